@@ -184,6 +184,14 @@ usage (void)
   fprintf(stderr, "                 - 1 One scan per component (default)\n");
   fprintf(stderr, "                 - 2 Optimize between one scan for all components and one scan for 1st component\n");
   fprintf(stderr, "                     plus one scan for remaining components\n");
+  fprintf(stderr, "  -scan-size-mode Candidate scan size mode for scan optimization\n");
+  fprintf(stderr, "                 - 0 Encode every candidate scan (default)\n");
+  fprintf(stderr, "                 - 1 Estimate candidate scan sizes (faster, but with -restart, can\n");
+  fprintf(stderr, "                     pick a slightly larger set of scans)\n");
+  fprintf(stderr, "  -huff-table-mode Optimized Huffman table generation mode\n");
+  fprintf(stderr, "                 - 0 JPEG Annex K procedure (default)\n");
+  fprintf(stderr, "                 - 1 Optimal length-limited codes (package-merge)\n");
+  fprintf(stderr, "  -huff-library  Use pre-trained Huffman tables for sequential images\n");
   fprintf(stderr, "  -notrellis     Disable trellis optimization\n");
   fprintf(stderr, "  -trellis-dc    Enable trellis optimization of DC coefficients (default)\n");
   fprintf(stderr, "  -notrellis-dc  Disable trellis optimization of DC coefficients\n");
@@ -217,6 +225,8 @@ usage (void)
   fprintf(stderr, "                 - 4 Custom, tuned for PSNR-HVS\n");
   fprintf(stderr, "                 - 5 Table from paper by Klein, Silverstein and Carney\n");
   fprintf(stderr, "  -restart N     Set restart interval in rows, or in blocks with B\n");
+  fprintf(stderr, "  -threads N     Use N worker threads for trellis quantization and scan\n");
+  fprintf(stderr, "                 optimization\n");
 #ifdef INPUT_SMOOTHING_SUPPORTED
   fprintf(stderr, "  -smooth N      Smooth dithered input (N=1..100 is strength)\n");
 #endif
@@ -388,6 +398,25 @@ parse_switches (j_compress_ptr cinfo, int argc, char **argv,
       }
       jpeg_c_set_int_param(cinfo, JINT_DC_SCAN_OPT_MODE, atoi(argv[argn]));
 
+    } else if (keymatch(arg, "scan-size-mode", 6)) {
+      if (++argn >= argc) {      /* advance to next argument */
+        fprintf(stderr, "%s: missing argument for scan-size-mode\n", progname);
+        usage();
+      }
+      jpeg_c_set_int_param(cinfo, JINT_SCAN_SIZE_MODE, atoi(argv[argn]));
+
+    } else if (keymatch(arg, "huff-table-mode", 4)) {
+      if (++argn >= argc) {      /* advance to next argument */
+        fprintf(stderr, "%s: missing argument for huff-table-mode\n",
+                progname);
+        usage();
+      }
+      jpeg_c_set_int_param(cinfo, JINT_HUFF_TABLE_MODE, atoi(argv[argn]));
+
+    } else if (keymatch(arg, "huff-library", 6)) {
+      /* Use the pre-trained Huffman tables instead of an optimization pass. */
+      jpeg_c_set_bool_param(cinfo, JBOOLEAN_HUFF_TABLE_LIBRARY, TRUE);
+
     } else if (keymatch(arg, "optimize", 1) || keymatch(arg, "optimise", 1)) {
       /* Enable entropy parm optimization. */
 #ifdef ENTROPY_OPT_SUPPORTED
@@ -531,6 +560,16 @@ parse_switches (j_compress_ptr cinfo, int argc, char **argv,
       /* Input file is Targa format. */
       is_targa = TRUE;
 
+    } else if (keymatch(arg, "threads", 2)) {
+      /* Set number of worker threads. */
+      int val;
+
+      if (++argn >= argc)       /* advance to next argument */
+        usage();
+      if (sscanf(argv[argn], "%d", &val) != 1 || val < 1)
+        usage();
+      jpeg_c_set_int_param(cinfo, JINT_NUM_THREADS, val);
+
     } else if (keymatch(arg, "notrellis-dc", 11)) {
       /* disable trellis quantization */
       jpeg_c_set_bool_param(cinfo, JBOOLEAN_TRELLIS_QUANT_DC, FALSE);
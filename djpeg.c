@@ -92,6 +92,7 @@ static IMAGE_FORMATS requested_fmt;
 static const char *progname;    /* program name for error messages */
 static char *outfilename;       /* for -outfile switch */
 boolean memsrc;                 /* for -memsrc switch */
+boolean buffered;               /* for -buffered switch */
 boolean skip, crop;
 JDIMENSION skip_start, skip_end;
 JDIMENSION crop_x, crop_y, crop_width, crop_height;
@@ -171,6 +172,7 @@ usage (void)
   fprintf(stderr, "  -memsrc        Load input file into memory before decompressing\n");
 #endif
 
+  fprintf(stderr, "  -buffered      Use buffered-image mode (read all input before output)\n");
   fprintf(stderr, "  -skip Y0,Y1    Decompress all rows except those between Y0 and Y1 (inclusive)\n");
   fprintf(stderr, "  -crop WxH+X+Y  Decompress only a rectangular subregion of the image\n");
   fprintf(stderr, "  -verbose  or  -debug   Emit debug output\n");
@@ -198,6 +200,7 @@ parse_switches (j_decompress_ptr cinfo, int argc, char **argv,
   requested_fmt = DEFAULT_FMT;  /* set default output file format */
   outfilename = NULL;
   memsrc = FALSE;
+  buffered = FALSE;
   skip = FALSE;
   crop = FALSE;
   cinfo->err->trace_level = 0;
@@ -220,6 +223,11 @@ parse_switches (j_decompress_ptr cinfo, int argc, char **argv,
       /* BMP output format. */
       requested_fmt = FMT_BMP;
 
+    } else if (keymatch(arg, "buffered", 2)) {
+      /* Decompress in buffered-image mode. */
+      buffered = TRUE;
+      cinfo->buffered_image = TRUE;
+
     } else if (keymatch(arg, "colors", 1) || keymatch(arg, "colours", 1) ||
                keymatch(arg, "quantize", 1) || keymatch(arg, "quantise", 1)) {
       /* Do color quantization. */
@@ -663,6 +671,15 @@ main (int argc, char **argv)
   /* Start decompressor */
   (void) jpeg_start_decompress(&cinfo);
 
+  /* In buffered-image mode, absorb the whole file and then emit the final
+   * image in a single output pass.
+   */
+  if (buffered) {
+    while (jpeg_consume_input(&cinfo) != JPEG_REACHED_EOI)
+      ;
+    (void) jpeg_start_output(&cinfo, cinfo.input_scan_number);
+  }
+
   /* Skip rows */
   if (skip) {
     JDIMENSION tmp;
@@ -758,6 +775,8 @@ main (int argc, char **argv)
    * I must do it in this order because output module has allocated memory
    * of lifespan JPOOL_IMAGE; it needs to finish before releasing memory.
    */
+  if (buffered)
+    (void) jpeg_finish_output(&cinfo);
   (*dest_mgr->finish_output) (&cinfo, dest_mgr);
   (void) jpeg_finish_decompress(&cinfo);
   jpeg_destroy_decompress(&cinfo);
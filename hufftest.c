@@ -0,0 +1,198 @@
+/*
+ * hufftest.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This program checks the Huffman tables that jpeg_gen_optimal_table()
+ * generates with JINT_HUFF_TABLE_MODE = 1 against those of the default
+ * procedure (JINT_HUFF_TABLE_MODE = 0.)  When no code needs more than 16 bits,
+ * the tables must be identical.  Otherwise, the package-merge table must be
+ * valid and must not take more bits than the default one.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jchuff.h"
+
+#define NUM_RANDOM_TESTS  1000
+
+static int failures = 0;
+static unsigned long rand_state = 1;
+
+
+static long next_rand (void)
+{
+  rand_state = rand_state * 1103515245 + 12345;
+  return (long)((rand_state >> 16) & 0x7fff);
+}
+
+
+/*
+ * Return the length of the longest code in an unrestricted Huffman code for
+ * the counts (plus the pseudo-symbol 256 with count 1), merging the trees in
+ * the same order as jpeg_gen_optimal_table().
+ */
+
+static int huffman_max_length (const long freq[])
+{
+  long counts[257];
+  int depth[257];
+  int c1, c2, i;
+
+  MEMCOPY(counts, freq, sizeof(counts));
+  MEMZERO(depth, sizeof(depth));
+  counts[256] = 1;
+  for (;;) {
+    c1 = c2 = -1;
+    for (i = 0; i <= 256; i++) {
+      if (counts[i] && (c1 < 0 || counts[i] <= counts[c1])) {
+        c2 = c1;
+        c1 = i;
+      } else if (counts[i] && (c2 < 0 || counts[i] <= counts[c2]))
+        c2 = i;
+    }
+    if (c2 < 0)
+      return depth[c1];
+    counts[c1] += counts[c2];
+    counts[c2] = 0;
+    depth[c1] = (depth[c1] > depth[c2] ? depth[c1] : depth[c2]) + 1;
+  }
+}
+
+
+/* Return the number of bits that the counts take with the table htbl */
+
+static double table_bits (JHUFF_TBL *htbl, const long freq[])
+{
+  double bits = 0.0;
+  int len, k, p = 0;
+
+  for (len = 1; len <= 16; len++) {
+    for (k = 0; k < htbl->bits[len]; k++)
+      bits += (double)freq[htbl->huffval[p++]] * len;
+  }
+  return bits;
+}
+
+
+static void gen_table (j_compress_ptr cinfo, int mode, const long freq[],
+                       JHUFF_TBL *htbl)
+{
+  long counts[257];
+
+  /* jpeg_gen_optimal_table() clobbers the counts */
+  MEMCOPY(counts, freq, sizeof(counts));
+  MEMZERO(htbl, sizeof(JHUFF_TBL));
+  jpeg_c_set_int_param(cinfo, JINT_HUFF_TABLE_MODE, mode);
+  jpeg_gen_optimal_table(cinfo, htbl, counts);
+}
+
+
+/*
+ * Return TRUE if htbl codes every symbol with a nonzero count, in at most
+ * 16 bits, with no code consisting of all ones.
+ */
+
+static boolean valid_table (JHUFF_TBL *htbl, const long freq[])
+{
+  long codes = 0;
+  int num_symbols = 0, num_nonzero = 0, len, i, j;
+
+  for (len = 1; len <= 16; len++) {
+    codes = codes * 2 + htbl->bits[len];
+    num_symbols += htbl->bits[len];
+  }
+  if (codes >= 65536L)
+    return FALSE;
+
+  for (i = 0; i < 256; i++) {
+    if (freq[i] == 0)
+      continue;
+    num_nonzero++;
+    for (j = 0; j < num_symbols && htbl->huffval[j] != i; j++);
+    if (j == num_symbols)
+      return FALSE;
+  }
+  return num_symbols == num_nonzero;
+}
+
+
+static void check (j_compress_ptr cinfo, const char *name, const long freq[],
+                   boolean must_match)
+{
+  JHUFF_TBL tbl0, tbl1;
+  double bits0, bits1;
+  boolean match;
+
+  gen_table(cinfo, 0, freq, &tbl0);
+  gen_table(cinfo, 1, freq, &tbl1);
+  bits0 = table_bits(&tbl0, freq);
+  bits1 = table_bits(&tbl1, freq);
+  match = !memcmp(tbl0.bits, tbl1.bits, sizeof(tbl0.bits)) &&
+          !memcmp(tbl0.huffval, tbl1.huffval, sizeof(tbl0.huffval));
+
+  if (!valid_table(&tbl1, freq)) {
+    printf("%s: invalid table\n", name);
+    failures++;
+  } else if (must_match && !match) {
+    printf("%s: tables differ\n", name);
+    failures++;
+  } else if (bits1 > bits0) {
+    printf("%s: %.0f bits with mode 1 vs. %.0f with mode 0\n", name, bits1,
+           bits0);
+    failures++;
+  }
+}
+
+
+int main (void)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  long freq[257];
+  char name[80];
+  int i, t, num_bind = 0;
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+
+  /* Counts that follow the Fibonacci sequence give the longest possible
+   * Huffman codes, so the 16-bit limit binds.
+   */
+  MEMZERO(freq, sizeof(freq));
+  freq[0] = freq[1] = 1;
+  for (i = 2; i < 24; i++)
+    freq[i] = freq[i - 1] + freq[i - 2];
+  check(&cinfo, "Fibonacci counts", freq, FALSE);
+
+  /* Random counts, some of them skewed enough for the limit to bind.  The
+   * tables must match whenever it does not.
+   */
+  for (t = 0; t < NUM_RANDOM_TESTS; t++) {
+    int max_shift = (int)(next_rand() % 24);
+
+    /* Spread the counts over several orders of magnitude */
+    MEMZERO(freq, sizeof(freq));
+    for (i = 0; i < 256; i++) {
+      if (next_rand() % 4 == 0)
+        freq[i] = (1L << (next_rand() % (max_shift + 1))) +
+                  next_rand() % 16;
+    }
+    sprintf(name, "random counts %d", t);
+    if (huffman_max_length(freq) > 16)
+      num_bind++;
+    check(&cinfo, name, freq, huffman_max_length(freq) <= 16);
+  }
+  printf("%d of %d random tables exceeded 16 bits\n", num_bind,
+         NUM_RANDOM_TESTS);
+
+  jpeg_destroy_compress(&cinfo);
+  if (failures) {
+    printf("%d test(s) FAILED\n", failures);
+    return 1;
+  }
+  printf("All Huffman table tests passed\n");
+  return 0;
+}
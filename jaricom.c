@@ -14,6 +14,9 @@
  * This data represents Table D.2 in the JPEG spec (ISO/IEC IS 10918-1
  * and CCITT Recommendation ITU-T T.81) and Table 24 in the JBIG spec
  * (ISO/IEC IS 11544 and CCITT Recommendation ITU-T T.82).
+ *
+ * It also contains a routine that expands the table into the combined form
+ * used by the encoder and decoder.
  */
 
 #define JPEG_INTERNALS
@@ -154,3 +157,35 @@ const JLONG jpeg_aritab[113+1] = {
  */
   V( 113, 0x5a1d, 113, 113, 0 )
 };
+
+
+/*
+ * Build the combined probability estimation and state transition table.
+ * The table is indexed directly by the contents of a statistics bin (the MPS
+ * sense in bit 7 and the state index in the lower bits), and each entry
+ * holds
+ *   bits 16-31: Qe_Value
+ *   bits 8-15:  new bin contents after coding the LPS
+ *   bits 0-7:   new bin contents after coding the MPS
+ * so the coders need not apply the MPS sense and Switch_MPS separately.
+ * Entries for state indices that do not exist are left as zero.
+ */
+
+GLOBAL(void)
+jpeg_make_arith_trans_tbl (JLONG *tbl)
+{
+  int sv;
+  JLONG qe, mps;
+
+  for (sv = 0; sv < 256; sv++) {
+    if ((sv & 0x7F) > 113) {
+      tbl[sv] = 0;
+      continue;
+    }
+    qe = jpeg_aritab[sv & 0x7F];
+    mps = sv & 0x80;
+    tbl[sv] = (qe >> 16) << 16 |               /* Qe_Value */
+              (mps ^ (qe & 0xFF)) << 8 |       /* Estimate_after_LPS */
+              (mps ^ ((qe >> 8) & 0xFF));      /* Estimate_after_MPS */
+  }
+}
@@ -45,6 +45,15 @@ typedef struct {
 
   /* Statistics bin for coding with fixed probability 0.5 */
   unsigned char fixed_bin[4];
+
+  /* Combined probability estimation and state transition table */
+  JLONG trans[256];
+
+  /* Estimated cost in bits of coding a 0 or a 1 with a statistics bin in
+   * each possible state, for trellis quantization (see jget_arith_rates())
+   */
+  float state_rates[256][2];
+  boolean state_rates_valid;
 } arith_entropy_encoder;
 
 typedef arith_entropy_encoder *arith_entropy_ptr;
@@ -113,6 +122,59 @@ typedef arith_entropy_encoder *arith_entropy_ptr;
 #define IRIGHT_SHIFT(x,shft)    ((x) >> (shft))
 #endif
 
+/* RENORM_SHIFT(a) returns the number of left shifts that renormalize the
+ * interval size a (0 < a < 0x8000), i.e. that bring it to 0x8000 or above.
+ */
+
+#if defined(__GNUC__)
+#define RENORM_SHIFT(a)  (__builtin_clz((unsigned int) (a)) - 16)
+#else
+#define RENORM_SHIFT(a)  renorm_shift(a)
+
+LOCAL(int)
+renorm_shift (JLONG a)
+{
+  int n = 0;
+
+  while (a < 0x8000L) {
+    a <<= 1;
+    n++;
+  }
+  return n;
+}
+#endif
+
+
+/*
+ * Return the index of the last coefficient, up to and including Se, that is
+ * set in a bitmap from the side information of a block (see jccoefct.c), or 0
+ * if there is none.  This is the end-of-block index that encode_mcu_AC_first()
+ * and encode_mcu_AC_refine() would otherwise establish by examining the
+ * coefficients themselves.
+ */
+
+LOCAL(int)
+last_coef_in_bitmap (const size_t *bitmap, int Se)
+{
+  int w = Se / BITMAP_WORD_BITS;
+  size_t word;
+
+  word = bitmap[w] & ((((size_t) 2) << (Se % BITMAP_WORD_BITS)) - 1);
+  while (word == 0) {
+    if (--w < 0)
+      return 0;
+    word = bitmap[w];
+  }
+#if defined(__GNUC__)
+  return w * BITMAP_WORD_BITS + 63 - __builtin_clzll((unsigned long long) word);
+#else
+  Se = w * BITMAP_WORD_BITS;
+  while (word >>= 1)
+    Se++;
+  return Se;
+#endif
+}
+
 
 LOCAL(void)
 emit_byte (int val, j_compress_ptr cinfo)
@@ -131,6 +193,30 @@ emit_byte (int val, j_compress_ptr cinfo)
 }
 
 
+LOCAL(void)
+emit_zeros (JLONG count, j_compress_ptr cinfo)
+/* Write count > 0 pending zero bytes, as many at a time as the buffer holds */
+{
+  struct jpeg_destination_mgr *dest = cinfo->dest;
+  size_t n;
+
+  if (cinfo->master->trellis_passes)
+    return;
+
+  do {
+    n = dest->free_in_buffer;
+    if ((JLONG) n > count)
+      n = (size_t) count;
+    MEMZERO(dest->next_output_byte, n);
+    dest->next_output_byte += n;
+    count -= (JLONG) n;
+    if ((dest->free_in_buffer -= n) == 0)
+      if (! (*dest->empty_output_buffer) (cinfo))
+        ERREXIT(cinfo, JERR_CANT_SUSPEND);
+  } while (count > 0);
+}
+
+
 /*
  * Finish up at the end of an arithmetic-compressed scan.
  */
@@ -154,9 +240,10 @@ finish_pass (j_compress_ptr cinfo)
   if (e->c & 0xF8000000L) {
     /* One final overflow has to be handled */
     if (e->buffer >= 0) {
-      if (e->zc)
-        do emit_byte(0x00, cinfo);
-        while (--e->zc);
+      if (e->zc) {
+        emit_zeros(e->zc, cinfo);
+        e->zc = 0;
+      }
       emit_byte(e->buffer + 1, cinfo);
       if (e->buffer + 1 == 0xFF)
         emit_byte(0x00, cinfo);
@@ -167,15 +254,17 @@ finish_pass (j_compress_ptr cinfo)
     if (e->buffer == 0)
       ++e->zc;
     else if (e->buffer >= 0) {
-      if (e->zc)
-        do emit_byte(0x00, cinfo);
-        while (--e->zc);
+      if (e->zc) {
+        emit_zeros(e->zc, cinfo);
+        e->zc = 0;
+      }
       emit_byte(e->buffer, cinfo);
     }
     if (e->sc) {
-      if (e->zc)
-        do emit_byte(0x00, cinfo);
-        while (--e->zc);
+      if (e->zc) {
+        emit_zeros(e->zc, cinfo);
+        e->zc = 0;
+      }
       do {
         emit_byte(0xFF, cinfo);
         emit_byte(0x00, cinfo);
@@ -184,9 +273,10 @@ finish_pass (j_compress_ptr cinfo)
   }
   /* Output final bytes only if they are not 0x00 */
   if (e->c & 0x7FFF800L) {
-    if (e->zc)  /* output final pending zero bytes */
-      do emit_byte(0x00, cinfo);
-      while (--e->zc);
+    if (e->zc) {  /* output final pending zero bytes */
+      emit_zeros(e->zc, cinfo);
+      e->zc = 0;
+    }
     emit_byte((e->c >> 19) & 0xFF, cinfo);
     if (((e->c >> 19) & 0xFF) == 0xFF)
       emit_byte(0x00, cinfo);
@@ -199,13 +289,68 @@ finish_pass (j_compress_ptr cinfo)
 }
 
 
+/*
+ * Output the byte that has just been completed in the C register (bits
+ * 19-27, including the carry), per section D.1.6, and make room for the
+ * next one.
+ */
+
+LOCAL(void)
+byte_out (arith_entropy_ptr e, j_compress_ptr cinfo)
+{
+  register JLONG temp;
+
+  temp = e->c >> 19;
+  if (temp > 0xFF) {
+    /* Handle overflow over all stacked 0xFF bytes */
+    if (e->buffer >= 0) {
+      if (e->zc) {
+        emit_zeros(e->zc, cinfo);
+        e->zc = 0;
+      }
+      emit_byte(e->buffer + 1, cinfo);
+      if (e->buffer + 1 == 0xFF)
+        emit_byte(0x00, cinfo);
+    }
+    e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
+    e->sc = 0;
+    /* Note: The 3 spacer bits in the C register guarantee
+     * that the new buffer byte can't be 0xFF here
+     * (see page 160 in the P&M JPEG book). */
+    e->buffer = temp & 0xFF;  /* new output byte, might overflow later */
+  } else if (temp == 0xFF) {
+    ++e->sc;  /* stack 0xFF byte (which might overflow later) */
+  } else {
+    /* Output all stacked 0xFF bytes, they will not overflow any more */
+    if (e->buffer == 0)
+      ++e->zc;
+    else if (e->buffer >= 0) {
+      if (e->zc) {
+        emit_zeros(e->zc, cinfo);
+        e->zc = 0;
+      }
+      emit_byte(e->buffer, cinfo);
+    }
+    if (e->sc) {
+      if (e->zc) {
+        emit_zeros(e->zc, cinfo);
+        e->zc = 0;
+      }
+      do {
+        emit_byte(0xFF, cinfo);
+        emit_byte(0x00, cinfo);
+      } while (--e->sc);
+    }
+    e->buffer = temp & 0xFF;  /* new output byte (can still overflow) */
+  }
+  e->c &= 0x7FFFFL;
+  e->ct += 8;
+}
+
+
 /*
  * The core arithmetic encoding routine (common in JPEG and JBIG).
  * This needs to go as fast as possible.
- * Machine-dependent optimization facilities
- * are not utilized in this portable implementation.
- * However, this code should be fairly efficient and
- * may be a good base for further optimizations anyway.
  *
  * Parameter 'val' to be encoded may be 0 or 1 (binary decision).
  *
@@ -216,26 +361,23 @@ finish_pass (j_compress_ptr cinfo)
  * stream compliant to the spec (no trailing zero bytes,
  * except for FF stuffing).
  *
- * I've also introduced a new scheme for accessing
- * the probability estimation state machine table,
- * derived from Markus Kuhn's JBIG implementation.
+ * The probability estimation state machine is accessed through the
+ * combined table built by jpeg_make_arith_trans_tbl(), which yields Qe and
+ * both successor states with a single lookup.  Renormalization shifts the
+ * A and C registers by the whole required amount at once rather than one
+ * bit at a time, stopping only at byte boundaries to output data.
  */
 
 LOCAL(void)
 arith_encode (j_compress_ptr cinfo, unsigned char *st, int val)
 {
   register arith_entropy_ptr e = (arith_entropy_ptr) cinfo->entropy;
-  register unsigned char nl, nm;
-  register JLONG qe, temp;
-  register int sv;
+  register JLONG qe, t;
+  register int sv, n;
 
-  /* Fetch values from our compact representation of Table D.2:
-   * Qe values and probability estimation state machine
-   */
   sv = *st;
-  qe = jpeg_aritab[sv & 0x7F];  /* => Qe_Value */
-  nl = qe & 0xFF; qe >>= 8;     /* Next_Index_LPS + Switch_MPS */
-  nm = qe & 0xFF; qe >>= 8;     /* Next_Index_MPS */
+  t = e->trans[sv];
+  qe = t >> 16;                 /* => Qe_Value */
 
   /* Encode & estimation procedures per sections D.1.4 & D.1.5 */
   e->a -= qe;
@@ -249,7 +391,7 @@ arith_encode (j_compress_ptr cinfo, unsigned char *st, int val)
       e->c += e->a;
       e->a = qe;
     }
-    *st = (sv & 0x80) ^ nl;     /* Estimate_after_LPS */
+    *st = (unsigned char) (t >> 8);     /* Estimate_after_LPS */
   } else {
     /* Encode the more probable symbol */
     if (e->a >= 0x8000L)
@@ -261,59 +403,21 @@ arith_encode (j_compress_ptr cinfo, unsigned char *st, int val)
       e->c += e->a;
       e->a = qe;
     }
-    *st = (sv & 0x80) ^ nm;     /* Estimate_after_MPS */
+    *st = (unsigned char) t;            /* Estimate_after_MPS */
   }
 
   /* Renormalization & data output per section D.1.6 */
-  do {
-    e->a <<= 1;
-    e->c <<= 1;
-    if (--e->ct == 0) {
-      /* Another byte is ready for output */
-      temp = e->c >> 19;
-      if (temp > 0xFF) {
-        /* Handle overflow over all stacked 0xFF bytes */
-        if (e->buffer >= 0) {
-          if (e->zc)
-            do emit_byte(0x00, cinfo);
-            while (--e->zc);
-          emit_byte(e->buffer + 1, cinfo);
-          if (e->buffer + 1 == 0xFF)
-            emit_byte(0x00, cinfo);
-        }
-        e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
-        e->sc = 0;
-        /* Note: The 3 spacer bits in the C register guarantee
-         * that the new buffer byte can't be 0xFF here
-         * (see page 160 in the P&M JPEG book). */
-        e->buffer = temp & 0xFF;  /* new output byte, might overflow later */
-      } else if (temp == 0xFF) {
-        ++e->sc;  /* stack 0xFF byte (which might overflow later) */
-      } else {
-        /* Output all stacked 0xFF bytes, they will not overflow any more */
-        if (e->buffer == 0)
-          ++e->zc;
-        else if (e->buffer >= 0) {
-          if (e->zc)
-            do emit_byte(0x00, cinfo);
-            while (--e->zc);
-          emit_byte(e->buffer, cinfo);
-        }
-        if (e->sc) {
-          if (e->zc)
-            do emit_byte(0x00, cinfo);
-            while (--e->zc);
-          do {
-            emit_byte(0xFF, cinfo);
-            emit_byte(0x00, cinfo);
-          } while (--e->sc);
-        }
-        e->buffer = temp & 0xFF;  /* new output byte (can still overflow) */
-      }
-      e->c &= 0x7FFFFL;
-      e->ct += 8;
-    }
-  } while (e->a < 0x8000L);
+  n = RENORM_SHIFT(e->a);
+  e->a <<= n;
+  while (n >= e->ct) {
+    /* Another byte is ready for output */
+    e->c <<= e->ct;
+    n -= e->ct;
+    e->ct = 0;
+    byte_out(e, cinfo);
+  }
+  e->c <<= n;
+  e->ct -= n;
 }
 
 
@@ -482,17 +586,22 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   /* Sections F.1.4.2 & F.1.4.4.2: Encoding of AC coefficients */
 
   /* Establish EOB (end-of-block) index */
-  for (ke = cinfo->Se; ke > 0; ke--)
-    /* We must apply the point transform by Al.  For AC coefficients this
-     * is an integer division with rounding towards 0.  To do this portably
-     * in C, we shift after obtaining the absolute value.
-     */
-    if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
-      if (v >>= cinfo->Al) break;
-    } else {
-      v = -v;
-      if (v >>= cinfo->Al) break;
-    }
+  if (cinfo->coef->MCU_info != NULL && cinfo->Al <= BLOCK_INFO_MAX_AL)
+    ke = last_coef_in_bitmap(cinfo->coef->MCU_info[0]->nonzero[cinfo->Al],
+                             cinfo->Se);
+  else {
+    for (ke = cinfo->Se; ke > 0; ke--)
+      /* We must apply the point transform by Al.  For AC coefficients this
+       * is an integer division with rounding towards 0.  To do this portably
+       * in C, we shift after obtaining the absolute value.
+       */
+      if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
+        if (v >>= cinfo->Al) break;
+      } else {
+        v = -v;
+        if (v >>= cinfo->Al) break;
+      }
+  }
 
   /* Figure F.5: Encode_AC_Coefficients */
   for (k = cinfo->Ss; k <= ke; k++) {
@@ -616,26 +725,36 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   /* Section G.1.3.3: Encoding of AC coefficients */
 
   /* Establish EOB (end-of-block) index */
-  for (ke = cinfo->Se; ke > 0; ke--)
-    /* We must apply the point transform by Al.  For AC coefficients this
-     * is an integer division with rounding towards 0.  To do this portably
-     * in C, we shift after obtaining the absolute value.
-     */
-    if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
-      if (v >>= cinfo->Al) break;
-    } else {
-      v = -v;
-      if (v >>= cinfo->Al) break;
-    }
+  if (cinfo->coef->MCU_info != NULL && cinfo->Al <= BLOCK_INFO_MAX_AL)
+    ke = last_coef_in_bitmap(cinfo->coef->MCU_info[0]->nonzero[cinfo->Al],
+                             cinfo->Se);
+  else {
+    for (ke = cinfo->Se; ke > 0; ke--)
+      /* We must apply the point transform by Al.  For AC coefficients this
+       * is an integer division with rounding towards 0.  To do this portably
+       * in C, we shift after obtaining the absolute value.
+       */
+      if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
+        if (v >>= cinfo->Al) break;
+      } else {
+        v = -v;
+        if (v >>= cinfo->Al) break;
+      }
+  }
 
   /* Establish EOBx (previous stage end-of-block) index */
-  for (kex = ke; kex > 0; kex--)
-    if ((v = (*block)[jpeg_natural_order[kex]]) >= 0) {
-      if (v >>= cinfo->Ah) break;
-    } else {
-      v = -v;
-      if (v >>= cinfo->Ah) break;
-    }
+  if (cinfo->coef->MCU_info != NULL && cinfo->Ah <= BLOCK_INFO_MAX_AL)
+    kex = last_coef_in_bitmap(cinfo->coef->MCU_info[0]->nonzero[cinfo->Ah],
+                              ke);
+  else {
+    for (kex = ke; kex > 0; kex--)
+      if ((v = (*block)[jpeg_natural_order[kex]]) >= 0) {
+        if (v >>= cinfo->Ah) break;
+      } else {
+        v = -v;
+        if (v >>= cinfo->Ah) break;
+      }
+  }
 
   /* Figure G.10: Encode_AC_Coefficients_SA */
   for (k = cinfo->Ss; k <= ke; k++) {
@@ -933,35 +1052,67 @@ jinit_arith_encoder (j_compress_ptr cinfo)
 
   /* Initialize index for fixed probability estimation */
   entropy->fixed_bin[0] = 113;
+
+  jpeg_make_arith_trans_tbl(entropy->trans);
+  entropy->state_rates_valid = FALSE;
+}
+
+
+LOCAL(void)
+build_state_rates (arith_entropy_ptr entropy)
+/* Compute the cost of coding a 0 or a 1 with a bin in each possible state */
+{
+  int state;
+
+  for (state = 0; state < 256; state++) {
+    int mps_val = state >> 7;
+    float prob_lps, prob_0, prob_1;
+
+    if ((state & 0x7f) > 113) {
+      /* Not a valid state; never occurs in a statistics bin */
+      entropy->state_rates[state][0] = entropy->state_rates[state][1] = 0;
+      continue;
+    }
+    prob_lps = (jpeg_aritab[state & 0x7f] >> 16) / 46340.95; /* 32768*sqrt(2) */
+    prob_0 = (mps_val) ? prob_lps : 1.0 - prob_lps;
+    prob_1 = 1.0 - prob_0;
+    entropy->state_rates[state][0] = -log(prob_0) / log(2.0);
+    entropy->state_rates[state][1] = -log(prob_1) / log(2.0);
+  }
+  entropy->state_rates_valid = TRUE;
 }
 
+
+/*
+ * Fill in the rate model used by trellis quantization with arithmetic coding
+ * (quantize_trellis_arith() in jcdctmgr.c) from the current statistics of
+ * the given tables.  The cost of each decision depends only on the state of
+ * its statistics bin, so the costs are computed once per state and then
+ * looked up.
+ */
+
 GLOBAL(void)
 jget_arith_rates (j_compress_ptr cinfo, int dc_tbl_no, int ac_tbl_no, arith_rates *r)
 {
   int i;
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
-  
+  unsigned char *dc_stats = entropy->dc_stats[dc_tbl_no];
+  unsigned char *ac_stats = entropy->ac_stats[ac_tbl_no];
+
+  if (!entropy->state_rates_valid)
+    build_state_rates(entropy);
+
   r->arith_dc_L = cinfo->arith_dc_L[dc_tbl_no];
   r->arith_dc_U = cinfo->arith_dc_U[dc_tbl_no];
   r->arith_ac_K = cinfo->arith_ac_K[ac_tbl_no];
-  
+
   for (i = 0; i < DC_STAT_BINS; i++) {
-    int state = entropy->dc_stats[dc_tbl_no][i];
-    int mps_val = state >> 7;
-    float prob_lps = (jpeg_aritab[state & 0x7f] >> 16) / 46340.95; /* 32768*sqrt(2) */
-    float prob_0 = (mps_val) ? prob_lps : 1.0 - prob_lps;
-    float prob_1 = 1.0 - prob_0;
-    r->rate_dc[i][0] = -log(prob_0) / log(2.0);
-    r->rate_dc[i][1] = -log(prob_1) / log(2.0);
+    r->rate_dc[i][0] = entropy->state_rates[dc_stats[i]][0];
+    r->rate_dc[i][1] = entropy->state_rates[dc_stats[i]][1];
   }
 
   for (i = 0; i < AC_STAT_BINS; i++) {
-    int state = entropy->ac_stats[ac_tbl_no][i];
-    int mps_val = state >> 7;
-    float prob_lps = (jpeg_aritab[state & 0x7f] >> 16) / 46340.95;
-    float prob_0 = (mps_val) ? prob_lps : 1.0 - prob_lps;
-    float prob_1 = 1.0 - prob_0;
-    r->rate_ac[i][0] = -log(prob_0) / log(2.0);
-    r->rate_ac[i][1] = -log(prob_1) / log(2.0);
+    r->rate_ac[i][0] = entropy->state_rates[ac_stats[i]][0];
+    r->rate_ac[i][1] = entropy->state_rates[ac_stats[i]][1];
   }
 }
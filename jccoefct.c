@@ -18,6 +18,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jchuff.h"
+#include "jthread.h"
 
 /* We use a full-image coefficient buffer when doing Huffman optimization,
  * and also for writing multiple-scan JPEG files.  In all cases, the DCT
@@ -33,6 +34,21 @@
 #endif
 
 
+/* Entropy coding statistics used to drive trellis quantization of one
+ * component.  The Huffman tables are fixed for the duration of a pass, but
+ * the arithmetic coding statistics evolve as the pass proceeds, so the latter
+ * are rebuilt for every iMCU row.
+ */
+
+typedef struct {
+  c_derived_tbl dctbl;
+  c_derived_tbl actbl;
+#ifdef C_ARITH_CODING_SUPPORTED
+  arith_rates arith_r;
+#endif
+} trellis_tables;
+
+
 /* Private buffer controller object */
 
 typedef struct {
@@ -57,6 +73,28 @@ typedef struct {
   /* when using trellis quantization, need to keep a copy of all unquantized coefficients */
   jvirt_barray_ptr whole_image_uq[MAX_COMPONENTS];
 
+  /* TRUE if the current trellis pass has already requantized the whole scan
+   * (multi-threaded mode)
+   */
+  boolean trellis_done;
+
+  /* Trellis quantization scratch storage, one per worker thread */
+  trellis_workspace *trellis_ws;
+
+  /* Rate models for the components of the current scan, as used by
+   * compress_trellis_pass(), and whether they have been built for the current
+   * pass (with arithmetic coding, they are rebuilt for every iMCU row anyway)
+   */
+  trellis_tables *trellis_tbl;
+  boolean trellis_tbl_valid;
+
+  /* Side information for the blocks of each virtual array, indexed by block
+   * row (NULL until alloc_block_info() has been called), and for those of the
+   * current MCU.
+   */
+  jblock_info **block_info[MAX_COMPONENTS];
+  jblock_info *MCU_info[C_MAX_BLOCKS_IN_MCU];
+
 } my_coef_controller;
 
 typedef my_coef_controller *my_coef_ptr;
@@ -73,6 +111,8 @@ METHODDEF(boolean) compress_output
 #endif
 METHODDEF(boolean) compress_trellis_pass
         (j_compress_ptr cinfo, JSAMPIMAGE input_buf);
+METHODDEF(boolean) compress_trellis_pass_threaded
+        (j_compress_ptr cinfo, JSAMPIMAGE input_buf);
 
 
 LOCAL(void)
@@ -99,6 +139,137 @@ start_iMCU_row (j_compress_ptr cinfo)
 }
 
 
+/*
+ * Block side information.
+ * Each candidate scan of a progressive encode takes two passes over the
+ * coefficients (one to gather statistics and one to output the scan), and
+ * every AC scan examines all the coefficients of its spectral band in every
+ * block, mostly to find that they are zero.  Once the coefficients are final,
+ * we therefore compute a jblock_info for every block, the bitmaps of its
+ * coefficients that are nonzero for each Al, and hand it to the entropy
+ * encoder along with the block (see jcphuff.c and jcarith.c.)  This takes a
+ * quarter of the memory taken by the virtual arrays.
+ *
+ * Without trellis quantization, the coefficients are final as soon as the
+ * first pass has quantized them, so the first pass computes the side
+ * information of each iMCU row right after the DCT, while the row is still in
+ * the cache.  Otherwise build_block_info() computes it in a separate pass over
+ * the coefficients once the trellis passes are done.
+ */
+
+LOCAL(void)
+compute_block_info (JCOEFPTR block, jblock_info *info)
+{
+  register int temp, k, Al;
+  size_t bit;
+
+  MEMZERO(info, sizeof(jblock_info));
+
+  for (k = 1; k < DCTSIZE2; k++) {
+    temp = block[jpeg_natural_order[k]];
+    if (temp == 0)
+      continue;
+    if (temp < 0)
+      temp = -temp;
+    bit = ((size_t) 1) << (k % BITMAP_WORD_BITS);
+    for (Al = 0; Al <= BLOCK_INFO_MAX_AL && (temp >> Al); Al++)
+      info->nonzero[Al][k / BITMAP_WORD_BITS] |= bit;
+  }
+}
+
+
+LOCAL(void)
+alloc_block_info (j_compress_ptr cinfo)
+/* Allocate the side information for all the blocks of the virtual arrays */
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JDIMENSION iMCU_row_num, blocks_across;
+  int ci, block_row;
+  jpeg_component_info *compptr;
+  jblock_info **rows, *info;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    blocks_across = (JDIMENSION) jround_up((long) compptr->width_in_blocks,
+                                           (long) compptr->h_samp_factor);
+    rows = (jblock_info **)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  cinfo->total_iMCU_rows *
+                                  compptr->v_samp_factor *
+                                  sizeof(jblock_info *));
+    for (iMCU_row_num = 0; iMCU_row_num < cinfo->total_iMCU_rows;
+         iMCU_row_num++) {
+      info = (jblock_info *)
+        (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                    compptr->v_samp_factor * blocks_across *
+                                    sizeof(jblock_info));
+      for (block_row = 0; block_row < compptr->v_samp_factor; block_row++) {
+        rows[iMCU_row_num * compptr->v_samp_factor + block_row] = info;
+        info += blocks_across;
+      }
+    }
+    coef->block_info[ci] = rows;
+  }
+}
+
+
+LOCAL(void)
+compute_block_info_row (j_compress_ptr cinfo, jpeg_component_info *compptr,
+                        JDIMENSION iMCU_row_num, JBLOCKARRAY buffer)
+/* Compute the side information for the blocks of one iMCU row of a
+ * component, including the dummy blocks, given the row's virtual array strip
+ */
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JDIMENSION blocks_across, bi;
+  int block_row;
+  jblock_info *info;
+
+  blocks_across = (JDIMENSION) jround_up((long) compptr->width_in_blocks,
+                                         (long) compptr->h_samp_factor);
+  for (block_row = 0; block_row < compptr->v_samp_factor; block_row++) {
+    info = coef->block_info[compptr->component_index]
+             [iMCU_row_num * compptr->v_samp_factor + block_row];
+    for (bi = 0; bi < blocks_across; bi++)
+      compute_block_info(buffer[block_row][bi], info++);
+  }
+}
+
+
+LOCAL(void)
+build_block_info (j_compress_ptr cinfo)
+/* Compute the side information for all the blocks of the virtual arrays,
+ * if it is useful and has not been done yet
+ */
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JDIMENSION iMCU_row_num;
+  int ci;
+  jpeg_component_info *compptr;
+  JBLOCKARRAY buffer;
+
+  /* Only progressive scans make use of it, and the coefficients may still
+   * change during the trellis quantization passes.
+   */
+  if (coef->block_info[0] != NULL || ! cinfo->progressive_mode ||
+      cinfo->master->trellis_passes)
+    return;
+
+  alloc_block_info(cinfo);
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    for (iMCU_row_num = 0; iMCU_row_num < cinfo->total_iMCU_rows;
+         iMCU_row_num++) {
+      buffer = (*cinfo->mem->access_virt_barray)
+        ((j_common_ptr) cinfo, coef->whole_image[ci],
+         iMCU_row_num * compptr->v_samp_factor,
+         (JDIMENSION) compptr->v_samp_factor, FALSE);
+      compute_block_info_row(cinfo, compptr, iMCU_row_num, buffer);
+    }
+  }
+}
+
+
 /*
  * Initialize for a processing pass.
  */
@@ -110,6 +281,7 @@ start_pass_coef (j_compress_ptr cinfo, J_BUF_MODE pass_mode)
 
   coef->iMCU_row_num = 0;
   start_iMCU_row(cinfo);
+  coef->pub.MCU_info = NULL;
 
   switch (pass_mode) {
   case JBUF_PASS_THRU:
@@ -122,17 +294,31 @@ start_pass_coef (j_compress_ptr cinfo, J_BUF_MODE pass_mode)
     if (coef->whole_image[0] == NULL)
       ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
     coef->pub.compress_data = compress_first_pass;
+    /* See "Block side information" above */
+    if (cinfo->progressive_mode && !cinfo->master->trellis_quant) {
+      if (coef->block_info[0] == NULL)
+        alloc_block_info(cinfo);
+      coef->pub.MCU_info = coef->MCU_info;
+    }
     break;
   case JBUF_CRANK_DEST:
     if (coef->whole_image[0] == NULL)
       ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
     coef->pub.compress_data = compress_output;
+    build_block_info(cinfo);
+    if (coef->block_info[0] != NULL)
+      coef->pub.MCU_info = coef->MCU_info;
     break;
 #endif
   case JBUF_REQUANT:
     if (coef->whole_image[0] == NULL)
       ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
-    coef->pub.compress_data = compress_trellis_pass;
+    coef->trellis_done = FALSE;
+    coef->trellis_tbl_valid = FALSE;
+    if (cinfo->master->num_threads > 1 && !cinfo->arith_code)
+      coef->pub.compress_data = compress_trellis_pass_threaded;
+    else
+      coef->pub.compress_data = compress_trellis_pass;
     break;
       
   default:
@@ -339,6 +525,8 @@ compress_first_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
         }
       }
     }
+    if (coef->pub.MCU_info != NULL)
+      compute_block_info_row(cinfo, compptr, coef->iMCU_row_num, buffer);
   }
   /* NB: compress_output will increment iMCU_row_num if successful.
    * A suspension return will result in redoing all the work above next time.
@@ -348,41 +536,155 @@ compress_first_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
   return compress_output(cinfo, input_buf);
 }
 
-METHODDEF(boolean)
-compress_trellis_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
+LOCAL(void)
+get_trellis_tables (j_compress_ptr cinfo, jpeg_component_info *compptr,
+                    trellis_tables *tables)
+{
+  c_derived_tbl *dctbl = &tables->dctbl;
+  c_derived_tbl *actbl = &tables->actbl;
+
+#ifdef C_ARITH_CODING_SUPPORTED
+  if (cinfo->arith_code)
+    jget_arith_rates(cinfo, compptr->dc_tbl_no, compptr->ac_tbl_no,
+                     &tables->arith_r);
+  else
+#endif
+  {
+    jpeg_make_c_derived_tbl(cinfo, TRUE, compptr->dc_tbl_no, &dctbl);
+    jpeg_make_c_derived_tbl(cinfo, FALSE, compptr->ac_tbl_no, &actbl);
+  }
+}
+
+
+/*
+ * Requantize one component's share of an iMCU row using trellis quantization,
+ * and regenerate the dummy blocks at the right and lower edges of the image.
+ * buffer and buffer_dst point to the first block row of the iMCU row in the
+ * quantized and unquantized virtual arrays, respectively.
+ *
+ * Rows within an iMCU row are coupled through the DC predictor and, for DC
+ * trellis quantization, through the reconstructed DC values of the row above.
+ * Different iMCU rows and components are completely independent, which is
+ * what allows compress_trellis_pass_mt() to process them concurrently.
+ *
+ * If accumulate_norms is FALSE, the statistics for trellis_q_opt are not
+ * accumulated; the caller is then responsible for calling
+ * accumulate_trellis_norms() on the row.
+ */
+
+LOCAL(void)
+trellis_quantize_row (j_compress_ptr cinfo, jpeg_component_info *compptr,
+                      JDIMENSION iMCU_row_num, JBLOCKARRAY buffer,
+                      JBLOCKARRAY buffer_dst, trellis_tables *tables,
+                      trellis_workspace *ws, boolean accumulate_norms)
 {
-  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
   JDIMENSION blocks_across, MCUs_across, MCUindex;
-  int bi, ci, h_samp_factor, block_row, block_rows, ndummy;
+  int bi, h_samp_factor, block_row, block_rows, ndummy;
+  int tblno = compptr->quant_tbl_no;
+  double *norm_src = accumulate_norms ? cinfo->master->norm_src[tblno] : NULL;
+  double *norm_coef = accumulate_norms ? cinfo->master->norm_coef[tblno] : NULL;
   JCOEF lastDC;
-  jpeg_component_info *compptr;
-  JBLOCKARRAY buffer;
   JBLOCKROW thisblockrow, lastblockrow;
-  JBLOCKARRAY buffer_dst;
 
-  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
-    c_derived_tbl dctbl_data;
-    c_derived_tbl *dctbl = &dctbl_data;
-    c_derived_tbl actbl_data;
-    c_derived_tbl *actbl = &actbl_data;
-    
-#ifdef C_ARITH_CODING_SUPPORTED
-    arith_rates arith_r_data;
-    arith_rates *arith_r = &arith_r_data;
-#endif
-    
-    compptr = cinfo->cur_comp_info[ci];
+  /* Count non-dummy DCT block rows in this iMCU row. */
+  if (iMCU_row_num < last_iMCU_row)
+    block_rows = compptr->v_samp_factor;
+  else {
+    /* NB: can't use last_row_height here, since may not be set! */
+    block_rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
+    if (block_rows == 0) block_rows = compptr->v_samp_factor;
+  }
+  blocks_across = compptr->width_in_blocks;
+  h_samp_factor = compptr->h_samp_factor;
+  /* Count number of dummy blocks to be added at the right margin. */
+  ndummy = (int) (blocks_across % h_samp_factor);
+  if (ndummy > 0)
+    ndummy = h_samp_factor - ndummy;
 
+  lastDC = 0;
+
+  /* Requantize all non-dummy blocks in this iMCU row.  Each call
+   * processes a complete horizontal row of DCT blocks.
+   */
+  for (block_row = 0; block_row < block_rows; block_row++) {
+    thisblockrow = buffer[block_row];
+    lastblockrow = (block_row > 0) ? buffer[block_row-1] : NULL;
 #ifdef C_ARITH_CODING_SUPPORTED
     if (cinfo->arith_code)
-      jget_arith_rates(cinfo, compptr->dc_tbl_no, compptr->ac_tbl_no, arith_r);
+      quantize_trellis_arith(cinfo, &tables->arith_r, thisblockrow,
+                             buffer_dst[block_row], blocks_across,
+                             cinfo->quant_tbl_ptrs[tblno],
+                             norm_src, norm_coef,
+                             &lastDC, lastblockrow, buffer_dst[block_row-1],
+                             ws);
     else
 #endif
-    {
-      jpeg_make_c_derived_tbl(cinfo, TRUE, compptr->dc_tbl_no, &dctbl);
-      jpeg_make_c_derived_tbl(cinfo, FALSE, compptr->ac_tbl_no, &actbl);
+      quantize_trellis(cinfo, &tables->dctbl, &tables->actbl, thisblockrow,
+                       buffer_dst[block_row], blocks_across,
+                       cinfo->quant_tbl_ptrs[tblno],
+                       norm_src, norm_coef,
+                       &lastDC, lastblockrow, buffer_dst[block_row-1], ws);
+
+    if (ndummy > 0) {
+      /* Create dummy blocks at the right edge of the image. */
+      thisblockrow += blocks_across; /* => first dummy block */
+      jzero_far((void *) thisblockrow, ndummy * sizeof(JBLOCK));
+      lastDC = thisblockrow[-1][0];
+      for (bi = 0; bi < ndummy; bi++) {
+        thisblockrow[bi][0] = lastDC;
+      }
+    }
+  }
+  /* If at end of image, create dummy block rows as needed.
+   * The tricky part here is that within each MCU, we want the DC values
+   * of the dummy blocks to match the last real block's DC value.
+   * This squeezes a few more bytes out of the resulting file...
+   */
+  if (iMCU_row_num == last_iMCU_row) {
+    blocks_across += ndummy;  /* include lower right corner */
+    MCUs_across = blocks_across / h_samp_factor;
+    for (block_row = block_rows; block_row < compptr->v_samp_factor;
+         block_row++) {
+      thisblockrow = buffer[block_row];
+      lastblockrow = buffer[block_row-1];
+      jzero_far((void *) thisblockrow,
+                (size_t) (blocks_across * sizeof(JBLOCK)));
+      for (MCUindex = 0; MCUindex < MCUs_across; MCUindex++) {
+        lastDC = lastblockrow[h_samp_factor-1][0];
+        for (bi = 0; bi < h_samp_factor; bi++) {
+          thisblockrow[bi][0] = lastDC;
+        }
+        thisblockrow += h_samp_factor; /* advance to next MCU in row */
+        lastblockrow += h_samp_factor;
+      }
     }
+  }
+}
+
+
+METHODDEF(boolean)
+compress_trellis_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  int ci;
+  jpeg_component_info *compptr;
+  JBLOCKARRAY buffer;
+  JBLOCKARRAY buffer_dst;
+  trellis_tables *tables;
+  int i;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+
+    /* Components that use the same pair of tables share one rate model. */
+    for (i = 0; i < ci; i++)
+      if (cinfo->cur_comp_info[i]->dc_tbl_no == compptr->dc_tbl_no &&
+          cinfo->cur_comp_info[i]->ac_tbl_no == compptr->ac_tbl_no)
+        break;
+    tables = &coef->trellis_tbl[i];
+    if (i == ci && (cinfo->arith_code || !coef->trellis_tbl_valid))
+      get_trellis_tables(cinfo, compptr, tables);
 
     /* Align the virtual buffer for this component. */
     buffer = (*cinfo->mem->access_virt_barray)
@@ -394,82 +696,11 @@ compress_trellis_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
     ((j_common_ptr) cinfo, coef->whole_image_uq[compptr->component_index],
      coef->iMCU_row_num * compptr->v_samp_factor,
      (JDIMENSION) compptr->v_samp_factor, TRUE);
-    
-    /* Count non-dummy DCT block rows in this iMCU row. */
-    if (coef->iMCU_row_num < last_iMCU_row)
-      block_rows = compptr->v_samp_factor;
-    else {
-      /* NB: can't use last_row_height here, since may not be set! */
-      block_rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
-      if (block_rows == 0) block_rows = compptr->v_samp_factor;
-    }
-    blocks_across = compptr->width_in_blocks;
-    h_samp_factor = compptr->h_samp_factor;
-    /* Count number of dummy blocks to be added at the right margin. */
-    ndummy = (int) (blocks_across % h_samp_factor);
-    if (ndummy > 0)
-      ndummy = h_samp_factor - ndummy;
-    
-    lastDC = 0;
-    
-    /* Perform DCT for all non-dummy blocks in this iMCU row.  Each call
-     * on forward_DCT processes a complete horizontal row of DCT blocks.
-     */
-    for (block_row = 0; block_row < block_rows; block_row++) {
-      thisblockrow = buffer[block_row];
-      lastblockrow = (block_row > 0) ? buffer[block_row-1] : NULL;
-#ifdef C_ARITH_CODING_SUPPORTED
-      if (cinfo->arith_code)
-        quantize_trellis_arith(cinfo, arith_r, thisblockrow,
-                               buffer_dst[block_row], blocks_across,
-                               cinfo->quant_tbl_ptrs[compptr->quant_tbl_no],
-                               cinfo->master->norm_src[compptr->quant_tbl_no],
-                               cinfo->master->norm_coef[compptr->quant_tbl_no],
-                               &lastDC, lastblockrow, buffer_dst[block_row-1]);
-      else
-#endif
-        quantize_trellis(cinfo, dctbl, actbl, thisblockrow,
-                         buffer_dst[block_row], blocks_across,
-                         cinfo->quant_tbl_ptrs[compptr->quant_tbl_no],
-                         cinfo->master->norm_src[compptr->quant_tbl_no],
-                         cinfo->master->norm_coef[compptr->quant_tbl_no],
-                         &lastDC, lastblockrow, buffer_dst[block_row-1]);
-      
-      if (ndummy > 0) {
-        /* Create dummy blocks at the right edge of the image. */
-        thisblockrow += blocks_across; /* => first dummy block */
-        jzero_far((void *) thisblockrow, ndummy * sizeof(JBLOCK));
-        lastDC = thisblockrow[-1][0];
-        for (bi = 0; bi < ndummy; bi++) {
-          thisblockrow[bi][0] = lastDC;
-        }
-      }
-    }
-    /* If at end of image, create dummy block rows as needed.
-     * The tricky part here is that within each MCU, we want the DC values
-     * of the dummy blocks to match the last real block's DC value.
-     * This squeezes a few more bytes out of the resulting file...
-     */
-    if (coef->iMCU_row_num == last_iMCU_row) {
-      blocks_across += ndummy;  /* include lower right corner */
-      MCUs_across = blocks_across / h_samp_factor;
-      for (block_row = block_rows; block_row < compptr->v_samp_factor;
-           block_row++) {
-        thisblockrow = buffer[block_row];
-        lastblockrow = buffer[block_row-1];
-        jzero_far((void *) thisblockrow,
-                  (size_t) (blocks_across * sizeof(JBLOCK)));
-        for (MCUindex = 0; MCUindex < MCUs_across; MCUindex++) {
-          lastDC = lastblockrow[h_samp_factor-1][0];
-          for (bi = 0; bi < h_samp_factor; bi++) {
-            thisblockrow[bi][0] = lastDC;
-          }
-          thisblockrow += h_samp_factor; /* advance to next MCU in row */
-          lastblockrow += h_samp_factor;
-        }
-      }
-    }
+
+    trellis_quantize_row(cinfo, compptr, coef->iMCU_row_num, buffer,
+                         buffer_dst, tables, &coef->trellis_ws[0], TRUE);
   }
+  coef->trellis_tbl_valid = TRUE;
 
   /* NB: compress_output will increment iMCU_row_num if successful.
    * A suspension return will result in redoing all the work above next time.
@@ -479,6 +710,136 @@ compress_trellis_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
   return compress_output(cinfo, input_buf);
 }
 
+
+/*
+ * Multi-threaded trellis quantization.
+ *
+ * With Huffman coding, the rate model used by trellis quantization is fixed
+ * for the duration of a pass, so every (iMCU row, component) pair of the scan
+ * can be requantized independently.  We do all of them up front, on the first
+ * call of the pass, and then feed the results to the entropy encoder one iMCU
+ * row at a time, exactly as compress_trellis_pass() would.  (Arithmetic coding
+ * statistics change as each row is encoded, so that case always uses
+ * compress_trellis_pass().)
+ *
+ * This relies on the virtual arrays being entirely memory-resident, which
+ * jinit_c_coef_controller() guarantees when more than one thread is
+ * requested.
+ */
+
+typedef struct {
+  j_compress_ptr cinfo;
+  trellis_tables tables[MAX_COMPS_IN_SCAN];
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
+  JBLOCKARRAY buffer_dst[MAX_COMPS_IN_SCAN];
+} trellis_job;
+
+
+METHODDEF(void)
+trellis_task (void *arg, int task, int worker)
+{
+  trellis_job *job = (trellis_job *) arg;
+  j_compress_ptr cinfo = job->cinfo;
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  int ci = task % cinfo->comps_in_scan;
+  JDIMENSION iMCU_row_num = (JDIMENSION) (task / cinfo->comps_in_scan);
+  jpeg_component_info *compptr = cinfo->cur_comp_info[ci];
+  JDIMENSION first_row = iMCU_row_num * compptr->v_samp_factor;
+
+  trellis_quantize_row(cinfo, compptr, iMCU_row_num,
+                       job->buffer[ci] + first_row,
+                       job->buffer_dst[ci] + first_row,
+                       &job->tables[ci], &coef->trellis_ws[worker], FALSE);
+}
+
+
+LOCAL(void)
+accumulate_trellis_norms (j_compress_ptr cinfo, jpeg_component_info *compptr,
+                          JBLOCKARRAY buffer, JBLOCKARRAY buffer_dst,
+                          int block_rows)
+/* Accumulate trellis_q_opt statistics in the same order as quantize_trellis()
+ * would, so that the results are bit-identical to the single-threaded case.
+ */
+{
+  double *norm_src = cinfo->master->norm_src[compptr->quant_tbl_no];
+  double *norm_coef = cinfo->master->norm_coef[compptr->quant_tbl_no];
+  JDIMENSION bi;
+  int block_row, i;
+
+  for (block_row = 0; block_row < block_rows; block_row++) {
+    JBLOCKROW coef_blocks = buffer[block_row];
+    JBLOCKROW src = buffer_dst[block_row];
+
+    for (bi = 0; bi < compptr->width_in_blocks; bi++) {
+      for (i = 1; i < DCTSIZE2; i++) {
+        norm_src[i] += src[bi][i] * coef_blocks[bi][i];
+        norm_coef[i] += 8 * coef_blocks[bi][i] * coef_blocks[bi][i];
+      }
+    }
+  }
+}
+
+
+LOCAL(void)
+compress_trellis_pass_mt (j_compress_ptr cinfo)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  trellis_job job;
+  int ci, block_rows;
+  JDIMENSION iMCU_row_num;
+  jpeg_component_info *compptr;
+
+  job.cinfo = cinfo;
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    get_trellis_tables(cinfo, compptr, &job.tables[ci]);
+    job.buffer[ci] = (*cinfo->mem->access_virt_barray)
+      ((j_common_ptr) cinfo, coef->whole_image[compptr->component_index],
+       (JDIMENSION) 0, cinfo->total_iMCU_rows * compptr->v_samp_factor, TRUE);
+    job.buffer_dst[ci] = (*cinfo->mem->access_virt_barray)
+      ((j_common_ptr) cinfo, coef->whole_image_uq[compptr->component_index],
+       (JDIMENSION) 0, cinfo->total_iMCU_rows * compptr->v_samp_factor, TRUE);
+  }
+
+  jthread_run_tasks(cinfo->master->num_threads,
+                    (int) cinfo->total_iMCU_rows * cinfo->comps_in_scan,
+                    trellis_task, &job);
+
+  if (cinfo->master->trellis_q_opt) {
+    for (iMCU_row_num = 0; iMCU_row_num < cinfo->total_iMCU_rows;
+         iMCU_row_num++) {
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        compptr = cinfo->cur_comp_info[ci];
+        if (iMCU_row_num < cinfo->total_iMCU_rows - 1)
+          block_rows = compptr->v_samp_factor;
+        else {
+          block_rows = (int) (compptr->height_in_blocks %
+                              compptr->v_samp_factor);
+          if (block_rows == 0) block_rows = compptr->v_samp_factor;
+        }
+        accumulate_trellis_norms(cinfo, compptr,
+          job.buffer[ci] + iMCU_row_num * compptr->v_samp_factor,
+          job.buffer_dst[ci] + iMCU_row_num * compptr->v_samp_factor,
+          block_rows);
+      }
+    }
+  }
+}
+
+
+METHODDEF(boolean)
+compress_trellis_pass_threaded (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+
+  if (! coef->trellis_done) {
+    compress_trellis_pass_mt(cinfo);
+    coef->trellis_done = TRUE;
+  }
+
+  return compress_output(cinfo, input_buf);
+}
+
 /*
  * Process some data in subsequent passes of a multi-pass case.
  * We process the equivalent of one fully interleaved MCU row ("iMCU" row)
@@ -498,6 +859,7 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
   JDIMENSION start_col;
   JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
   JBLOCKROW buffer_ptr;
+  jblock_info **info_rows[MAX_COMPS_IN_SCAN];
   jpeg_component_info *compptr;
 
   /* Align the virtual buffers for the components used in this scan.
@@ -510,6 +872,9 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
       ((j_common_ptr) cinfo, coef->whole_image[compptr->component_index],
        coef->iMCU_row_num * compptr->v_samp_factor,
        (JDIMENSION) compptr->v_samp_factor, FALSE);
+    if (coef->pub.MCU_info != NULL)
+      info_rows[ci] = coef->block_info[compptr->component_index] +
+                      coef->iMCU_row_num * compptr->v_samp_factor;
   }
 
   /* Loop to process one whole iMCU row */
@@ -524,6 +889,11 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
         start_col = MCU_col_num * compptr->MCU_width;
         for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
           buffer_ptr = buffer[ci][yindex+yoffset] + start_col;
+          if (coef->pub.MCU_info != NULL) {
+            for (xindex = 0; xindex < compptr->MCU_width; xindex++)
+              coef->MCU_info[blkn + xindex] =
+                info_rows[ci][yindex+yoffset] + start_col + xindex;
+          }
           for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
             coef->MCU_buffer[blkn++] = buffer_ptr++;
           }
@@ -549,6 +919,55 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
 #endif /* FULL_COEF_BUFFER_SUPPORTED */
 
 
+/*
+ * Allocate the trellis quantization scratch storage for one worker.
+ * Only the arrays needed by the current parameters are allocated.
+ */
+
+LOCAL(void)
+alloc_trellis_workspace (j_compress_ptr cinfo, trellis_workspace *ws,
+                         JDIMENSION max_blocks)
+{
+  int i;
+
+  MEMZERO(ws, sizeof(trellis_workspace));
+  ws->max_blocks = max_blocks;
+
+  if (cinfo->master->trellis_eob_opt) {
+    ws->accumulated_zero_block_cost = (float *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  (max_blocks + 1) * sizeof(float));
+    ws->accumulated_block_cost = (float *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  (max_blocks + 1) * sizeof(float));
+    ws->block_run_start = (int *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  max_blocks * sizeof(int));
+    ws->requires_eob = (int *)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  (max_blocks + 1) * sizeof(int));
+  }
+
+  if (cinfo->master->trellis_quant_dc) {
+    for (i = 0; i < DC_TRELLIS_MAX_CANDIDATES; i++) {
+      ws->accumulated_dc_cost[i] = (float *)
+        (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                    max_blocks * sizeof(float));
+      ws->dc_cost_backtrack[i] = (int *)
+        (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                    max_blocks * sizeof(int));
+      ws->dc_candidate[i] = (JCOEF *)
+        (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                    max_blocks * sizeof(JCOEF));
+      if (cinfo->arith_code)
+        ws->dc_context[i] = (int *)
+          (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                      max_blocks * sizeof(int));
+    }
+  }
+}
+
+
 /*
  * Initialize coefficient buffer controller.
  */
@@ -563,6 +982,7 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
                                 sizeof(my_coef_controller));
   cinfo->coef = (struct jpeg_c_coef_controller *) coef;
   coef->pub.start_pass = start_pass_coef;
+  MEMZERO(coef->block_info, sizeof(coef->block_info));
 
   /* Create the coefficient buffer. */
   if (need_full_buffer) {
@@ -571,16 +991,28 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
     /* padded to a multiple of samp_factor DCT blocks in each direction. */
     int ci;
     jpeg_component_info *compptr;
+    JDIMENSION maxaccess;
 
     for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
          ci++, compptr++) {
+      /* Multi-threaded trellis quantization and scan search need to access
+       * the whole image at once.  Requesting that as the access height forces
+       * the memory manager to keep the arrays resident.
+       */
+      if (cinfo->master->num_threads > 1 &&
+          (cinfo->master->trellis_quant || cinfo->master->optimize_scans))
+        maxaccess = (JDIMENSION) jround_up((long) compptr->height_in_blocks,
+                                           (long) compptr->v_samp_factor);
+      else
+        maxaccess = (JDIMENSION) compptr->v_samp_factor;
+
       coef->whole_image[ci] = (*cinfo->mem->request_virt_barray)
         ((j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
          (JDIMENSION) jround_up((long) compptr->width_in_blocks,
                                 (long) compptr->h_samp_factor),
          (JDIMENSION) jround_up((long) compptr->height_in_blocks,
                                 (long) compptr->v_samp_factor),
-         (JDIMENSION) compptr->v_samp_factor);
+         maxaccess);
       
       coef->whole_image_uq[ci] = (*cinfo->mem->request_virt_barray)
         ((j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
@@ -588,7 +1020,27 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
                                 (long) compptr->h_samp_factor),
          (JDIMENSION) jround_up((long) compptr->height_in_blocks,
                                 (long) compptr->v_samp_factor),
-         (JDIMENSION) compptr->v_samp_factor);
+         maxaccess);
+    }
+
+    coef->trellis_ws = NULL;
+    coef->trellis_tbl = NULL;
+    if (cinfo->master->trellis_quant) {
+      JDIMENSION max_blocks = 0;
+      int num_workers = cinfo->arith_code ? 1 : cinfo->master->num_threads;
+
+      for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+           ci++, compptr++)
+        max_blocks = MAX(max_blocks, compptr->width_in_blocks);
+
+      coef->trellis_ws = (trellis_workspace *)
+        (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                    num_workers * sizeof(trellis_workspace));
+      for (ci = 0; ci < num_workers; ci++)
+        alloc_trellis_workspace(cinfo, &coef->trellis_ws[ci], max_blocks);
+      coef->trellis_tbl = (trellis_tables *)
+        (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                    MAX_COMPS_IN_SCAN * sizeof(trellis_tables));
     }
 #else
     ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
@@ -607,3 +1059,29 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
     coef->whole_image[0] = NULL; /* flag for no virtual arrays */
   }
 }
+
+
+/*
+ * Initialize a coefficient buffer controller for a private copy of a
+ * compression object (see the parallel scan search in jcmaster.c.)  The new
+ * controller reads the full-image buffer of src's controller, which must be
+ * entirely memory-resident, so that several copies can output scans from it
+ * concurrently.  Only the JBUF_CRANK_DEST mode may be used with it.
+ */
+
+GLOBAL(void)
+jinit_c_coef_controller_shared (j_compress_ptr cinfo, j_compress_ptr src)
+{
+  my_coef_ptr coef;
+
+  /* The copies share src's block side information, so compute it first. */
+  build_block_info(src);
+
+  coef = (my_coef_ptr)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                sizeof(my_coef_controller));
+  MEMCOPY(coef, src->coef, sizeof(my_coef_controller));
+  coef->trellis_ws = NULL;
+  coef->trellis_tbl = NULL;
+  cinfo->coef = (struct jpeg_c_coef_controller *) coef;
+}
@@ -915,8 +915,6 @@ static const float jpeg_lambda_weights_csf_luma[64] = {
   0.43454f, 0.42146f, 0.34609f, 0.24072f, 0.15975f, 0.10701f, 0.07558f, 0.05875f,
 };
 
-#define DC_TRELLIS_MAX_CANDIDATES 9
-
 LOCAL(int) get_num_dc_trellis_candidates(int dc_quantval) {
   /* Higher qualities can tolerate higher DC distortion */
   return MIN(DC_TRELLIS_MAX_CANDIDATES, (2 + 60 / dc_quantval)|1);
@@ -925,7 +923,7 @@ LOCAL(int) get_num_dc_trellis_candidates(int dc_quantval) {
 GLOBAL(void)
 quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actbl, JBLOCKROW coef_blocks, JBLOCKROW src, JDIMENSION num_blocks,
                  JQUANT_TBL * qtbl, double *norm_src, double *norm_coef, JCOEF *last_dc_val,
-                 JBLOCKROW coef_blocks_above, JBLOCKROW src_above)
+                 JBLOCKROW coef_blocks_above, JBLOCKROW src_above, trellis_workspace *ws)
 {
   int i, j, k, l;
   float accumulated_zero_dist[DCTSIZE2];
@@ -938,6 +936,7 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
   float lambda_base;
   float lambda;
   float lambda_dc;
+  double lambda_scale1, lambda_scale2 = 0.0;
   const float *lambda_tbl = (cinfo->master->use_lambda_weight_tbl) ?
                             jpeg_lambda_weights_csf_luma :
                             jpeg_lambda_weights_flat;
@@ -958,6 +957,13 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
   JCOEF *dc_candidate[DC_TRELLIS_MAX_CANDIDATES];
   int mode = 1;
   float lambda_table[DCTSIZE2];
+  int simd_prep = jsimd_can_trellis_prep();
+  int simd_search = jsimd_can_trellis_search();
+  int qdiv[DCTSIZE2];
+  int qvals[DCTSIZE2];
+  float zero_dist[DCTSIZE2];
+  int preds[DCTSIZE2];
+  int num_preds;
   const int dc_trellis_candidates = get_num_dc_trellis_candidates(qtbl->quantval[0]);
   
   Ss = cinfo->Ss;
@@ -967,16 +973,10 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
   if (Se < Ss)
     return;
   if (cinfo->master->trellis_eob_opt) {
-    accumulated_zero_block_cost = (float *)malloc((num_blocks + 1) * sizeof(float));
-    accumulated_block_cost = (float *)malloc((num_blocks + 1) * sizeof(float));
-    block_run_start = (int *)malloc(num_blocks * sizeof(int));
-    requires_eob = (int *)malloc((num_blocks + 1) * sizeof(int));
-    if (!accumulated_zero_block_cost ||
-        !accumulated_block_cost ||
-        !block_run_start ||
-        !requires_eob) {
-      ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
-    }
+    accumulated_zero_block_cost = ws->accumulated_zero_block_cost;
+    accumulated_block_cost = ws->accumulated_block_cost;
+    block_run_start = ws->block_run_start;
+    requires_eob = ws->requires_eob;
 
     accumulated_zero_block_cost[0] = 0;
     accumulated_block_cost[0] = 0;
@@ -985,14 +985,9 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
   
   if (cinfo->master->trellis_quant_dc) {
     for (i = 0; i < dc_trellis_candidates; i++) {
-      accumulated_dc_cost[i] = (float *)malloc(num_blocks * sizeof(float));
-      dc_cost_backtrack[i] = (int *)malloc(num_blocks * sizeof(int));
-      dc_candidate[i] = (JCOEF *)malloc(num_blocks * sizeof(JCOEF));
-      if (!accumulated_dc_cost[i] ||
-          !dc_cost_backtrack[i] ||
-          !dc_candidate[i]) {
-        ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
-      }
+      accumulated_dc_cost[i] = ws->accumulated_dc_cost[i];
+      dc_cost_backtrack[i] = ws->dc_cost_backtrack[i];
+      dc_candidate[i] = ws->dc_candidate[i];
     }
   }
   
@@ -1009,6 +1004,16 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
       lambda_table[i] = 1.0 / (qtbl->quantval[i] * qtbl->quantval[i]);
   } else
     lambda_base = 1.0 / norm;
+
+  for (i = 0; i < DCTSIZE2; i++)
+    qdiv[i] = 8 * qtbl->quantval[i];
+
+  /* These don't depend on the block, so compute them only once */
+  if (cinfo->master->lambda_log_scale2 > 0.0) {
+    lambda_scale1 = pow(2.0, cinfo->master->lambda_log_scale1);
+    lambda_scale2 = pow(2.0, cinfo->master->lambda_log_scale2);
+  } else
+    lambda_scale1 = pow(2.0, cinfo->master->lambda_log_scale1 - 12.0);
   
   for (bi = 0; bi < num_blocks; bi++) {
     
@@ -1019,12 +1024,14 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
     norm /= 63.0;
     
     if (cinfo->master->lambda_log_scale2 > 0.0)
-      lambda = pow(2.0, cinfo->master->lambda_log_scale1) * lambda_base /
-                   (pow(2.0, cinfo->master->lambda_log_scale2) + norm);
+      lambda = lambda_scale1 * lambda_base / (lambda_scale2 + norm);
     else
-      lambda = pow(2.0, cinfo->master->lambda_log_scale1 - 12.0) * lambda_base;
+      lambda = lambda_scale1 * lambda_base;
     
     lambda_dc = lambda * lambda_tbl[0];
+
+    if (simd_prep)
+      jsimd_trellis_prep(src[bi], qdiv, lambda_tbl, lambda, qvals, zero_dist);
     
     accumulated_zero_dist[Ss-1] = 0.0;
     accumulated_cost[Ss-1] = 0.0;
@@ -1075,12 +1082,7 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
           dc_delta = dc_candidate[k][bi] - *last_dc_val;
 
           /* Derive number of suffix bits */
-          bits = 0;
-          dc_delta = abs(dc_delta);
-          while (dc_delta) {
-            dc_delta >>= 1;
-            bits++;
-          }
+          bits = jpeg_nbits_table[abs(dc_delta)];
           cost = bits + dctbl->ehufsi[bits] + dc_candidate_dist;
           accumulated_dc_cost[k][0] = cost;
           dc_cost_backtrack[k][0] = -1;
@@ -1089,12 +1091,7 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
             dc_delta = dc_candidate[k][bi] - dc_candidate[l][bi-1];
 
             /* Derive number of suffix bits */
-            bits = 0;
-            dc_delta = abs(dc_delta);
-            while (dc_delta) {
-              dc_delta >>= 1;
-              bits++;
-            }
+            bits = jpeg_nbits_table[abs(dc_delta)];
             cost = bits + dctbl->ehufsi[bits] + dc_candidate_dist + accumulated_dc_cost[l][bi-1];
             if (l == 0 || cost < accumulated_dc_cost[k][bi]) {
               accumulated_dc_cost[k][bi] = cost;
@@ -1106,6 +1103,8 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
     }
 
     /* Do AC coefficients */
+    preds[0] = Ss-1;
+    num_preds = 1;
     for (i = Ss; i <= Se; i++) {
       int z = jpeg_natural_order[i];
 
@@ -1118,9 +1117,13 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
       int num_candidates;
       int qval;
       
-      accumulated_zero_dist[i] = x * x * lambda * lambda_tbl[z] + accumulated_zero_dist[i-1];
-      
-      qval = (x + q/2) / q; /* quantized value (round nearest) */
+      if (simd_prep) {
+        accumulated_zero_dist[i] = zero_dist[z] + accumulated_zero_dist[i-1];
+        qval = qvals[z];
+      } else {
+        accumulated_zero_dist[i] = x * x * lambda * lambda_tbl[z] + accumulated_zero_dist[i-1];
+        qval = (x + q/2) / q; /* quantized value (round nearest) */
+      }
 
       if (qval == 0) {
         coef_blocks[bi][z] = 0;
@@ -1140,6 +1143,21 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
         candidate_dist[k] = delta * delta * lambda * lambda_tbl[z];
       }
       
+      if (simd_search) {
+        /* preds[] lists the positions a zero run may follow, i.e. Ss-1 and
+         * the nonzero coefficients so far.
+         */
+        k = jsimd_trellis_search(i, num_preds, preds, num_candidates,
+                                 candidate_dist, accumulated_cost,
+                                 accumulated_zero_dist, run_start,
+                                 actbl->ehufsi);
+        if (k >= 0)
+          coef_blocks[bi][z] = (candidate[k] ^ sign) - sign;
+        if (coef_blocks[bi][z] != 0)
+          preds[num_preds++] = i;
+        continue;
+      }
+
       accumulated_cost[i] = 1e38;
       
       for (j = Ss-1; j < i; j++) {
@@ -1278,13 +1296,10 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
       last_block = block_run_start[bi]-1;
       bi--;
     }
-    free(accumulated_zero_block_cost);
-    free(accumulated_block_cost);
-    free(block_run_start);
-    free(requires_eob);
   }
   
-  if (cinfo->master->trellis_q_opt) {
+  /* norm_src is NULL if the caller accumulates these statistics itself */
+  if (cinfo->master->trellis_q_opt && norm_src != NULL) {
     for (bi = 0; bi < num_blocks; bi++) {
       for (i = 1; i < DCTSIZE2; i++) {
         norm_src[i] += src[bi][i] * coef_blocks[bi][i];
@@ -1306,12 +1321,6 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
 
     /* Save DC predictor */
     *last_dc_val = coef_blocks[num_blocks-1][0];
-
-    for (i = 0; i < dc_trellis_candidates; i++) {
-      free(accumulated_dc_cost[i]);
-      free(dc_cost_backtrack[i]);
-      free(dc_candidate[i]);
-    }
   }
 
 }
@@ -1320,7 +1329,7 @@ quantize_trellis(j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actb
 GLOBAL(void)
 quantize_trellis_arith(j_compress_ptr cinfo, arith_rates *r, JBLOCKROW coef_blocks, JBLOCKROW src, JDIMENSION num_blocks,
                  JQUANT_TBL * qtbl, double *norm_src, double *norm_coef, JCOEF *last_dc_val,
-                 JBLOCKROW coef_blocks_above, JBLOCKROW src_above)
+                 JBLOCKROW coef_blocks_above, JBLOCKROW src_above, trellis_workspace *ws)
 {
   int i, j, k, l;
   float accumulated_zero_dist[DCTSIZE2];
@@ -1358,16 +1367,10 @@ quantize_trellis_arith(j_compress_ptr cinfo, arith_rates *r, JBLOCKROW coef_bloc
   
   if (cinfo->master->trellis_quant_dc) {
     for (i = 0; i < dc_trellis_candidates; i++) {
-      accumulated_dc_cost[i] = (float *)malloc(num_blocks * sizeof(float));
-      dc_cost_backtrack[i] = (int *)malloc(num_blocks * sizeof(int));
-      dc_candidate[i] = (JCOEF *)malloc(num_blocks * sizeof(JCOEF));
-      dc_context[i] = (int *)malloc(num_blocks * sizeof(int));
-      if (!accumulated_dc_cost[i] ||
-          !dc_cost_backtrack[i] ||
-          !dc_candidate[i] ||
-          !dc_context[i]) {
-        ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
-      }
+      accumulated_dc_cost[i] = ws->accumulated_dc_cost[i];
+      dc_cost_backtrack[i] = ws->dc_cost_backtrack[i];
+      dc_candidate[i] = ws->dc_candidate[i];
+      dc_context[i] = ws->dc_context[i];
     }
   }
   
@@ -1621,7 +1624,8 @@ quantize_trellis_arith(j_compress_ptr cinfo, arith_rates *r, JBLOCKROW coef_bloc
     
   }
   
-  if (cinfo->master->trellis_q_opt) {
+  /* norm_src is NULL if the caller accumulates these statistics itself */
+  if (cinfo->master->trellis_q_opt && norm_src != NULL) {
     for (bi = 0; bi < num_blocks; bi++) {
       for (i = 1; i < DCTSIZE2; i++) {
         norm_src[i] += src[bi][i] * coef_blocks[bi][i];
@@ -1643,13 +1647,6 @@ quantize_trellis_arith(j_compress_ptr cinfo, arith_rates *r, JBLOCKROW coef_bloc
     
     /* Save DC predictor */
     *last_dc_val = coef_blocks[num_blocks-1][0];
-    
-    for (i = 0; i < dc_trellis_candidates; i++) {
-      free(accumulated_dc_cost[i]);
-      free(dc_cost_backtrack[i]);
-      free(dc_candidate[i]);
-      free(dc_context[i]);
-    }
   }
 }
 #endif
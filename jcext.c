@@ -27,6 +27,7 @@ jpeg_c_bool_param_supported (const j_compress_ptr cinfo, J_BOOLEAN_PARAM param)
   case JBOOLEAN_USE_SCANS_IN_TRELLIS:
   case JBOOLEAN_TRELLIS_Q_OPT:
   case JBOOLEAN_OVERSHOOT_DERINGING:
+  case JBOOLEAN_HUFF_TABLE_LIBRARY:
     return TRUE;
   }
 
@@ -63,6 +64,9 @@ jpeg_c_set_bool_param (j_compress_ptr cinfo, J_BOOLEAN_PARAM param,
   case JBOOLEAN_OVERSHOOT_DERINGING:
     cinfo->master->overshoot_deringing = value;
     break;
+  case JBOOLEAN_HUFF_TABLE_LIBRARY:
+    cinfo->master->huff_table_library = value;
+    break;
   default:
     ERREXIT(cinfo, JERR_BAD_PARAM);
   }
@@ -89,6 +93,8 @@ jpeg_c_get_bool_param (const j_compress_ptr cinfo, J_BOOLEAN_PARAM param)
     return cinfo->master->trellis_q_opt;
   case JBOOLEAN_OVERSHOOT_DERINGING:
     return cinfo->master->overshoot_deringing;
+  case JBOOLEAN_HUFF_TABLE_LIBRARY:
+    return cinfo->master->huff_table_library;
   default:
     ERREXIT(cinfo, JERR_BAD_PARAM);
   }
@@ -104,6 +110,7 @@ jpeg_c_float_param_supported (const j_compress_ptr cinfo, J_FLOAT_PARAM param)
   case JFLOAT_LAMBDA_LOG_SCALE1:
   case JFLOAT_LAMBDA_LOG_SCALE2:
   case JFLOAT_TRELLIS_DELTA_DC_WEIGHT:
+  case JFLOAT_TRELLIS_LOOP_THRESHOLD:
     return TRUE;
   }
 
@@ -124,6 +131,9 @@ jpeg_c_set_float_param (j_compress_ptr cinfo, J_FLOAT_PARAM param, float value)
   case JFLOAT_TRELLIS_DELTA_DC_WEIGHT:
     cinfo->master->trellis_delta_dc_weight = value;
     break;
+  case JFLOAT_TRELLIS_LOOP_THRESHOLD:
+    cinfo->master->trellis_loop_threshold = value;
+    break;
   default:
     ERREXIT(cinfo, JERR_BAD_PARAM);
   }
@@ -140,6 +150,8 @@ jpeg_c_get_float_param (const j_compress_ptr cinfo, J_FLOAT_PARAM param)
     return cinfo->master->lambda_log_scale2;
   case JFLOAT_TRELLIS_DELTA_DC_WEIGHT:
     return cinfo->master->trellis_delta_dc_weight;
+  case JFLOAT_TRELLIS_LOOP_THRESHOLD:
+    return cinfo->master->trellis_loop_threshold;
   default:
     ERREXIT(cinfo, JERR_BAD_PARAM);
   }
@@ -157,6 +169,12 @@ jpeg_c_int_param_supported (const j_compress_ptr cinfo, J_INT_PARAM param)
   case JINT_TRELLIS_NUM_LOOPS:
   case JINT_BASE_QUANT_TBL_IDX:
   case JINT_DC_SCAN_OPT_MODE:
+  case JINT_NUM_THREADS:
+  case JINT_TRELLIS_LOOPS_USED:
+  case JINT_SCAN_SIZE_MODE:
+  case JINT_SCAN_BUFFER_LIMIT:
+  case JINT_SCAN_BUFFER_PEAK:
+  case JINT_HUFF_TABLE_MODE:
     return TRUE;
   }
 
@@ -191,6 +209,26 @@ jpeg_c_set_int_param (j_compress_ptr cinfo, J_INT_PARAM param, int value)
   case JINT_DC_SCAN_OPT_MODE:
     cinfo->master->dc_scan_opt_mode = value;
     break;
+  case JINT_NUM_THREADS:
+    if (value < 1)
+      ERREXIT(cinfo, JERR_BAD_PARAM_VALUE);
+    cinfo->master->num_threads = value;
+    break;
+  case JINT_SCAN_SIZE_MODE:
+    if (value < 0 || value > 1)
+      ERREXIT(cinfo, JERR_BAD_PARAM_VALUE);
+    cinfo->master->scan_size_mode = value;
+    break;
+  case JINT_SCAN_BUFFER_LIMIT:
+    if (value < 0)
+      ERREXIT(cinfo, JERR_BAD_PARAM_VALUE);
+    cinfo->master->scan_buffer_limit = value;
+    break;
+  case JINT_HUFF_TABLE_MODE:
+    if (value < 0 || value > 1)
+      ERREXIT(cinfo, JERR_BAD_PARAM_VALUE);
+    cinfo->master->huff_table_mode = value;
+    break;
   default:
     ERREXIT(cinfo, JERR_BAD_PARAM);
   }
@@ -211,6 +249,18 @@ jpeg_c_get_int_param (const j_compress_ptr cinfo, J_INT_PARAM param)
     return cinfo->master->quant_tbl_master_idx;
   case JINT_DC_SCAN_OPT_MODE:
     return cinfo->master->dc_scan_opt_mode;
+  case JINT_NUM_THREADS:
+    return cinfo->master->num_threads;
+  case JINT_TRELLIS_LOOPS_USED:
+    return cinfo->master->trellis_loops_used;
+  case JINT_SCAN_SIZE_MODE:
+    return cinfo->master->scan_size_mode;
+  case JINT_SCAN_BUFFER_LIMIT:
+    return cinfo->master->scan_buffer_limit;
+  case JINT_SCAN_BUFFER_PEAK:
+    return cinfo->master->scan_buffer_peak;
+  case JINT_HUFF_TABLE_MODE:
+    return cinfo->master->huff_table_mode;
   default:
     ERREXIT(cinfo, JERR_BAD_PARAM);
   }
@@ -23,6 +23,7 @@
 #include "jpeglib.h"
 #include "jsimd.h"
 #include "jconfigint.h"
+#include "jthread.h"
 #include <limits.h>
 
 /*
@@ -92,6 +93,16 @@ typedef struct {
 #endif
 
 
+/* Output of one restart interval encoded on a worker thread */
+
+typedef struct {
+  JOCTET *data;                 /* encoded data (malloc'ed, grows as needed) */
+  size_t size;                  /* allocated size of data */
+  size_t used;                  /* # of bytes of data in use */
+  boolean failed;               /* TRUE if data could not be enlarged */
+} huff_segment;
+
+
 typedef struct {
   struct jpeg_entropy_encoder pub; /* public fields */
 
@@ -111,6 +122,15 @@ typedef struct {
 #endif
 
   int simd;
+
+  /* Restart intervals buffered for parallel encoding (see encode_mcu_batch) */
+  JBLOCKROW batch_blocks;       /* copies of the buffered MCUs' blocks */
+  long batch_blocks_size;       /* # of blocks allocated in batch_blocks */
+  huff_segment *segments;       /* one per restart interval in a batch */
+  int batch_intervals;          /* # of restart intervals per batch */
+  JDIMENSION batch_mcus;        /* # of MCUs buffered so far */
+  boolean first_interval;       /* TRUE until the scan's first interval is
+                                   written */
 } huff_entropy_encoder;
 
 typedef huff_entropy_encoder *huff_entropy_ptr;
@@ -124,12 +144,19 @@ typedef struct {
   size_t free_in_buffer;        /* # of byte spaces remaining in buffer */
   savable_state cur;            /* Current bit buffer & DC state */
   j_compress_ptr cinfo;         /* dump_buffer needs access to this */
+  /* The SIMD encoders depend on the layout of the fields above. */
+  huff_segment *segment;        /* private output buffer, or NULL to write to
+                                   cinfo->dest */
 } working_state;
 
 
 /* Forward declarations */
 METHODDEF(boolean) encode_mcu_huff (j_compress_ptr cinfo, JBLOCKROW *MCU_data);
 METHODDEF(void) finish_pass_huff (j_compress_ptr cinfo);
+METHODDEF(boolean) encode_mcu_batch (j_compress_ptr cinfo,
+                                     JBLOCKROW *MCU_data);
+METHODDEF(void) finish_pass_batch (j_compress_ptr cinfo);
+LOCAL(boolean) start_batch (j_compress_ptr cinfo);
 #ifdef ENTROPY_OPT_SUPPORTED
 METHODDEF(boolean) encode_mcu_gather (j_compress_ptr cinfo,
                                       JBLOCKROW *MCU_data);
@@ -157,6 +184,10 @@ start_pass_huff (j_compress_ptr cinfo, boolean gather_statistics)
 #else
     ERREXIT(cinfo, JERR_NOT_COMPILED);
 #endif
+  } else if (cinfo->restart_interval && cinfo->master->num_threads > 1 &&
+             start_batch(cinfo)) {
+    entropy->pub.encode_mcu = encode_mcu_batch;
+    entropy->pub.finish_pass = finish_pass_batch;
   } else {
     entropy->pub.encode_mcu = encode_mcu_huff;
     entropy->pub.finish_pass = finish_pass_huff;
@@ -309,6 +340,11 @@ jpeg_make_c_derived_tbl (j_compress_ptr cinfo, boolean isDC, int tblno,
 
 /* Outputting bytes to the file */
 
+/* Initial size of the private buffer of a restart interval encoded on a worker
+ * thread.  It is doubled whenever it fills up.
+ */
+#define SEGMENT_INIT_SIZE  4096
+
 /* Emit a byte, taking 'action' if must suspend. */
 #define emit_byte(state,val,action)  \
         { *(state)->next_output_byte++ = (JOCTET) (val);  \
@@ -323,6 +359,23 @@ dump_buffer (working_state *state)
 {
   struct jpeg_destination_mgr *dest = state->cinfo->dest;
 
+  if (state->segment != NULL) {
+    /* Enlarge the private buffer instead */
+    huff_segment *segment = state->segment;
+    size_t size = segment->size ? segment->size * 2 : SEGMENT_INIT_SIZE;
+    JOCTET *data = (JOCTET *) realloc(segment->data, size);
+
+    if (data == NULL) {
+      segment->failed = TRUE;
+      return FALSE;
+    }
+    state->next_output_byte = data + segment->size;
+    state->free_in_buffer = size - segment->size;
+    segment->data = data;
+    segment->size = size;
+    return TRUE;
+  }
+
   if (! (*dest->empty_output_buffer) (state->cinfo))
     return FALSE;
   /* After a successful buffer dump, must reset buffer pointers */
@@ -389,16 +442,64 @@ dump_buffer (working_state *state)
 
 #if SIZEOF_SIZE_T==8 || defined(_WIN64)
 
+/* On 64-bit platforms, the bit buffer is filled completely and then written
+ * out 8 bytes at a time.  A byte of the buffer is 0xFF only if its high bit
+ * is set and adding 1 clears it, so the (rare) buffers that need byte
+ * stuffing can be detected without examining each byte.  Carries from lower
+ * bytes may cause false positives, which merely take the slow path.  Up to 64
+ * bits may be left in the buffer between calls, so flush_bits() empties all
+ * whole bytes before padding.
+ */
+
+#define BUFFER_HAS_FF(buf) \
+  ((buf) & 0x8080808080808080 & ~((buf) + 0x0101010101010101))
+
+#define EMIT_FULL_BYTE(shift) { \
+  JOCTET c = (JOCTET)GETJOCTET(put_buffer >> (shift)); \
+  *buffer++ = c; \
+  if (c == 0xFF)  /* need to stuff a zero byte? */ \
+    *buffer++ = 0; \
+ }
+
+#define FLUSH_BUFFER() { \
+  if (BUFFER_HAS_FF(put_buffer)) { \
+    EMIT_FULL_BYTE(56)  EMIT_FULL_BYTE(48) \
+    EMIT_FULL_BYTE(40)  EMIT_FULL_BYTE(32) \
+    EMIT_FULL_BYTE(24)  EMIT_FULL_BYTE(16) \
+    EMIT_FULL_BYTE(8)   EMIT_FULL_BYTE(0) \
+  } else { \
+    buffer[0] = (JOCTET) (put_buffer >> 56); \
+    buffer[1] = (JOCTET) (put_buffer >> 48); \
+    buffer[2] = (JOCTET) (put_buffer >> 40); \
+    buffer[3] = (JOCTET) (put_buffer >> 32); \
+    buffer[4] = (JOCTET) (put_buffer >> 24); \
+    buffer[5] = (JOCTET) (put_buffer >> 16); \
+    buffer[6] = (JOCTET) (put_buffer >> 8); \
+    buffer[7] = (JOCTET) put_buffer; \
+    buffer += 8; \
+  } \
+ }
+
+/* Bits of code above the size of the code that did not fit in the buffer are
+ * shifted out by subsequent calls, so they need not be masked off.
+ */
 #define EMIT_BITS(code, size) { \
-  CHECKBUF47() \
-  PUT_BITS(code, size) \
+  put_bits += size; \
+  if (put_bits > 64) { \
+    put_bits -= 64; \
+    put_buffer = (put_buffer << (size - put_bits)) | \
+                 ((size_t) (code) >> put_bits); \
+    FLUSH_BUFFER() \
+    put_buffer = (size_t) (code); \
+  } else \
+    put_buffer = (put_buffer << size) | (size_t) (code); \
 }
 
 #define EMIT_CODE(code, size) { \
   temp2 &= (((JLONG) 1)<<nbits) - 1; \
-  CHECKBUF31() \
-  PUT_BITS(code, size) \
-  PUT_BITS(temp2, nbits) \
+  temp2 |= code << nbits; \
+  nbits += size; \
+  EMIT_BITS(temp2, nbits) \
  }
 
 #else
@@ -472,6 +573,7 @@ flush_bits (working_state *state)
   LOAD_BUFFER()
 
   /* fill any partial byte with ones */
+  while (put_bits >= 8) EMIT_BYTE()
   PUT_BITS(0x7F, 7)
   while (put_bits >= 8) EMIT_BYTE()
 
@@ -653,6 +755,7 @@ encode_mcu_huff (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   state.free_in_buffer = cinfo->dest->free_in_buffer;
   ASSIGN_STATE(state.cur, entropy->saved);
   state.cinfo = cinfo;
+  state.segment = NULL;
 
   /* Emit restart marker if needed */
   if (cinfo->restart_interval) {
@@ -722,6 +825,7 @@ finish_pass_huff (j_compress_ptr cinfo)
   state.free_in_buffer = cinfo->dest->free_in_buffer;
   ASSIGN_STATE(state.cur, entropy->saved);
   state.cinfo = cinfo;
+  state.segment = NULL;
 
   /* Flush out the last data */
   if (! flush_bits(&state))
@@ -733,6 +837,238 @@ finish_pass_huff (j_compress_ptr cinfo)
   ASSIGN_STATE(entropy->saved, state.cur);
 }
 
+/*
+ * Parallel encoding of restart intervals.
+ *
+ * Each restart interval begins with the bit buffer empty and the DC
+ * predictions reset, so the intervals of a scan can be encoded independently
+ * of one another.  When multiple threads are allowed, encode_mcu_batch()
+ * merely copies the coefficients of each MCU.  Once a batch of intervals has
+ * been collected, they are encoded concurrently, each into a private buffer,
+ * and then written out in order, separated by the same RSTn markers that
+ * emit_restart() would have written.  The output is therefore identical to
+ * that of encode_mcu_huff().  Output suspension is not supported in this
+ * mode.
+ */
+
+/* Upper limit on the size of the coefficients buffered for a batch */
+#define MAX_BATCH_BLOCKS  (16L * 1024L * 1024L / (long) sizeof(JBLOCK))
+
+/* Number of restart intervals per batch for each thread, so that the
+ * intervals can be balanced among the threads
+ */
+#define BATCH_INTERVALS_PER_THREAD  4
+
+
+LOCAL(boolean)
+start_batch (j_compress_ptr cinfo)
+/* Prepare for encoding the scan in batches of restart intervals.
+ * Returns FALSE if the intervals are too large to be buffered.
+ */
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  long interval_blocks = (long) cinfo->restart_interval *
+                         (long) cinfo->blocks_in_MCU;
+  int max_intervals = cinfo->master->num_threads * BATCH_INTERVALS_PER_THREAD;
+  long num_intervals;
+
+  num_intervals = MAX_BATCH_BLOCKS / interval_blocks;
+  if (num_intervals < 2)
+    return FALSE;
+  if (num_intervals > max_intervals)
+    num_intervals = max_intervals;
+
+  if (entropy->segments == NULL) {
+    entropy->segments = (huff_segment *)
+      (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  max_intervals * sizeof(huff_segment));
+    MEMZERO(entropy->segments, max_intervals * sizeof(huff_segment));
+  }
+  if (entropy->batch_blocks_size < num_intervals * interval_blocks) {
+    entropy->batch_blocks_size = num_intervals * interval_blocks;
+    entropy->batch_blocks = (JBLOCKROW)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  entropy->batch_blocks_size *
+                                  sizeof(JBLOCK));
+  }
+  entropy->batch_intervals = (int) num_intervals;
+  entropy->batch_mcus = 0;
+  entropy->first_interval = TRUE;
+
+  return TRUE;
+}
+
+
+METHODDEF(void)
+encode_interval_task (void *arg, int task, int worker)
+/* Encode restart interval number 'task' of the current batch */
+{
+  j_compress_ptr cinfo = (j_compress_ptr) arg;
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  huff_segment *segment = &entropy->segments[task];
+  JDIMENSION mcu = (JDIMENSION) task * cinfo->restart_interval;
+  JDIMENSION end_mcu = min(mcu + cinfo->restart_interval, entropy->batch_mcus);
+  JBLOCKROW block = entropy->batch_blocks + mcu * cinfo->blocks_in_MCU;
+  working_state state;
+  int blkn, ci;
+  jpeg_component_info *compptr;
+  c_derived_tbl *dctbl, *actbl;
+
+  /* Each interval starts with an empty bit buffer and zero DC predictions. */
+  state.next_output_byte = segment->data;
+  state.free_in_buffer = segment->size;
+  MEMZERO(&state.cur, sizeof(state.cur));
+  state.cinfo = cinfo;
+  state.segment = segment;
+  segment->failed = FALSE;
+  if (segment->data == NULL && ! dump_buffer(&state))
+    return;
+
+  for (; mcu < end_mcu; mcu++) {
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++, block++) {
+      ci = cinfo->MCU_membership[blkn];
+      compptr = cinfo->cur_comp_info[ci];
+      dctbl = entropy->dc_derived_tbls[compptr->dc_tbl_no];
+      actbl = entropy->ac_derived_tbls[compptr->ac_tbl_no];
+      if (entropy->simd) {
+        if (! encode_one_block_simd(&state, block[0],
+                                    state.cur.last_dc_val[ci], dctbl, actbl))
+          return;
+      } else {
+        if (! encode_one_block(&state, block[0], state.cur.last_dc_val[ci],
+                               dctbl, actbl))
+          return;
+      }
+      state.cur.last_dc_val[ci] = block[0][0];
+    }
+  }
+
+  if (! flush_bits(&state))
+    return;
+  segment->used = segment->size - state.free_in_buffer;
+}
+
+
+LOCAL(void)
+release_batch (j_compress_ptr cinfo)
+/* Free the private buffers of the restart intervals */
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  int i;
+
+  for (i = 0; i < entropy->batch_intervals; i++) {
+    if (entropy->segments[i].data != NULL) {
+      free(entropy->segments[i].data);
+      entropy->segments[i].data = NULL;
+      entropy->segments[i].size = 0;
+    }
+  }
+}
+
+
+LOCAL(void)
+write_batch_data (j_compress_ptr cinfo, const JOCTET *data, size_t size)
+/* Copy encoded data to the destination */
+{
+  struct jpeg_destination_mgr *dest = cinfo->dest;
+
+  /* Hand large blocks directly to destinations that can take them. */
+  if (size > dest->free_in_buffer && jpeg_write_direct(cinfo, data, size))
+    return;
+
+  while (size >= dest->free_in_buffer) {
+    MEMCOPY(dest->next_output_byte, data, dest->free_in_buffer);
+    data += dest->free_in_buffer;
+    size -= dest->free_in_buffer;
+    dest->next_output_byte += dest->free_in_buffer;
+    dest->free_in_buffer = 0;
+    if (! (*dest->empty_output_buffer) (cinfo)) {
+      release_batch(cinfo);
+      ERREXIT(cinfo, JERR_CANT_SUSPEND);
+    }
+  }
+  MEMCOPY(dest->next_output_byte, data, size);
+  dest->next_output_byte += size;
+  dest->free_in_buffer -= size;
+}
+
+
+LOCAL(void)
+encode_batch (j_compress_ptr cinfo)
+/* Encode the buffered restart intervals and write them out */
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  int num_intervals = (int) ((entropy->batch_mcus +
+                              cinfo->restart_interval - 1) /
+                             cinfo->restart_interval);
+  JOCTET marker[2];
+  int i;
+
+  jthread_run_tasks(cinfo->master->num_threads, num_intervals,
+                    encode_interval_task, (void *) cinfo);
+
+  for (i = 0; i < num_intervals; i++) {
+    if (entropy->segments[i].failed) {
+      release_batch(cinfo);
+      ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 11);
+    }
+  }
+
+  for (i = 0; i < num_intervals; i++) {
+    if (! entropy->first_interval) {
+      marker[0] = 0xFF;
+      marker[1] = (JOCTET) (JPEG_RST0 + entropy->next_restart_num);
+      write_batch_data(cinfo, marker, 2);
+      entropy->next_restart_num++;
+      entropy->next_restart_num &= 7;
+    }
+    entropy->first_interval = FALSE;
+    write_batch_data(cinfo, entropy->segments[i].data,
+                     entropy->segments[i].used);
+  }
+
+  entropy->batch_mcus = 0;
+}
+
+
+/*
+ * Buffer one MCU's worth of coefficients for parallel encoding.
+ */
+
+METHODDEF(boolean)
+encode_mcu_batch (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  JBLOCKROW block = entropy->batch_blocks +
+                    entropy->batch_mcus * cinfo->blocks_in_MCU;
+  int blkn;
+
+  for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+    MEMCOPY(block[blkn], MCU_data[blkn][0], sizeof(JBLOCK));
+
+  if (++entropy->batch_mcus ==
+      (JDIMENSION) entropy->batch_intervals * cinfo->restart_interval)
+    encode_batch(cinfo);
+
+  return TRUE;
+}
+
+
+/*
+ * Finish up at the end of a scan encoded in batches of restart intervals.
+ */
+
+METHODDEF(void)
+finish_pass_batch (j_compress_ptr cinfo)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+
+  if (entropy->batch_mcus > 0)
+    encode_batch(cinfo);
+  release_batch(cinfo);
+}
+
+
 
 /*
  * Huffman coding optimization.
@@ -856,59 +1192,22 @@ encode_mcu_gather (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 
 
 /*
- * Generate the best Huffman code table for the given counts, fill htbl.
- * Note this is also used by jcphuff.c.
- *
- * The JPEG standard requires that no symbol be assigned a codeword of all
- * one bits (so that padding bits added at the end of a compressed segment
- * can't look like a valid code).  Because of the canonical ordering of
- * codewords, this just means that there must be an unused slot in the
- * longest codeword length category.  Section K.2 of the JPEG spec suggests
- * reserving such a slot by pretending that symbol 256 is a valid symbol
- * with count 1.  In theory that's not optimal; giving it count zero but
- * including it in the symbol set anyway should give a better Huffman code.
- * But the theoretically better code actually seems to come out worse in
- * practice, because it produces more all-ones bytes (which incur stuffed
- * zero bytes in the final file).  In any case the difference is tiny.
- *
- * The JPEG standard requires Huffman codes to be no more than 16 bits long.
- * If some symbols have a very small but nonzero probability, the Huffman tree
- * must be adjusted to meet the code length restriction.  We currently use
- * the adjustment method suggested in JPEG section K.2.  This method is *not*
- * optimal; it may not choose the best possible limited-length code.  But
- * typically only very-low-frequency symbols will be given less-than-optimal
- * lengths, so the code is almost optimal.  Experimental comparisons against
- * an optimal limited-length-code algorithm indicate that the difference is
- * microscopic --- usually less than a hundredth of a percent of total size.
- * So the extra complexity of an optimal algorithm doesn't seem worthwhile.
+ * Assign code lengths to the symbols with nonzero counts in freq[] using
+ * Huffman's basic algorithm.  This clobbers freq[].  The lengths may exceed
+ * 16 bits, in which case jpeg_gen_optimal_table() adjusts them.
  */
 
-GLOBAL(void)
-jpeg_gen_optimal_table (j_compress_ptr cinfo, JHUFF_TBL *htbl, long freq[])
+LOCAL(void)
+huffman_code_lengths (long freq[], int codesize[])
 {
-#define MAX_CLEN 32             /* assumed maximum initial code length */
-  UINT8 bits[MAX_CLEN+1];       /* bits[k] = # of symbols with code length k */
-  int codesize[257];            /* codesize[k] = code length of symbol k */
   int others[257];              /* next symbol in current branch of tree */
   int c1, c2;
-  int p, i, j;
+  int i;
   long v;
 
-  /* This algorithm is explained in section K.2 of the JPEG standard */
-
-  MEMZERO(bits, sizeof(bits));
-  MEMZERO(codesize, sizeof(codesize));
   for (i = 0; i < 257; i++)
     others[i] = -1;             /* init links to empty */
 
-  freq[256] = 1;                /* make sure 256 has a nonzero count */
-  /* Including the pseudo-symbol 256 in the Huffman procedure guarantees
-   * that no real symbol is given code-value of all ones, because 256
-   * will be placed last in the largest codeword category.
-   */
-
-  /* Huffman's basic algorithm to assign optimal code lengths to symbols */
-
   for (;;) {
     /* Find the smallest nonzero frequency, set c1 = its symbol */
     /* In case of ties, take the larger symbol number */
@@ -956,6 +1255,250 @@ jpeg_gen_optimal_table (j_compress_ptr cinfo, JHUFF_TBL *htbl, long freq[])
       codesize[c2]++;
     }
   }
+}
+
+
+/* Binary heap of Huffman trees, ordered as huffman_code_lengths() picks them:
+ * by count and, among equal counts, larger symbol first.
+ */
+
+#define HEAP_BEFORE(a,b)  (w[a] < w[b] || (w[a] == w[b] && (a) > (b)))
+
+LOCAL(void)
+heap_insert (int heap[], int *n, const long w[], int c)
+{
+  int j;
+
+  for (j = (*n)++; j > 0 && HEAP_BEFORE(c, heap[(j - 1) / 2]);
+       j = (j - 1) / 2)
+    heap[j] = heap[(j - 1) / 2];
+  heap[j] = c;
+}
+
+LOCAL(int)
+heap_remove (int heap[], int *n, const long w[])
+{
+  int top = heap[0];
+  int c = heap[--(*n)];
+  int j, k;
+
+  for (j = 0; (k = 2 * j + 1) < *n; j = k) {
+    if (k + 1 < *n && HEAP_BEFORE(heap[k + 1], heap[k]))
+      k++;
+    if (!HEAP_BEFORE(heap[k], c))
+      break;
+    heap[j] = heap[k];
+  }
+  heap[j] = c;
+  return top;
+}
+
+
+/*
+ * Same as huffman_code_lengths(), but keeps the unmerged trees in a binary
+ * heap rather than searching all 257 counts for each merge, and leaves freq[]
+ * alone.  The heap orders the trees by count and, among equal counts, puts
+ * the larger symbol first, so the same pairs are merged in the same order and
+ * the code lengths come out identical.  Returns the longest code length.
+ */
+
+LOCAL(int)
+heap_code_lengths (const long freq[], int codesize[])
+{
+  long w[257];                  /* count of each tree, by its first symbol */
+  int heap[257];                /* trees not yet merged */
+  int others[257];              /* next symbol in current branch of tree */
+  int n, i, c1, c2, maxlen;
+
+  n = 0;
+  for (i = 0; i <= 256; i++) {
+    others[i] = -1;
+    w[i] = freq[i];
+    if (freq[i])
+      heap_insert(heap, &n, w, i);
+  }
+
+  while (n > 1) {
+    /* Merge the two smallest trees into c1's */
+    c1 = heap_remove(heap, &n, w);
+    c2 = heap_remove(heap, &n, w);
+    w[c1] += w[c2];
+    heap_insert(heap, &n, w, c1);
+
+    /* Increment the codesize of everything in c1's and c2's tree branches */
+    codesize[c1]++;
+    while (others[c1] >= 0) {
+      c1 = others[c1];
+      codesize[c1]++;
+    }
+    others[c1] = c2;
+    codesize[c2]++;
+    while (others[c2] >= 0) {
+      c2 = others[c2];
+      codesize[c2]++;
+    }
+  }
+
+  maxlen = 0;
+  for (i = 0; i <= 256; i++) {
+    if (codesize[i] > maxlen)
+      maxlen = codesize[i];
+  }
+  return maxlen;
+}
+
+
+/*
+ * Assign optimal code lengths of at most 16 bits to the symbols with nonzero
+ * counts in freq[], using the package-merge algorithm (L. L. Larmore and
+ * D. S. Hirschberg, "A fast algorithm for optimal length-limited Huffman
+ * codes", JACM 37(3), 1990.)
+ *
+ * The symbols are sorted by increasing count.  The list for the longest
+ * codes holds the symbols alone, and each list for codes one bit shorter
+ * merges the symbols with the "packages" formed by pairing up the items of
+ * the previous list, in order, whose weight is the sum of the pair's.  Taking
+ * the first 2n-2 items of the last list, and then recursively the items of
+ * the previous list that make up the packages taken, each symbol's code
+ * length is the number of times it is taken.  Since the symbols taken from
+ * each list are the first ones in sorted order, we only need to remember
+ * which items of each list are symbols.  This takes O(n * 16) time.
+ *
+ * Among symbols with equal counts, the larger symbol sorts first, so that
+ * pseudo-symbol 256 gets a longest code, as required by
+ * jpeg_gen_optimal_table().
+ */
+
+#define MAX_CODE_LEN  16        /* longest code length allowed by JPEG */
+
+LOCAL(void)
+limited_code_lengths (const long freq[], int codesize[])
+{
+  int sorted[257];              /* symbols with nonzero counts, sorted */
+  double weight[2][2 * 257];    /* weights of the items of the last 2 lists */
+  char is_symbol[MAX_CODE_LEN][2 * 257]; /* TRUE=list item is a symbol */
+  double *prev, *next;
+  int n, i, j, k, level, num_packages, num_symbols, num_taken;
+
+  /* Insertion sort, which is plenty fast for 257 symbols */
+  n = 0;
+  for (i = 256; i >= 0; i--) {
+    if (freq[i] == 0)
+      continue;
+    for (j = n; j > 0 && freq[sorted[j - 1]] > freq[i]; j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = i;
+    n++;
+  }
+
+  if (n < 2) {                  /* one symbol still needs a 1-bit code */
+    codesize[sorted[0]] = 1;
+    return;
+  }
+
+  /* Build the lists, from the longest codes (level 0) up.  The weights are
+   * kept in floating point so that the package sums cannot overflow.
+   */
+  for (i = 0; i < n; i++) {
+    weight[0][i] = (double) freq[sorted[i]];
+    is_symbol[0][i] = TRUE;
+  }
+  num_taken = n;                /* size of the previous list */
+  for (level = 1; level < MAX_CODE_LEN; level++) {
+    prev = weight[(level - 1) & 1];
+    next = weight[level & 1];
+    num_packages = num_taken / 2;
+    i = j = k = 0;
+    while (i < n || j < num_packages) {
+      if (j >= num_packages ||
+          (i < n && (double) freq[sorted[i]] <= prev[2 * j] + prev[2 * j + 1])) {
+        next[k] = (double) freq[sorted[i++]];
+        is_symbol[level][k++] = TRUE;
+      } else {
+        next[k] = prev[2 * j] + prev[2 * j + 1];
+        j++;
+        is_symbol[level][k++] = FALSE;
+      }
+    }
+    num_taken = k;
+  }
+
+  /* Take the items, from the shortest codes down */
+  num_taken = 2 * n - 2;
+  for (level = MAX_CODE_LEN - 1; level >= 0 && num_taken > 0; level--) {
+    num_symbols = 0;
+    for (k = 0; k < num_taken; k++)
+      num_symbols += is_symbol[level][k];
+    for (i = 0; i < num_symbols; i++)
+      codesize[sorted[i]]++;
+    num_taken = 2 * (num_taken - num_symbols);
+  }
+}
+
+
+/*
+ * Generate the best Huffman code table for the given counts, fill htbl.
+ * Note this is also used by jcphuff.c.
+ *
+ * The JPEG standard requires that no symbol be assigned a codeword of all
+ * one bits (so that padding bits added at the end of a compressed segment
+ * can't look like a valid code).  Because of the canonical ordering of
+ * codewords, this just means that there must be an unused slot in the
+ * longest codeword length category.  Section K.2 of the JPEG spec suggests
+ * reserving such a slot by pretending that symbol 256 is a valid symbol
+ * with count 1.  In theory that's not optimal; giving it count zero but
+ * including it in the symbol set anyway should give a better Huffman code.
+ * But the theoretically better code actually seems to come out worse in
+ * practice, because it produces more all-ones bytes (which incur stuffed
+ * zero bytes in the final file).  In any case the difference is tiny.
+ *
+ * The JPEG standard requires Huffman codes to be no more than 16 bits long.
+ * If some symbols have a very small but nonzero probability, the Huffman tree
+ * must be adjusted to meet the code length restriction.  By default, we use
+ * the adjustment method suggested in JPEG section K.2.  This method is *not*
+ * optimal; it may not choose the best possible limited-length code.  But
+ * typically only very-low-frequency symbols will be given less-than-optimal
+ * lengths, so the code is almost optimal.  Experimental comparisons against
+ * an optimal limited-length-code algorithm indicate that the difference is
+ * microscopic --- usually less than a hundredth of a percent of total size.
+ * With JINT_HUFF_TABLE_MODE = 1, we use such an algorithm (package-merge,
+ * see limited_code_lengths()) instead, but only when some code would exceed
+ * 16 bits; otherwise we keep the Huffman code lengths, built with a heap
+ * (heap_code_lengths()) rather than the quadratic procedure.  Either way,
+ * this is much faster, which matters because the tables are generated many
+ * times over when optimizing scans and in trellis quantization loops.
+ */
+
+GLOBAL(void)
+jpeg_gen_optimal_table (j_compress_ptr cinfo, JHUFF_TBL *htbl, long freq[])
+{
+#define MAX_CLEN 32             /* assumed maximum initial code length */
+  UINT8 bits[MAX_CLEN+1];       /* bits[k] = # of symbols with code length k */
+  int codesize[257];            /* codesize[k] = code length of symbol k */
+  int p, i, j;
+
+  /* This algorithm is explained in section K.2 of the JPEG standard */
+
+  MEMZERO(bits, sizeof(bits));
+  MEMZERO(codesize, sizeof(codesize));
+
+  freq[256] = 1;                /* make sure 256 has a nonzero count */
+  /* Including the pseudo-symbol 256 in the Huffman procedure guarantees
+   * that no real symbol is given code-value of all ones, because 256
+   * will be placed last in the largest codeword category.
+   */
+
+  if (cinfo->master->huff_table_mode == 1) {
+    /* Package-merge is only needed if the limit binds.  Otherwise, keep the
+     * Huffman code lengths: package-merge may pick other lengths that are
+     * just as short, but whose codes produce more stuffed zero bytes.
+     */
+    if (heap_code_lengths(freq, codesize) > MAX_CODE_LEN) {
+      MEMZERO(codesize, sizeof(codesize));
+      limited_code_lengths(freq, codesize);
+    }
+  } else
+    huffman_code_lengths(freq, codesize);
 
   /* Now count the number of symbols of each code length */
   for (i = 0; i <= 256; i++) {
@@ -1020,6 +1563,38 @@ jpeg_gen_optimal_table (j_compress_ptr cinfo, JHUFF_TBL *htbl, long freq[])
 }
 
 
+/*
+ * Estimate the number of bits that the symbols counted in freq[] occupy
+ * when coded with the table htbl, including the magnitude bits that follow
+ * each symbol (the low 4 bits of both DC and AC symbols give their number)
+ * and the run length bits that follow progressive EOBn symbols (0xn0, n < 15.)
+ * freq[] must hold the counts as they were before being passed to
+ * jpeg_gen_optimal_table(), which clobbers them.
+ *
+ * Note this is also used by jcphuff.c.
+ */
+
+GLOBAL(double)
+jpeg_huff_table_bits (JHUFF_TBL *htbl, const long freq[])
+{
+  double total = 0.0;
+  int len, i, p = 0;
+
+  for (len = 1; len <= 16; len++) {
+    for (i = 0; i < htbl->bits[len]; i++, p++) {
+      int sym = htbl->huffval[p];
+      int extra = sym & 15;
+
+      if (extra == 0 && sym != 0xF0)
+        extra = sym >> 4;
+      total += (double) freq[sym] * (len + extra);
+    }
+  }
+
+  return total;
+}
+
+
 /*
  * Finish up a statistics-gathering pass and create the new Huffman tables.
  */
@@ -1033,12 +1608,14 @@ finish_pass_gather (j_compress_ptr cinfo)
   JHUFF_TBL **htblptr;
   boolean did_dc[NUM_HUFF_TBLS];
   boolean did_ac[NUM_HUFF_TBLS];
+  long counts[257];
 
   /* It's important not to apply jpeg_gen_optimal_table more than once
    * per table, because it clobbers the input frequency counts!
    */
   MEMZERO(did_dc, sizeof(did_dc));
   MEMZERO(did_ac, sizeof(did_ac));
+  cinfo->master->gather_bits = 0.0;
 
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
     compptr = cinfo->cur_comp_info[ci];
@@ -1048,14 +1625,18 @@ finish_pass_gather (j_compress_ptr cinfo)
       htblptr = & cinfo->dc_huff_tbl_ptrs[dctbl];
       if (*htblptr == NULL)
         *htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+      MEMCOPY(counts, entropy->dc_count_ptrs[dctbl], sizeof(counts));
       jpeg_gen_optimal_table(cinfo, *htblptr, entropy->dc_count_ptrs[dctbl]);
+      cinfo->master->gather_bits += jpeg_huff_table_bits(*htblptr, counts);
       did_dc[dctbl] = TRUE;
     }
     if (! did_ac[actbl]) {
       htblptr = & cinfo->ac_huff_tbl_ptrs[actbl];
       if (*htblptr == NULL)
         *htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+      MEMCOPY(counts, entropy->ac_count_ptrs[actbl], sizeof(counts));
       jpeg_gen_optimal_table(cinfo, *htblptr, entropy->ac_count_ptrs[actbl]);
+      cinfo->master->gather_bits += jpeg_huff_table_bits(*htblptr, counts);
       did_ac[actbl] = TRUE;
     }
   }
@@ -1088,4 +1669,8 @@ jinit_huff_encoder (j_compress_ptr cinfo)
     entropy->dc_count_ptrs[i] = entropy->ac_count_ptrs[i] = NULL;
 #endif
   }
+  entropy->batch_blocks = NULL;
+  entropy->batch_blocks_size = 0;
+  entropy->segments = NULL;
+  entropy->batch_intervals = 0;
 }
@@ -43,7 +43,11 @@ EXTERN(void) jpeg_make_c_derived_tbl
 EXTERN(void) jpeg_gen_optimal_table
         (j_compress_ptr cinfo, JHUFF_TBL *htbl, long freq[]);
 
+/* Estimate the coded size, in bits, of the given counts with a table */
+EXTERN(double) jpeg_huff_table_bits (JHUFF_TBL *htbl, const long freq[]);
+
 EXTERN(void) quantize_trellis
         (j_compress_ptr cinfo, c_derived_tbl *dctbl, c_derived_tbl *actbl, JBLOCKROW coef_blocks, JBLOCKROW src, JDIMENSION num_blocks,
                  JQUANT_TBL * qtbl, double *norm_src, double *norm_coef, JCOEF *last_dc_val,
-         JBLOCKROW coef_blocks_above, JBLOCKROW src_above);
+         JBLOCKROW coef_blocks_above, JBLOCKROW src_above,
+         trellis_workspace *ws);
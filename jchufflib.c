@@ -0,0 +1,647 @@
+/*
+ * jchufflib.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains a library of pre-trained Huffman tables for sequential
+ * JPEG encoding, and the routine that picks tables from it for an image
+ * (see JBOOLEAN_HUFF_TABLE_LIBRARY in README-mozilla.txt.)
+ *
+ * Optimized Huffman tables can only be built once the statistics of the whole
+ * image are known, which requires buffering all of its coefficients and an
+ * extra pass over them.  Tables trained on typical images, for the same
+ * quantization and sampling, capture most of the benefit, and let a baseline
+ * image be encoded in a single streaming pass.
+ *
+ * The tables were trained on the images in testimages/ (testorig.ppm,
+ * nightshot_iso_100.bmp and vgl_*.bmp), encoded with cjpeg -baseline
+ * -notrellis at qualities 95, 90, 80, 70, 50, 30, 20, 10 and 5, both with
+ * subsampled (2x2) and with full-resolution chroma.  The symbol counts of each
+ * image were normalized to the same total and summed, and each table was
+ * generated from the sums by jpeg_gen_optimal_table(), after giving every
+ * symbol that baseline 8-bit data can produce a count of at least 1 so that
+ * any image can be encoded with the tables.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+
+
+/* A table in the format of JHUFF_TBL (the DC tables only use the first 12
+ * entries of huffval[])
+ */
+
+typedef struct {
+  UINT8 bits[17];
+  UINT8 huffval[162];
+} trained_huff_tbl;
+
+
+/* The tables are trained for several quality levels, which we tell apart by
+ * the sum of the 64 entries of the luminance quantization table.  Each class
+ * starts at the given limit, which lies halfway (geometrically) between the
+ * sums of neighboring training qualities for the default quantization tables.
+ * Tables trained at quality 90 and 95 made larger files than the standard
+ * tables from the JPEG spec, so there are none for sums below the first limit
+ * (about quality 85.)
+ */
+
+#define NUM_QUALITY_CLASSES  7
+
+static const long quality_class_limit[NUM_QUALITY_CLASSES] = {
+  1612, 2794, 4313, 6561, 8914, 11521, 14317
+};
+
+/* Luminance tables, by quality class */
+
+static const trained_huff_tbl luma_dc_tables[NUM_QUALITY_CLASSES] = {
+  { /* quality 80 */
+    { 0, 0, 2, 2, 3, 1, 1, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x05, 0x06, 0x03, 0x04, 0x01, 0x02, 0x07, 0x00, 0x08, 0x09,
+      0x0a, 0x0b } },
+  { /* quality 70 */
+    { 0, 0, 1, 5, 1, 1, 1, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x05, 0x01, 0x02, 0x03, 0x04, 0x06, 0x00, 0x07, 0x08, 0x09,
+      0x0a, 0x0b } },
+  { /* quality 50 */
+    { 0, 0, 2, 3, 1, 1, 1, 0, 3, 1, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x03, 0x04, 0x01, 0x02, 0x05, 0x00, 0x06, 0x07, 0x08, 0x09,
+      0x0a, 0x0b } },
+  { /* quality 30 */
+    { 0, 0, 2, 3, 1, 1, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x03, 0x04, 0x00, 0x01, 0x02, 0x05, 0x06, 0x07, 0x08, 0x09,
+      0x0a, 0x0b } },
+  { /* quality 20 */
+    { 0, 0, 3, 1, 1, 1, 1, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x00, 0x02, 0x03, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+      0x0a, 0x0b } },
+  { /* quality 10 */
+    { 0, 0, 3, 1, 1, 1, 0, 1, 5, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+      0x0a, 0x0b } },
+  { /* quality 5 */
+    { 0, 1, 1, 1, 1, 1, 0, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+      0x0a, 0x0b } }
+};
+
+static const trained_huff_tbl luma_ac_tables[NUM_QUALITY_CLASSES] = {
+  { /* quality 80 */
+    { 0, 0, 2, 1, 3, 3, 2, 4, 4, 4, 4, 3, 1, 1, 1, 2, 127 },
+    { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x06,
+      0x31, 0x13, 0x22, 0x41, 0x51, 0x07, 0x14, 0x61, 0x71, 0x23,
+      0x32, 0x81, 0x91, 0x15, 0x42, 0xa1, 0xb1, 0x52, 0xc1, 0xd1,
+      0x17, 0x24, 0x33, 0x62, 0x72, 0x16, 0x43, 0xe1, 0xf0, 0x34,
+      0x53, 0x67, 0x82, 0xa5, 0xc2, 0xe2, 0x25, 0x26, 0x35, 0x44,
+      0x54, 0x57, 0x94, 0xb2, 0xf1, 0xd2, 0x08, 0x09, 0x0a, 0x18,
+      0x19, 0x1a, 0x27, 0x28, 0x29, 0x2a, 0x36, 0x37, 0x38, 0x39,
+      0x3a, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x55, 0x56, 0x58,
+      0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x68, 0x69, 0x6a, 0x73,
+      0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85,
+      0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x95, 0x96, 0x97,
+      0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa6, 0xa7, 0xa8, 0xa9,
+      0xaa, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc3,
+      0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd3, 0xd4, 0xd5,
+      0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+      0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa } },
+  { /* quality 70 */
+    { 0, 0, 2, 1, 3, 3, 2, 5, 2, 4, 3, 5, 1, 1, 1, 2, 127 },
+    { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31,
+      0x41, 0x06, 0x13, 0x22, 0x51, 0x61, 0x32, 0x71, 0x14, 0x23,
+      0x81, 0x91, 0xa1, 0xb1, 0xc1, 0x15, 0x16, 0x42, 0x52, 0xd1,
+      0x24, 0x33, 0x62, 0xe1, 0xf0, 0x07, 0x25, 0x43, 0x53, 0x82,
+      0xf1, 0x66, 0x72, 0xa5, 0x26, 0x35, 0x45, 0x46, 0x54, 0x56,
+      0x73, 0x93, 0xd2, 0x34, 0x08, 0x09, 0x0a, 0x17, 0x18, 0x19,
+      0x1a, 0x27, 0x28, 0x29, 0x2a, 0x36, 0x37, 0x38, 0x39, 0x3a,
+      0x44, 0x47, 0x48, 0x49, 0x4a, 0x55, 0x57, 0x58, 0x59, 0x5a,
+      0x63, 0x64, 0x65, 0x67, 0x68, 0x69, 0x6a, 0x74, 0x75, 0x76,
+      0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+      0x89, 0x8a, 0x92, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+      0xa2, 0xa3, 0xa4, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3,
+      0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+      0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd3, 0xd4, 0xd5, 0xd6,
+      0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+      0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa } },
+  { /* quality 50 */
+    { 0, 0, 2, 2, 1, 3, 2, 5, 2, 2, 7, 5, 1, 1, 2, 0, 127 },
+    { 0x01, 0x02, 0x00, 0x03, 0x11, 0x04, 0x12, 0x21, 0x31, 0x41,
+      0x05, 0x13, 0x22, 0x51, 0x61, 0x32, 0x71, 0x81, 0x91, 0x06,
+      0x14, 0x23, 0x42, 0xa1, 0xb1, 0xc1, 0x15, 0x33, 0x52, 0xd1,
+      0xe1, 0x16, 0x24, 0x53, 0x62, 0xf0, 0x43, 0x72, 0xa2, 0xa4,
+      0xb2, 0xf1, 0x25, 0x56, 0x66, 0x73, 0x92, 0x34, 0x44, 0x82,
+      0x93, 0xd2, 0x07, 0x08, 0x09, 0x0a, 0x17, 0x18, 0x19, 0x1a,
+      0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39,
+      0x3a, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x54, 0x55, 0x57,
+      0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x67, 0x68, 0x69, 0x6a,
+      0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85,
+      0x86, 0x87, 0x88, 0x89, 0x8a, 0x94, 0x95, 0x96, 0x97, 0x98,
+      0x99, 0x9a, 0xa3, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb3,
+      0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+      0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd3, 0xd4, 0xd5, 0xd6,
+      0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+      0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa } },
+  { /* quality 30 */
+    { 0, 0, 1, 4, 1, 3, 2, 4, 3, 7, 3, 1, 1, 1, 1, 1, 129 },
+    { 0x01, 0x00, 0x02, 0x03, 0x11, 0x21, 0x04, 0x12, 0x31, 0x41,
+      0x51, 0x13, 0x22, 0x61, 0x71, 0x05, 0x32, 0x81, 0x14, 0x15,
+      0x52, 0x91, 0xa1, 0xb1, 0xc1, 0x23, 0x42, 0xf0, 0x33, 0x62,
+      0xd1, 0x72, 0x34, 0x43, 0x44, 0x65, 0x92, 0xa3, 0xe1, 0x24,
+      0x53, 0x55, 0x82, 0xf1, 0xa2, 0x06, 0x07, 0x08, 0x09, 0x0a,
+      0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29,
+      0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x45, 0x46, 0x47,
+      0x48, 0x49, 0x4a, 0x54, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63,
+      0x64, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76,
+      0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+      0x89, 0x8a, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+      0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+      0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+      0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+      0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa } },
+  { /* quality 20 */
+    { 0, 0, 2, 2, 1, 3, 3, 2, 3, 6, 4, 3, 1, 1, 1, 1, 129 },
+    { 0x00, 0x01, 0x02, 0x11, 0x03, 0x12, 0x21, 0x31, 0x04, 0x41,
+      0x51, 0x22, 0x61, 0x13, 0x14, 0x71, 0x32, 0x52, 0x81, 0x91,
+      0xb1, 0xf0, 0x42, 0xa1, 0xc1, 0xd1, 0x23, 0x33, 0x43, 0x62,
+      0x05, 0x64, 0x72, 0xa3, 0xe1, 0xf1, 0x53, 0x82, 0x92, 0x24,
+      0x54, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x15, 0x16, 0x17, 0x18,
+      0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35,
+      0x36, 0x37, 0x38, 0x39, 0x3a, 0x44, 0x45, 0x46, 0x47, 0x48,
+      0x49, 0x4a, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x65,
+      0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77,
+      0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+      0x8a, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2,
+      0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+      0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+      0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+      0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa } },
+  { /* quality 10 */
+    { 0, 0, 2, 2, 1, 1, 7, 1, 7, 4, 1, 1, 1, 1, 0, 2, 131 },
+    { 0x00, 0x01, 0x02, 0x11, 0x21, 0x31, 0x03, 0x12, 0x13, 0x41,
+      0x51, 0x61, 0x71, 0xf0, 0x22, 0x81, 0x91, 0xa1, 0xb1, 0xc1,
+      0xe1, 0x32, 0x42, 0x52, 0xd1, 0x62, 0xf1, 0x04, 0x63, 0xa2,
+      0x53, 0x23, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x14, 0x15,
+      0x16, 0x17, 0x18, 0x19, 0x1a, 0x24, 0x25, 0x26, 0x27, 0x28,
+      0x29, 0x2a, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+      0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x54, 0x55,
+      0x56, 0x57, 0x58, 0x59, 0x5a, 0x64, 0x65, 0x66, 0x67, 0x68,
+      0x69, 0x6a, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+      0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+      0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa3,
+      0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+      0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+      0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+      0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa } },
+  { /* quality 5 */
+    { 0, 1, 1, 0, 1, 2, 4, 5, 3, 4, 1, 1, 1, 0, 1, 2, 135 },
+    { 0x00, 0x01, 0x11, 0x21, 0x31, 0x02, 0x12, 0x41, 0xf0, 0x51,
+      0x61, 0x71, 0x91, 0xa1, 0x81, 0xb1, 0xd1, 0x22, 0xc1, 0xe1,
+      0xf1, 0x03, 0x32, 0x52, 0x62, 0x13, 0x42, 0xa2, 0x53, 0x04,
+      0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x14, 0x15, 0x16, 0x17,
+      0x18, 0x19, 0x1a, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29,
+      0x2a, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43,
+      0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x54, 0x55, 0x56,
+      0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+      0x69, 0x6a, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+      0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+      0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa3,
+      0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+      0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+      0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+      0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa } }
+};
+
+/* Chrominance tables, for full-resolution and for subsampled chroma, by
+ * quality class
+ */
+
+static const trained_huff_tbl chroma_dc_tables[2][NUM_QUALITY_CLASSES] = {
+  /* full-resolution chroma */
+  {
+    { /* quality 80 */
+      { 0, 0, 1, 5, 1, 1, 1, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 70 */
+      { 0, 0, 2, 3, 1, 1, 1, 0, 3, 1, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x02, 0x01, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 50 */
+      { 0, 1, 0, 3, 1, 1, 1, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 30 */
+      { 0, 1, 1, 1, 1, 1, 1, 0, 1, 5, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 20 */
+      { 0, 1, 1, 1, 1, 1, 1, 0, 1, 5, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 10 */
+      { 0, 1, 1, 1, 1, 1, 0, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 5 */
+      { 0, 1, 1, 1, 1, 0, 0, 7, 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } }
+  },
+  /* subsampled chroma */
+  {
+    { /* quality 80 */
+      { 0, 0, 2, 3, 1, 1, 1, 0, 3, 1, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x04, 0x02, 0x03, 0x05, 0x01, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 70 */
+      { 0, 0, 2, 3, 1, 1, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x03, 0x01, 0x02, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 50 */
+      { 0, 0, 3, 1, 1, 1, 1, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x02, 0x03, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 30 */
+      { 0, 0, 3, 1, 1, 1, 0, 1, 5, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 20 */
+      { 0, 1, 1, 1, 1, 1, 0, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 10 */
+      { 0, 1, 1, 1, 1, 1, 0, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } },
+    { /* quality 5 */
+      { 0, 1, 1, 1, 1, 0, 0, 7, 1, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b } }
+  }
+};
+
+static const trained_huff_tbl chroma_ac_tables[2][NUM_QUALITY_CLASSES] = {
+  /* full-resolution chroma */
+  {
+    { /* quality 80 */
+      { 0, 0, 2, 2, 1, 4, 0, 5, 3, 2, 5, 1, 1, 1, 0, 0, 135 },
+      { 0x00, 0x01, 0x02, 0x11, 0x03, 0x04, 0x12, 0x21, 0x31, 0x05,
+        0x13, 0x22, 0x41, 0x51, 0x14, 0x61, 0x71, 0x32, 0x91, 0x06,
+        0x23, 0x81, 0xa1, 0xb1, 0x42, 0x52, 0x15, 0xc1, 0xe1, 0xf0,
+        0x33, 0xb2, 0xd1, 0x24, 0x34, 0x35, 0x43, 0x62, 0x73, 0x74,
+        0x92, 0x53, 0xa2, 0xa3, 0x25, 0x07, 0x08, 0x09, 0x0a, 0x16,
+        0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x36,
+        0x37, 0x38, 0x39, 0x3a, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64,
+        0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x72, 0x75, 0x76, 0x77,
+        0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+        0x89, 0x8a, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb3, 0xb4, 0xb5,
+        0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
+        0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+        0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+        0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 70 */
+      { 0, 0, 2, 2, 1, 3, 2, 4, 5, 2, 4, 3, 1, 1, 1, 0, 131 },
+      { 0x00, 0x01, 0x02, 0x11, 0x03, 0x12, 0x21, 0x31, 0x04, 0x41,
+        0x13, 0x22, 0x51, 0x61, 0x05, 0x14, 0x32, 0x71, 0x91, 0x81,
+        0xb1, 0x42, 0xa1, 0xc1, 0xd1, 0x23, 0x52, 0x62, 0xe1, 0xf0,
+        0x24, 0x33, 0x34, 0x43, 0x72, 0x73, 0x92, 0x06, 0x53, 0xa2,
+        0xf1, 0x07, 0x08, 0x09, 0x0a, 0x15, 0x16, 0x17, 0x18, 0x19,
+        0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37,
+        0x38, 0x39, 0x3a, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a,
+        0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65,
+        0x66, 0x67, 0x68, 0x69, 0x6a, 0x74, 0x75, 0x76, 0x77, 0x78,
+        0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa3,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+        0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 50 */
+      { 0, 1, 1, 0, 2, 1, 3, 2, 5, 2, 4, 3, 1, 0, 2, 0, 135 },
+      { 0x00, 0x01, 0x02, 0x11, 0x21, 0x03, 0x12, 0x31, 0x41, 0x51,
+        0x04, 0x13, 0x22, 0x61, 0x71, 0x81, 0x91, 0x32, 0x42, 0xa1,
+        0xb1, 0x05, 0x52, 0xc1, 0xf0, 0x14, 0x23, 0x33, 0x72, 0xe1,
+        0x34, 0x62, 0xa2, 0xd1, 0xf1, 0x24, 0x43, 0x06, 0x07, 0x08,
+        0x09, 0x0a, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+        0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+        0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67,
+        0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+        0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+        0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa3,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+        0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 30 */
+      { 0, 1, 1, 0, 2, 1, 3, 3, 1, 7, 3, 1, 1, 0, 1, 2, 135 },
+      { 0x00, 0x01, 0x02, 0x11, 0x21, 0x03, 0x12, 0x31, 0x41, 0x51,
+        0x61, 0x71, 0x04, 0x13, 0x22, 0x32, 0x81, 0x91, 0xb1, 0x42,
+        0xa1, 0xf0, 0x33, 0x52, 0xc1, 0x23, 0x72, 0xd1, 0xe1, 0xf1,
+        0x43, 0x62, 0x82, 0x92, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+        0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x24, 0x25, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+        0x3a, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54,
+        0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66,
+        0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+        0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+        0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+        0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 20 */
+      { 0, 1, 1, 0, 2, 1, 3, 3, 1, 7, 3, 1, 1, 0, 1, 2, 135 },
+      { 0x00, 0x01, 0x02, 0x11, 0x21, 0x12, 0x31, 0x41, 0x03, 0x51,
+        0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x91, 0xa1, 0xb1, 0x42,
+        0xc1, 0xd1, 0xf0, 0x23, 0x52, 0x04, 0xe1, 0xf1, 0x33, 0x82,
+        0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x14, 0x15, 0x16, 0x17,
+        0x18, 0x19, 0x1a, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a,
+        0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+        0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57,
+        0x58, 0x59, 0x5a, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+        0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92,
+        0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+        0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+        0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 10 */
+      { 0, 1, 1, 1, 0, 1, 4, 1, 2, 5, 3, 1, 1, 0, 0, 2, 139 },
+      { 0x00, 0x01, 0x11, 0x02, 0x21, 0x31, 0x41, 0x51, 0x12, 0x61,
+        0x81, 0x32, 0x71, 0x91, 0xa1, 0xf0, 0x03, 0x22, 0x42, 0xb1,
+        0xc1, 0x52, 0x62, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+        0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x23, 0x24,
+        0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x33, 0x34, 0x35, 0x36,
+        0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a,
+        0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x72, 0x73,
+        0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84,
+        0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95,
+        0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6,
+        0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+        0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
+        0xc9, 0xca, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+        0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+        0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 5 */
+      { 0, 1, 1, 1, 0, 2, 1, 4, 3, 0, 1, 1, 0, 1, 1, 2, 143 },
+      { 0x00, 0x01, 0x11, 0x21, 0x31, 0x41, 0x02, 0x51, 0x81, 0xf0,
+        0x61, 0x71, 0x91, 0x12, 0xf1, 0x22, 0xa1, 0xc1, 0x03, 0x04,
+        0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x13, 0x14, 0x15, 0x16,
+        0x17, 0x18, 0x19, 0x1a, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+        0x3a, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a,
+        0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x62,
+        0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x72, 0x73,
+        0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84,
+        0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95,
+        0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6,
+        0xa7, 0xa8, 0xa9, 0xaa, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+        0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+        0xc8, 0xc9, 0xca, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+        0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } }
+  },
+  /* subsampled chroma */
+  {
+    { /* quality 80 */
+      { 0, 0, 2, 2, 1, 3, 2, 5, 2, 3, 6, 3, 1, 1, 1, 1, 129 },
+      { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x12, 0x21, 0x31, 0x41,
+        0x05, 0x13, 0x22, 0x32, 0x51, 0x61, 0x71, 0x42, 0x81, 0x91,
+        0x06, 0x14, 0x23, 0x33, 0x52, 0xb1, 0x53, 0x62, 0xa1, 0xc1,
+        0x72, 0xd1, 0xe1, 0xf0, 0x15, 0x24, 0x43, 0x92, 0xa2, 0xb2,
+        0x63, 0xd2, 0xf1, 0x07, 0x08, 0x09, 0x0a, 0x16, 0x17, 0x18,
+        0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35,
+        0x36, 0x37, 0x38, 0x39, 0x3a, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x64,
+        0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76,
+        0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+        0x9a, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb3,
+        0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+        0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 70 */
+      { 0, 0, 2, 2, 1, 3, 2, 5, 3, 1, 6, 3, 1, 1, 1, 0, 131 },
+      { 0x00, 0x01, 0x02, 0x11, 0x03, 0x12, 0x21, 0x31, 0x04, 0x41,
+        0x13, 0x22, 0x32, 0x51, 0x61, 0x05, 0x71, 0x81, 0x42, 0x52,
+        0x91, 0xa1, 0xb1, 0xc1, 0xd1, 0x14, 0x53, 0xe1, 0x06, 0x23,
+        0x33, 0xd2, 0xf0, 0xf1, 0x24, 0x43, 0x62, 0x73, 0x82, 0x92,
+        0xc2, 0x07, 0x08, 0x09, 0x0a, 0x15, 0x16, 0x17, 0x18, 0x19,
+        0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36,
+        0x37, 0x38, 0x39, 0x3a, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64,
+        0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x72, 0x74, 0x75, 0x76,
+        0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+        0x89, 0x8a, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+        0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2,
+        0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc3, 0xc4,
+        0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 50 */
+      { 0, 0, 2, 2, 1, 4, 1, 2, 4, 4, 5, 1, 1, 1, 0, 1, 133 },
+      { 0x00, 0x01, 0x02, 0x11, 0x03, 0x12, 0x21, 0x31, 0x41, 0x51,
+        0x04, 0x61, 0x13, 0x22, 0x71, 0x81, 0x52, 0x91, 0xa1, 0xb1,
+        0x05, 0x32, 0x42, 0xc1, 0xf0, 0x23, 0x33, 0x72, 0xe1, 0x62,
+        0x92, 0xf1, 0x14, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x15, 0x16,
+        0x17, 0x18, 0x19, 0x1a, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29,
+        0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+        0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56,
+        0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+        0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x93,
+        0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4,
+        0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5,
+        0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
+        0xc7, 0xc8, 0xc9, 0xca, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6,
+        0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 30 */
+      { 0, 1, 1, 0, 2, 1, 4, 1, 2, 5, 3, 1, 1, 0, 1, 0, 139 },
+      { 0x00, 0x01, 0x02, 0x11, 0x21, 0x03, 0x12, 0x31, 0x41, 0x51,
+        0x22, 0x61, 0x13, 0x32, 0x71, 0x81, 0x91, 0x04, 0x42, 0x72,
+        0xa1, 0xf0, 0x23, 0x52, 0xb1, 0xd1, 0xf1, 0xc1, 0x14, 0x05,
+        0x06, 0x07, 0x08, 0x09, 0x0a, 0x15, 0x16, 0x17, 0x18, 0x19,
+        0x1a, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x33, 0x34,
+        0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46,
+        0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+        0x59, 0x5a, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82,
+        0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93,
+        0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4,
+        0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5,
+        0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
+        0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+        0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+        0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 20 */
+      { 0, 1, 1, 0, 2, 1, 3, 4, 2, 1, 3, 1, 1, 0, 0, 1, 141 },
+      { 0x00, 0x01, 0x02, 0x11, 0x21, 0x12, 0x31, 0x41, 0x03, 0x51,
+        0x61, 0x71, 0x22, 0x81, 0x91, 0x32, 0x42, 0xa1, 0x04, 0x13,
+        0x62, 0xc1, 0xf1, 0x14, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+        0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x23, 0x24, 0x25, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38,
+        0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a,
+        0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63,
+        0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x72, 0x73, 0x74,
+        0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85,
+        0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+        0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+        0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
+        0xc9, 0xca, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+        0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+        0xe9, 0xea, 0xf0, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 10 */
+      { 0, 1, 1, 1, 0, 2, 2, 2, 1, 4, 1, 1, 0, 1, 2, 0, 143 },
+      { 0x00, 0x01, 0x11, 0x02, 0x21, 0x31, 0x41, 0x12, 0x71, 0x51,
+        0x03, 0x22, 0x61, 0x81, 0x32, 0xc1, 0xf0, 0x13, 0x04, 0x05,
+        0x06, 0x07, 0x08, 0x09, 0x0a, 0x14, 0x15, 0x16, 0x17, 0x18,
+        0x19, 0x1a, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a,
+        0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x42, 0x43,
+        0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x52, 0x53, 0x54,
+        0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x62, 0x63, 0x64, 0x65,
+        0x66, 0x67, 0x68, 0x69, 0x6a, 0x72, 0x73, 0x74, 0x75, 0x76,
+        0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+        0x98, 0x99, 0x9a, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+        0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
+        0xc9, 0xca, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8,
+        0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+        0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } },
+    { /* quality 5 */
+      { 0, 1, 1, 1, 0, 2, 2, 3, 1, 0, 1, 1, 0, 1, 1, 0, 147 },
+      { 0x00, 0x01, 0x11, 0x21, 0x31, 0x41, 0x71, 0x02, 0x22, 0x51,
+        0x12, 0x61, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+        0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x23, 0x24,
+        0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x32, 0x33, 0x34, 0x35,
+        0x36, 0x37, 0x38, 0x39, 0x3a, 0x42, 0x43, 0x44, 0x45, 0x46,
+        0x47, 0x48, 0x49, 0x4a, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
+        0x58, 0x59, 0x5a, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+        0x7a, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+        0x9a, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9,
+        0xaa, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9,
+        0xba, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+        0xca, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+        0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+        0xea, 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa } }
+  }
+};
+
+
+LOCAL(void)
+set_trained_table (j_compress_ptr cinfo, JHUFF_TBL **htblptr,
+                   const trained_huff_tbl *table)
+{
+  if (*htblptr == NULL)
+    *htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+
+  MEMCOPY((*htblptr)->bits, table->bits, sizeof((*htblptr)->bits));
+  MEMZERO((*htblptr)->huffval, sizeof((*htblptr)->huffval));
+  MEMCOPY((*htblptr)->huffval, table->huffval, sizeof(table->huffval));
+  /* Initialize sent_table FALSE so table will be written to JPEG file. */
+  (*htblptr)->sent_table = FALSE;
+}
+
+
+/*
+ * Install the pre-trained tables that best match the image as Huffman tables
+ * 0 (luminance) and 1 (chrominance).  Returns FALSE, leaving the tables
+ * untouched, if the library does not apply to the image: it only covers 8-bit
+ * YCbCr and grayscale images that use the usual table assignments, at
+ * qualities below about 85.
+ */
+
+GLOBAL(boolean)
+jpeg_set_trained_huff_tables (j_compress_ptr cinfo)
+{
+  jpeg_component_info *compptr;
+  JQUANT_TBL *qtbl;
+  long qsum;
+  int ci, i, qclass, subsampled;
+
+  if (cinfo->data_precision != 8)
+    return FALSE;
+  if (! (cinfo->jpeg_color_space == JCS_YCbCr && cinfo->num_components == 3) &&
+      ! (cinfo->jpeg_color_space == JCS_GRAYSCALE &&
+         cinfo->num_components == 1))
+    return FALSE;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (compptr->dc_tbl_no != (ci > 0) || compptr->ac_tbl_no != (ci > 0))
+      return FALSE;
+  }
+
+  qtbl = cinfo->quant_tbl_ptrs[cinfo->comp_info[0].quant_tbl_no];
+  if (qtbl == NULL)
+    return FALSE;               /* jcmaster.c will complain later */
+  qsum = 0;
+  for (i = 0; i < DCTSIZE2; i++)
+    qsum += qtbl->quantval[i];
+  if (qsum < quality_class_limit[0])
+    return FALSE;
+  for (qclass = 0; qclass < NUM_QUALITY_CLASSES - 1; qclass++) {
+    if (qsum < quality_class_limit[qclass + 1])
+      break;
+  }
+
+  set_trained_table(cinfo, &cinfo->dc_huff_tbl_ptrs[0],
+                    &luma_dc_tables[qclass]);
+  set_trained_table(cinfo, &cinfo->ac_huff_tbl_ptrs[0],
+                    &luma_ac_tables[qclass]);
+
+  if (cinfo->num_components > 1) {
+    subsampled = FALSE;
+    for (ci = 1; ci < cinfo->num_components; ci++) {
+      compptr = &cinfo->comp_info[ci];
+      if (compptr->h_samp_factor < cinfo->comp_info[0].h_samp_factor ||
+          compptr->v_samp_factor < cinfo->comp_info[0].v_samp_factor)
+        subsampled = TRUE;
+    }
+    set_trained_table(cinfo, &cinfo->dc_huff_tbl_ptrs[1],
+                      &chroma_dc_tables[subsampled][qclass]);
+    set_trained_table(cinfo, &cinfo->ac_huff_tbl_ptrs[1],
+                      &chroma_ac_tables[subsampled][qclass]);
+  }
+
+  return TRUE;
+}
@@ -23,6 +23,8 @@
 #include "jconfigint.h"
 #include "jmemsys.h"
 #include "jcmaster.h"
+#include "jthread.h"
+#include <setjmp.h>
 
 
   /*
@@ -487,6 +489,7 @@ prepare_for_pass (j_compress_ptr cinfo)
     } else {
       /* Will write frame/scan headers at first jpeg_write_scanlines call */
       master->pub.call_pass_startup = TRUE;
+      master->first_scan_written = TRUE;
     }
     break;
 #ifdef ENTROPY_OPT_SUPPORTED
@@ -516,9 +519,7 @@ prepare_for_pass (j_compress_ptr cinfo)
     }
     if (cinfo->master->optimize_scans) {
       master->saved_dest = cinfo->dest;
-      cinfo->dest = NULL;
-      master->scan_size[master->scan_number] = 0;
-      jpeg_mem_dest(cinfo, &master->scan_buffer[master->scan_number], &master->scan_size[master->scan_number]);
+      cinfo->dest = &master->scan_dest;
       (*cinfo->dest->init_destination)(cinfo);
     }
     (*cinfo->entropy->start_pass) (cinfo, FALSE);
@@ -581,24 +582,18 @@ pass_startup (j_compress_ptr cinfo)
 }
 
 
+LOCAL(void) encode_selected_scan (j_compress_ptr cinfo, int scan_idx);
+
+
 LOCAL(void)
-copy_buffer (j_compress_ptr cinfo, int scan_idx)
+write_buffer (j_compress_ptr cinfo, const unsigned char * src,
+              unsigned long size)
 {
-  my_master_ptr master = (my_master_ptr) cinfo->master;
-  
-  unsigned long size = master->scan_size[scan_idx];
-  unsigned char * src = master->scan_buffer[scan_idx];
-  int i;
-  
-  if (cinfo->err->trace_level > 0) {
-    fprintf(stderr, "SCAN ");
-    for (i = 0; i < cinfo->scan_info[scan_idx].comps_in_scan; i++)
-      fprintf(stderr, "%s%d", (i==0)?"":",", cinfo->scan_info[scan_idx].component_index[i]);
-    fprintf(stderr, ": %d %d", cinfo->scan_info[scan_idx].Ss, cinfo->scan_info[scan_idx].Se);
-    fprintf(stderr, " %d %d", cinfo->scan_info[scan_idx].Ah, master->actual_Al[scan_idx]);
-    fprintf(stderr, "\n");
-  }
-  
+  /* Hand large blocks directly to destinations that can take them. */
+  if (size > cinfo->dest->free_in_buffer &&
+      jpeg_write_direct(cinfo, src, (size_t) size))
+    return;
+
   while (size >= cinfo->dest->free_in_buffer)
   {
     MEMCOPY(cinfo->dest->next_output_byte, src, cinfo->dest->free_in_buffer);
@@ -616,6 +611,379 @@ copy_buffer (j_compress_ptr cinfo, int scan_idx)
   cinfo->dest->free_in_buffer -= size;
 }
 
+LOCAL(void)
+copy_buffer (j_compress_ptr cinfo, int scan_idx)
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int i;
+  
+  if (cinfo->err->trace_level > 0) {
+    fprintf(stderr, "SCAN ");
+    for (i = 0; i < cinfo->scan_info[scan_idx].comps_in_scan; i++)
+      fprintf(stderr, "%s%d", (i==0)?"":",", cinfo->scan_info[scan_idx].component_index[i]);
+    fprintf(stderr, ": %d %d", cinfo->scan_info[scan_idx].Ss, cinfo->scan_info[scan_idx].Se);
+    fprintf(stderr, " %d %d", cinfo->scan_info[scan_idx].Ah, master->actual_Al[scan_idx]);
+    fprintf(stderr, "\n");
+  }
+  
+  /* Without Huffman optimization or trellis quantization (arithmetic coding),
+   * the first scan was written by the main pass.
+   */
+  if (scan_idx == 0 && master->first_scan_written)
+    return;
+
+  if (! master->scan_in_arena[scan_idx]) {
+    encode_selected_scan(cinfo, scan_idx);
+    return;
+  }
+  write_buffer(cinfo, master->scan_arena + master->scan_offset[scan_idx],
+               master->scan_size[scan_idx]);
+  master->scan_in_arena[scan_idx] = FALSE;
+}
+
+
+/*
+ * Candidate scan buffering.
+ * The scans produced by the scan search are appended to a single growable
+ * buffer (the arena), through a destination manager that writes directly
+ * into it.  Whenever select_scans() has decided against some candidates,
+ * release_scans() reclaims their space, so that the following candidates
+ * reuse it.  The scans are appended in order of scan number, which
+ * release_scans() relies upon.
+ *
+ * If JINT_SCAN_BUFFER_LIMIT is set and the arena reaches that size, the
+ * scans that are still candidates are dropped from it (see spill_scans()),
+ * keeping only their sizes, which is all that select_scans() needs.  A scan
+ * that does not fit within the limit on its own is only measured as it is
+ * written (see discard_scan_data()).  The scans that end up being selected
+ * without being in the arena are encoded again from the coefficient buffer,
+ * directly to the output, so the arena never grows beyond the limit.
+ */
+
+#define SCAN_ARENA_INIT_SIZE  65536 /* initial size of the arena */
+
+LOCAL(boolean)
+spill_scans (j_compress_ptr cinfo)
+/* Drop the buffered scans other than the one being written, which is at the
+ * end of the (full) arena.  Returns TRUE if this made room for more data.
+ */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int current = master->scan_number;
+  size_t start = master->scan_offset[current];
+  size_t count = master->scan_arena_size - start;
+  int i;
+
+  if (start == 0)
+    return FALSE;
+
+  /* The first scan is never among these, since it is written to the output
+   * as soon as it is complete.
+   */
+  for (i = 0; i < cinfo->num_scans; i++) {
+    if (i != current)
+      master->scan_in_arena[i] = FALSE;
+  }
+  MEMMOVE(master->scan_arena, master->scan_arena + start, count);
+  master->scan_offset[current] = 0;
+  master->scan_arena_used = 0;
+  master->scan_dest.next_output_byte = master->scan_arena + count;
+  master->scan_dest.free_in_buffer = master->scan_arena_size - count;
+  return TRUE;
+}
+
+
+LOCAL(void)
+discard_scan_data (j_compress_ptr cinfo)
+/* Throw away the data of the scan being written, which fills the arena on
+ * its own, counting it in scan_discarded so that the size of the scan is
+ * still known when it is complete.
+ */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+
+  master->scan_discarded += master->scan_arena_size;
+  master->scan_dest.next_output_byte = master->scan_arena;
+  master->scan_dest.free_in_buffer = master->scan_arena_size;
+}
+
+
+LOCAL(void)
+grow_scan_arena (j_compress_ptr cinfo)
+/* Make room in the arena, which is full */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  size_t limit = (size_t) cinfo->master->scan_buffer_limit * 1024;
+  size_t size = master->scan_arena_size ?
+                master->scan_arena_size * 2 : SCAN_ARENA_INIT_SIZE;
+  JOCTET *arena;
+  int size_kb;
+
+  /* With a size limit, the arena grows up to the limit.  Beyond that, we
+   * drop the scans that it holds, and then the data of the scan being
+   * written if it does not fit on its own.
+   */
+  if (limit > 0) {
+    if (master->scan_arena_size >= limit) {
+      if (! spill_scans(cinfo))
+        discard_scan_data(cinfo);
+      return;
+    }
+    if (size > limit)
+      size = limit;
+  }
+
+  arena = (JOCTET *) realloc(master->scan_arena, size);
+  if (arena == NULL)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+
+  master->scan_dest.next_output_byte = arena + master->scan_arena_size;
+  master->scan_dest.free_in_buffer = size - master->scan_arena_size;
+  master->scan_arena = arena;
+  master->scan_arena_size = size;
+
+  size_kb = (int) ((size + 1023) / 1024);
+  if (size_kb > cinfo->master->scan_buffer_peak)
+    cinfo->master->scan_buffer_peak = size_kb;
+}
+
+
+METHODDEF(void)
+init_scan_destination (j_compress_ptr cinfo)
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+
+  master->scan_offset[master->scan_number] = master->scan_arena_used;
+  master->scan_dest.next_output_byte =
+    master->scan_arena + master->scan_arena_used;
+  master->scan_dest.free_in_buffer =
+    master->scan_arena_size - master->scan_arena_used;
+  if (master->scan_dest.free_in_buffer == 0)
+    grow_scan_arena(cinfo);
+}
+
+
+METHODDEF(boolean)
+empty_scan_buffer (j_compress_ptr cinfo)
+{
+  grow_scan_arena(cinfo);
+  return TRUE;
+}
+
+
+METHODDEF(void)
+term_scan_destination (j_compress_ptr cinfo)
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int scan_number = master->scan_number;
+
+  master->scan_arena_used =
+    master->scan_dest.next_output_byte - master->scan_arena;
+  master->scan_size[scan_number] =
+    (unsigned long) (master->scan_discarded + master->scan_arena_used -
+                     master->scan_offset[scan_number]);
+  master->scan_in_arena[scan_number] = (master->scan_discarded == 0);
+  if (master->scan_discarded) {
+    /* The scan will have to be encoded again if it is selected. */
+    master->scan_arena_used = master->scan_offset[scan_number];
+    master->scan_discarded = 0;
+  }
+}
+
+
+LOCAL(boolean)
+scan_may_be_selected (j_compress_ptr cinfo, int scan_idx,
+                      int next_scan_number)
+/* Determine whether scan_idx may still be written to the output, given the
+ * decisions that select_scans() has made up to next_scan_number
+ */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int luma_freq_split_scan_start = cinfo->master->num_scans_luma_dc +
+                                   3 * cinfo->master->Al_max_luma + 2;
+  int chroma_dc_scan_start = cinfo->master->num_scans_luma;
+  int chroma_Al_scan_start = chroma_dc_scan_start +
+                             cinfo->master->num_scans_chroma_dc;
+  int chroma_freq_split_scan_start = chroma_Al_scan_start +
+                                     (6 * cinfo->master->Al_max_chroma + 4);
+  int i, decision;
+
+  if (scan_idx == 0)
+    return TRUE;
+
+  if (scan_idx < luma_freq_split_scan_start) {
+    i = (scan_idx - 1) / 3;
+    if ((scan_idx - 1) % 3 == 2)
+      /* LSB refinement, kept if Al = i + 1 or more is selected */
+      return next_scan_number < scan_idx + 3 || i < master->best_Al_luma;
+    /* successive approximation candidate for Al = i, only measured */
+    return next_scan_number < 3 * i + 3;
+  }
+
+  if (scan_idx < cinfo->master->num_scans_luma) {
+    i = (scan_idx - luma_freq_split_scan_start + 1) >> 1;
+    decision = luma_freq_split_scan_start + 2 * i + 1;
+    return next_scan_number < decision ||
+           i == master->best_freq_split_idx_luma;
+  }
+
+  if (scan_idx < chroma_Al_scan_start) {
+    if (cinfo->master->dc_scan_opt_mode == 0)
+      return FALSE;
+    if (next_scan_number < chroma_Al_scan_start)
+      return TRUE;
+    return (scan_idx == chroma_dc_scan_start) ==
+           (master->interleave_chroma_dc &&
+            cinfo->master->dc_scan_opt_mode != 1);
+  }
+
+  if (scan_idx < chroma_freq_split_scan_start) {
+    i = (scan_idx - chroma_Al_scan_start) / 6;
+    if ((scan_idx - chroma_Al_scan_start) % 6 >= 4)
+      /* LSB refinement, kept if Al = i + 1 or more is selected */
+      return next_scan_number < chroma_Al_scan_start + 6 * i + 10 ||
+             i < master->best_Al_chroma;
+    return next_scan_number < chroma_Al_scan_start + 6 * i + 4;
+  }
+
+  i = (scan_idx - chroma_freq_split_scan_start + 2) >> 2;
+  decision = chroma_freq_split_scan_start + 4 * i + 2;
+  return next_scan_number < decision ||
+         i == master->best_freq_split_idx_chroma;
+}
+
+
+LOCAL(void)
+release_scans (j_compress_ptr cinfo, int next_scan_number)
+/* Reclaim the space of the candidates that can no longer be selected, moving
+ * the remaining ones down
+ */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  size_t used = 0;
+  int i;
+
+  for (i = 0; i < next_scan_number; i++) {
+    if (! master->scan_in_arena[i])
+      continue;
+    if (! scan_may_be_selected(cinfo, i, next_scan_number)) {
+      master->scan_in_arena[i] = FALSE;
+      continue;
+    }
+    if (master->scan_offset[i] != used) {
+      MEMMOVE(master->scan_arena + used,
+              master->scan_arena + master->scan_offset[i],
+              master->scan_size[i]);
+      master->scan_offset[i] = used;
+    }
+    used += master->scan_size[i];
+  }
+  master->scan_arena_used = used;
+}
+
+/*
+ * Write the selected scans to the output as soon as the scans that precede
+ * them in the output are known, rather than at the end of the search, so
+ * that the output can be streamed.  The output order is: the luma DC scan,
+ * the chroma DC scan(s), the luma AC scans, the luma LSB refinements down to
+ * the lower of the two selected Al values, the chroma AC scans, the chroma
+ * LSB refinements down to the same Al, and then the remaining refinements
+ * for luma and chroma, interleaved.  output_stage counts the groups of scans
+ * that have been written.  Written scans are released from the arena.
+ */
+
+LOCAL(boolean)
+write_selected_scans (j_compress_ptr cinfo)
+/* Returns TRUE once all of the selected scans have been written */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int luma_freq_split_scan_start = cinfo->master->num_scans_luma_dc +
+                                   3 * cinfo->master->Al_max_luma + 2;
+  int chroma_dc_scan_start = cinfo->master->num_scans_luma;
+  int chroma_Al_scan_start = chroma_dc_scan_start +
+                             cinfo->master->num_scans_chroma_dc;
+  int chroma_freq_split_scan_start = chroma_Al_scan_start +
+                                     (6 * cinfo->master->Al_max_chroma + 4);
+  boolean have_chroma = cinfo->num_scans > cinfo->master->num_scans_luma;
+  /* # of scans that were either encoded or skipped by the search */
+  int num_searched = master->scan_number + 1;
+  int Al, min_Al;
+
+  switch (master->output_stage) {
+  case 0:
+    copy_buffer(cinfo, 0);
+    master->output_stage++;
+    /*FALLTHROUGH*/
+  case 1:
+    if (have_chroma && cinfo->master->dc_scan_opt_mode != 0) {
+      if (num_searched < chroma_Al_scan_start)
+        return FALSE;
+      if (master->interleave_chroma_dc && cinfo->master->dc_scan_opt_mode != 1)
+        copy_buffer(cinfo, chroma_dc_scan_start);
+      else {
+        copy_buffer(cinfo, chroma_dc_scan_start+1);
+        copy_buffer(cinfo, chroma_dc_scan_start+2);
+      }
+    }
+    master->output_stage++;
+    /*FALLTHROUGH*/
+  case 2:
+    if (num_searched < cinfo->master->num_scans_luma)
+      return FALSE;
+    if (master->best_freq_split_idx_luma == 0)
+      copy_buffer(cinfo, luma_freq_split_scan_start);
+    else {
+      copy_buffer(cinfo, luma_freq_split_scan_start+2*(master->best_freq_split_idx_luma-1)+1);
+      copy_buffer(cinfo, luma_freq_split_scan_start+2*(master->best_freq_split_idx_luma-1)+2);
+    }
+    master->output_stage++;
+    /*FALLTHROUGH*/
+  case 3:
+    /* The LSB refinements that come next depend on the chroma Al */
+    if (have_chroma && num_searched < chroma_freq_split_scan_start)
+      return FALSE;
+    min_Al = MIN(master->best_Al_luma, master->best_Al_chroma);
+    for (Al = master->best_Al_luma-1; Al >= min_Al; Al--)
+      copy_buffer(cinfo, 3 + 3*Al);
+    master->output_stage++;
+    /*FALLTHROUGH*/
+  case 4:
+    if (num_searched < cinfo->num_scans)
+      return FALSE;
+    min_Al = MIN(master->best_Al_luma, master->best_Al_chroma);
+    if (have_chroma) {
+      if (master->best_freq_split_idx_chroma == 0) {
+        copy_buffer(cinfo, chroma_freq_split_scan_start);
+        copy_buffer(cinfo, chroma_freq_split_scan_start+1);
+      }
+      else {
+        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+2);
+        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+3);
+        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+4);
+        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+5);
+      }
+
+      for (Al = master->best_Al_chroma-1; Al >= min_Al; Al--) {
+        copy_buffer(cinfo, chroma_Al_scan_start + 6*Al + 4);
+        copy_buffer(cinfo, chroma_Al_scan_start + 6*Al + 5);
+      }
+    }
+
+    for (Al = min_Al-1; Al >= 0; Al--) {
+      copy_buffer(cinfo, 3 + 3*Al);
+
+      if (have_chroma) {
+        copy_buffer(cinfo, chroma_Al_scan_start + 6*Al + 4);
+        copy_buffer(cinfo, chroma_Al_scan_start + 6*Al + 5);
+      }
+    }
+    master->output_stage++;
+  }
+
+  return TRUE;
+}
+
+
 LOCAL(void)
 select_scans (j_compress_ptr cinfo, int next_scan_number)
 {
@@ -741,72 +1109,502 @@ select_scans (j_compress_ptr cinfo, int next_scan_number)
     }
   }
   
-  if (master->scan_number == cinfo->num_scans - 1) {
-    int i, Al;
-    int min_Al = MIN(master->best_Al_luma, master->best_Al_chroma);
-    
-    copy_buffer(cinfo, 0);
+  if (write_selected_scans(cinfo)) {
+    /* free the memory allocated for buffers */
+    free(master->scan_arena);
+    master->scan_arena = NULL;
+    master->scan_arena_size = master->scan_arena_used = 0;
+  } else
+    release_scans(cinfo, next_scan_number);
+}
 
-    if (cinfo->num_scans > cinfo->master->num_scans_luma &&
-        cinfo->master->dc_scan_opt_mode != 0) {
-      base_scan_idx = cinfo->master->num_scans_luma;
-      
-      if (master->interleave_chroma_dc && cinfo->master->dc_scan_opt_mode != 1)
-        copy_buffer(cinfo, base_scan_idx);
-      else {
-        copy_buffer(cinfo, base_scan_idx+1);
-        copy_buffer(cinfo, base_scan_idx+2);
-      }
+/*
+ * Parallel scan search.
+ *
+ * The candidate scans of the scan search script only read the finished
+ * coefficient buffer, so with more than one thread we encode their Huffman
+ * optimization and output passes concurrently, each worker using a private
+ * copy of the compression object with its own memory manager, entropy
+ * encoder, coefficient controller, Huffman tables and destination.  The
+ * marker segments that precede each scan depend on the scans written before
+ * it (DHT and DRI are only emitted when they change), so the main thread
+ * then walks through the scans exactly as the sequential passes would,
+ * writing the headers followed by the precomputed data, and lets
+ * select_scans() make the same decisions from the same scan sizes.  The
+ * output is therefore identical to that of the sequential search; the only
+ * extra work is for candidates that the sequential search would skip.
+ *
+ * The frequency split candidates are coded with the best Al found by the
+ * successive approximation candidates before them, so they are encoded in
+ * two later rounds, once the walk has selected Al for luma and for chroma.
+ */
+
+typedef struct {
+  struct jpeg_compress_struct cinfo; /* worker's copy of the compressor */
+  my_comp_master master;        /* worker's copy of the master state */
+  struct jpeg_error_mgr err;    /* worker's error handler */
+  jmp_buf setjmp_buffer;        /* for returning to the task on error */
+  boolean failed;               /* TRUE=an error occurred in this worker */
+} scan_worker;
+
+typedef struct {
+  scan_worker *workers;
+  scan_result *results;
+  int scans[64];                /* scan numbers to encode */
+} scan_job;
+
+
+METHODDEF(void)
+scan_worker_error_exit (j_common_ptr cinfo)
+{
+  scan_worker *worker = (scan_worker *) cinfo->client_data;
+
+  longjmp(worker->setjmp_buffer, 1);
+}
+
+
+LOCAL(void)
+encode_scan_pass (j_compress_ptr cinfo, boolean gather_statistics)
+/* Run a Huffman optimization or output pass for the current scan */
+{
+  JDIMENSION iMCU_row;
+
+  (*cinfo->entropy->start_pass) (cinfo, gather_statistics);
+  (*cinfo->coef->start_pass) (cinfo, JBUF_CRANK_DEST);
+  for (iMCU_row = 0; iMCU_row < cinfo->total_iMCU_rows; iMCU_row++)
+    (*cinfo->coef->compress_data) (cinfo, (JSAMPIMAGE) NULL);
+  (*cinfo->entropy->finish_pass) (cinfo);
+}
+
+
+LOCAL(void)
+encode_candidate_scan (j_compress_ptr cinfo, int scan_number,
+                       scan_result *result)
+/* Encode a candidate scan using a worker's copy of the compressor */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  JHUFF_TBL *htbl;
+  int i;
+
+  master->scan_number = scan_number;
+  select_scan_parameters(cinfo);
+  per_scan_setup(cinfo);
+
+  /* The entropy encoder looks at the destination even when gathering
+   * statistics, so set it up first.
+   */
+  result->data = NULL;
+  result->size = 0;
+  jpeg_mem_dest(cinfo, &result->data, &result->size);
+  (*cinfo->dest->init_destination) (cinfo);
+
+  MEMZERO(result->new_dc_tbl, sizeof(result->new_dc_tbl));
+  MEMZERO(result->new_ac_tbl, sizeof(result->new_ac_tbl));
+  if (cinfo->optimize_coding &&
+      (cinfo->Ss != 0 || cinfo->Ah == 0 || cinfo->arith_code)) {
+    /* Huffman optimization pass (see prepare_for_pass().)  The tables that
+     * it generates are the ones left with sent_table = FALSE.
+     */
+    for (i = 0; i < NUM_HUFF_TBLS; i++) {
+      if (cinfo->dc_huff_tbl_ptrs[i] != NULL)
+        cinfo->dc_huff_tbl_ptrs[i]->sent_table = TRUE;
+      if (cinfo->ac_huff_tbl_ptrs[i] != NULL)
+        cinfo->ac_huff_tbl_ptrs[i]->sent_table = TRUE;
     }
-    
-    if (master->best_freq_split_idx_luma == 0)
-      copy_buffer(cinfo, luma_freq_split_scan_start);
-    else {
-      copy_buffer(cinfo, luma_freq_split_scan_start+2*(master->best_freq_split_idx_luma-1)+1);
-      copy_buffer(cinfo, luma_freq_split_scan_start+2*(master->best_freq_split_idx_luma-1)+2);
+    encode_scan_pass(cinfo, TRUE);
+    for (i = 0; i < NUM_HUFF_TBLS; i++) {
+      htbl = cinfo->dc_huff_tbl_ptrs[i];
+      if (htbl != NULL && !htbl->sent_table) {
+        result->new_dc_tbl[i] = TRUE;
+        MEMCOPY(&result->dc_tbl[i], htbl, sizeof(JHUFF_TBL));
+      }
+      htbl = cinfo->ac_huff_tbl_ptrs[i];
+      if (htbl != NULL && !htbl->sent_table) {
+        result->new_ac_tbl[i] = TRUE;
+        MEMCOPY(&result->ac_tbl[i], htbl, sizeof(JHUFF_TBL));
+      }
     }
-    
-    /* copy the LSB refinements as well */
-    for (Al = master->best_Al_luma-1; Al >= min_Al; Al--)
-      copy_buffer(cinfo, 3 + 3*Al);
+  }
 
-    if (cinfo->num_scans > cinfo->master->num_scans_luma) {
-      if (master->best_freq_split_idx_chroma == 0) {
-        copy_buffer(cinfo, chroma_freq_split_scan_start);
-        copy_buffer(cinfo, chroma_freq_split_scan_start+1);
-      }
-      else {
-        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+2);
-        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+3);
-        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+4);
-        copy_buffer(cinfo, chroma_freq_split_scan_start+4*(master->best_freq_split_idx_chroma-1)+5);
+  /* Output pass */
+  encode_scan_pass(cinfo, FALSE);
+  (*cinfo->dest->term_destination) (cinfo);
+}
+
+
+METHODDEF(void)
+scan_task (void *arg, int task, int worker_num)
+{
+  scan_job *job = (scan_job *) arg;
+  scan_worker *worker = &job->workers[worker_num];
+  int scan_number = job->scans[task];
+
+  /* Errors are caught here, on the worker's own thread, and reported by
+   * encode_candidate_scans() once all of the tasks have completed.
+   */
+  if (worker->failed)
+    return;
+  if (setjmp(worker->setjmp_buffer)) {
+    worker->failed = TRUE;
+    return;
+  }
+  encode_candidate_scan(&worker->cinfo, scan_number,
+                        &job->results[scan_number]);
+}
+
+
+LOCAL(void)
+start_scan_workers (j_compress_ptr cinfo, scan_worker *workers)
+/* Set up each worker's private copy of the compressor */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  j_compress_ptr wcinfo;
+  int w, i;
+
+  for (w = 0; w < cinfo->master->num_threads; w++) {
+    wcinfo = &workers[w].cinfo;
+    MEMCOPY(wcinfo, cinfo, sizeof(struct jpeg_compress_struct));
+    MEMCOPY(&workers[w].master, master, sizeof(my_comp_master));
+    wcinfo->master = (struct jpeg_comp_master *) &workers[w].master;
+    wcinfo->progress = NULL;
+    wcinfo->dest = NULL;
+    workers[w].failed = FALSE;
+
+    /* Errors during setup are reported through the caller's handler. */
+    wcinfo->mem = NULL;
+    jinit_memory_mgr((j_common_ptr) wcinfo);
+    /* per_scan_setup() modifies the component info */
+    wcinfo->comp_info = (jpeg_component_info *)
+      (*wcinfo->mem->alloc_small) ((j_common_ptr) wcinfo, JPOOL_IMAGE,
+                                   cinfo->num_components *
+                                   sizeof(jpeg_component_info));
+    MEMCOPY(wcinfo->comp_info, cinfo->comp_info,
+            cinfo->num_components * sizeof(jpeg_component_info));
+    for (i = 0; i < NUM_HUFF_TBLS; i++) {
+      if (cinfo->dc_huff_tbl_ptrs[i] != NULL) {
+        wcinfo->dc_huff_tbl_ptrs[i] = jpeg_alloc_huff_table((j_common_ptr) wcinfo);
+        MEMCOPY(wcinfo->dc_huff_tbl_ptrs[i], cinfo->dc_huff_tbl_ptrs[i],
+                sizeof(JHUFF_TBL));
       }
-      
-      base_scan_idx = cinfo->master->num_scans_luma +
-                      cinfo->master->num_scans_chroma_dc;
-      
-      for (Al = master->best_Al_chroma-1; Al >= min_Al; Al--) {
-        copy_buffer(cinfo, base_scan_idx + 6*Al + 4);
-        copy_buffer(cinfo, base_scan_idx + 6*Al + 5);
+      if (cinfo->ac_huff_tbl_ptrs[i] != NULL) {
+        wcinfo->ac_huff_tbl_ptrs[i] = jpeg_alloc_huff_table((j_common_ptr) wcinfo);
+        MEMCOPY(wcinfo->ac_huff_tbl_ptrs[i], cinfo->ac_huff_tbl_ptrs[i],
+                sizeof(JHUFF_TBL));
       }
     }
-    
-    for (Al = min_Al-1; Al >= 0; Al--) {
-      copy_buffer(cinfo, 3 + 3*Al);
-      
-      if (cinfo->num_scans > cinfo->master->num_scans_luma) {
-        copy_buffer(cinfo, base_scan_idx + 6*Al + 4);
-        copy_buffer(cinfo, base_scan_idx + 6*Al + 5);
-      }
+    if (cinfo->arith_code) {
+#ifdef C_ARITH_CODING_SUPPORTED
+      jinit_arith_encoder(wcinfo);
+#endif
+    } else if (cinfo->progressive_mode) {
+#ifdef C_PROGRESSIVE_SUPPORTED
+      jinit_phuff_encoder(wcinfo);
+#endif
+    } else
+      jinit_huff_encoder(wcinfo);
+    jinit_c_coef_controller_shared(wcinfo, cinfo);
+
+    wcinfo->err = jpeg_std_error(&workers[w].err);
+    workers[w].err.error_exit = scan_worker_error_exit;
+    wcinfo->client_data = (void *) &workers[w];
+  }
+}
+
+
+LOCAL(void)
+finish_scan_search (j_compress_ptr cinfo, scan_worker *workers)
+/* Release the workers and any candidate scans that were not written */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int w, i;
+
+  for (w = 0; w < cinfo->master->num_threads; w++) {
+    if (workers[w].cinfo.mem != NULL)
+      jpeg_destroy((j_common_ptr) &workers[w].cinfo);
+  }
+  for (i = 0; i < cinfo->num_scans; i++) {
+    if (master->scan_results[i].data != NULL) {
+      free(master->scan_results[i].data);
+      master->scan_results[i].data = NULL;
+    }
+  }
+}
+
+
+LOCAL(void)
+encode_candidate_scans (j_compress_ptr cinfo, scan_worker *workers,
+                        int first_scan, int end_scan, const boolean *skip)
+/* Encode scans first_scan .. end_scan-1, other than those flagged in skip,
+ * in parallel
+ */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  scan_job job;
+  int num_tasks = 0;
+  int w, i;
+
+  for (i = first_scan; i < end_scan; i++) {
+    if (skip == NULL || !skip[i])
+      job.scans[num_tasks++] = i;
+  }
+  job.workers = workers;
+  job.results = master->scan_results;
+
+  /* The frequency split candidates depend on the Al selected so far. */
+  for (w = 0; w < cinfo->master->num_threads; w++) {
+    workers[w].master.best_Al_luma = master->best_Al_luma;
+    workers[w].master.best_Al_chroma = master->best_Al_chroma;
+  }
+
+  jthread_run_tasks(cinfo->master->num_threads, num_tasks, scan_task, &job);
+
+  for (w = 0; w < cinfo->master->num_threads; w++) {
+    if (workers[w].failed) {
+      cinfo->err->msg_code = workers[w].err.msg_code;
+      MEMCOPY(&cinfo->err->msg_parm, &workers[w].err.msg_parm,
+              sizeof(cinfo->err->msg_parm));
+      finish_scan_search(cinfo, workers);
+      (*cinfo->err->error_exit) ((j_common_ptr) cinfo);
+    }
+  }
+}
+
+
+LOCAL(void)
+write_candidate_scan (j_compress_ptr cinfo, scan_result *result)
+/* Do what the output pass for the current scan would do, using the data
+ * encoded ahead of time
+ */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int i;
+
+  select_scan_parameters(cinfo);
+  per_scan_setup(cinfo);
+
+  for (i = 0; i < NUM_HUFF_TBLS; i++) {
+    if (result->new_dc_tbl[i]) {
+      if (cinfo->dc_huff_tbl_ptrs[i] == NULL)
+        cinfo->dc_huff_tbl_ptrs[i] = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+      MEMCOPY(cinfo->dc_huff_tbl_ptrs[i], &result->dc_tbl[i],
+              sizeof(JHUFF_TBL));
+    }
+    if (result->new_ac_tbl[i]) {
+      if (cinfo->ac_huff_tbl_ptrs[i] == NULL)
+        cinfo->ac_huff_tbl_ptrs[i] = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+      MEMCOPY(cinfo->ac_huff_tbl_ptrs[i], &result->ac_tbl[i],
+              sizeof(JHUFF_TBL));
     }
-    
-    /* free the memory allocated for buffers */
-    for (i = 0; i < cinfo->num_scans; i++)
-      if (master->scan_buffer[i])
-        free(master->scan_buffer[i]);
   }
+
+  master->saved_dest = cinfo->dest;
+  cinfo->dest = &master->scan_dest;
+  (*cinfo->dest->init_destination) (cinfo);
+  if (master->scan_number == 0)
+    (*cinfo->marker->write_frame_header) (cinfo);
+  (*cinfo->marker->write_scan_header) (cinfo);
+  write_buffer(cinfo, result->data, result->size);
+  (*cinfo->dest->term_destination) (cinfo);
+  cinfo->dest = master->saved_dest;
+
+  free(result->data);
+  result->data = NULL;
 }
 
+
+LOCAL(void)
+search_scans_parallel (j_compress_ptr cinfo)
+/* Run the whole scan search, and write the selected scans */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int luma_freq_split_scan_start = cinfo->master->num_scans_luma_dc +
+                                   3 * cinfo->master->Al_max_luma + 2;
+  int chroma_freq_split_scan_start = cinfo->master->num_scans_luma +
+                                     cinfo->master->num_scans_chroma_dc +
+                                     (6 * cinfo->master->Al_max_chroma + 4);
+  boolean freq_split[64];
+  scan_worker *workers;
+  int i;
+
+  workers = (scan_worker *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                cinfo->master->num_threads *
+                                sizeof(scan_worker));
+  master->scan_results = (scan_result *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                cinfo->num_scans * sizeof(scan_result));
+  for (i = 0; i < cinfo->num_scans; i++) {
+    master->scan_results[i].data = NULL;
+    freq_split[i] = (i >= luma_freq_split_scan_start &&
+                     i < cinfo->master->num_scans_luma) ||
+                    (cinfo->num_scans > cinfo->master->num_scans_luma &&
+                     i >= chroma_freq_split_scan_start);
+  }
+  for (i = 0; i < cinfo->master->num_threads; i++)
+    workers[i].cinfo.mem = NULL;
+  cinfo->master->trellis_passes = FALSE;
+  start_scan_workers(cinfo, workers);
+
+  encode_candidate_scans(cinfo, workers, 0, cinfo->num_scans, freq_split);
+
+  master->scan_number = 0;
+  while (master->scan_number < cinfo->num_scans) {
+    if (master->scan_number == luma_freq_split_scan_start)
+      encode_candidate_scans(cinfo, workers, luma_freq_split_scan_start,
+                             cinfo->master->num_scans_luma, NULL);
+    else if (master->scan_number == chroma_freq_split_scan_start &&
+             cinfo->num_scans > cinfo->master->num_scans_luma)
+      encode_candidate_scans(cinfo, workers, chroma_freq_split_scan_start,
+                             cinfo->num_scans, NULL);
+
+    write_candidate_scan(cinfo, &master->scan_results[master->scan_number]);
+    select_scans(cinfo, master->scan_number + 1);
+    master->scan_number++;
+  }
+
+  finish_scan_search(cinfo, workers);
+
+  master->pass_number = master->total_passes - 1;
+  master->pub.is_last_pass = TRUE;
+}
+
+
+/*
+ * Scan size estimation.
+ * Deciding between the candidate scans only requires their sizes, and the
+ * Huffman optimization pass of a candidate already counts the symbols that
+ * its output pass would code.  With JINT_SCAN_SIZE_MODE = 1, we estimate the
+ * size of the scan from these counts and the code lengths of the optimal
+ * table generated from them (gather_bits), add the marker segments that would
+ * precede the scan, and skip the output pass.  select_scans() then makes its
+ * decisions from the estimates, and only the scans that it selects are
+ * encoded, when they are copied to the output.  The estimate ignores byte
+ * stuffing and the padding of the last byte of each entropy-coded segment,
+ * so a close decision may occasionally go the wrong way.
+ */
+
+LOCAL(unsigned long)
+estimate_scan_size (j_compress_ptr cinfo)
+{
+  boolean did_dc[NUM_HUFF_TBLS];
+  boolean did_ac[NUM_HUFF_TBLS];
+  jpeg_component_info *compptr;
+  JHUFF_TBL *htbl;
+  unsigned long size;
+  long num_MCUs;
+  int ci, i;
+
+  size = (unsigned long) ((cinfo->master->gather_bits + 7.0) / 8.0);
+
+  /* SOS marker segment */
+  size += 8 + 2 * cinfo->comps_in_scan;
+
+  /* One DHT marker segment for each table generated for this scan */
+  MEMZERO(did_dc, sizeof(did_dc));
+  MEMZERO(did_ac, sizeof(did_ac));
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    if (cinfo->Ss == 0 && cinfo->Ah == 0 && !did_dc[compptr->dc_tbl_no]) {
+      did_dc[compptr->dc_tbl_no] = TRUE;
+      htbl = cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no];
+      for (i = 1; i <= 16; i++)
+        size += htbl->bits[i];
+      size += 21;
+    }
+    if (cinfo->Se != 0 && !did_ac[compptr->ac_tbl_no]) {
+      did_ac[compptr->ac_tbl_no] = TRUE;
+      htbl = cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no];
+      for (i = 1; i <= 16; i++)
+        size += htbl->bits[i];
+      size += 21;
+    }
+  }
+
+  /* RSTn markers */
+  if (cinfo->restart_interval) {
+    num_MCUs = (long) cinfo->MCUs_per_row * (long) cinfo->MCU_rows_in_scan;
+    size += 2 * ((num_MCUs - 1) / cinfo->restart_interval);
+  }
+
+  return size;
+}
+
+
+LOCAL(void)
+encode_selected_scan (j_compress_ptr cinfo, int scan_idx)
+/* Encode a selected scan that is not in the arena directly to the output */
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int scan_number = master->scan_number;
+  int ci;
+
+  master->scan_number = scan_idx;
+  select_scan_parameters(cinfo);
+  per_scan_setup(cinfo);
+
+  if (cinfo->Ss != 0 || cinfo->Ah == 0)
+    encode_scan_pass(cinfo, TRUE);
+  if (scan_idx == 0) {
+    /* The frame header went the way of the rest of the first scan, but the
+     * quantization tables were marked as sent all the same.
+     */
+    for (ci = 0; ci < cinfo->num_components; ci++)
+      cinfo->quant_tbl_ptrs[cinfo->comp_info[ci].quant_tbl_no]->sent_table =
+        FALSE;
+    (*cinfo->marker->write_frame_header) (cinfo);
+  }
+  (*cinfo->marker->write_scan_header) (cinfo);
+  encode_scan_pass(cinfo, FALSE);
+
+  master->scan_number = scan_number;
+}
+
+
+/*
+ * Adaptive trellis loop termination.
+ * Each trellis loop consists of a statistics-gathering pass followed by a
+ * trellis pass for each frequency band (see select_scan_parameters()), and
+ * both kinds of pass leave the estimated size of the band in gather_bits.
+ * Thus the gathering passes of a loop measure the size before requantization
+ * and the trellis passes measure it afterwards.  Once a loop no longer
+ * reduces the size by at least trellis_loop_threshold (relative), further
+ * loops are unlikely to do better, so we skip the rest of the loops for the
+ * current component by advancing pass_number, much as select_scans() skips
+ * the scans it has no use for.
+ */
+
+LOCAL(void)
+update_trellis_loop (j_compress_ptr cinfo)
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int passes_per_loop = cinfo->master->use_scans_in_trellis ? 4 : 2;
+  int passes_per_comp = passes_per_loop * cinfo->master->trellis_num_loops;
+  int phase = master->pass_number % passes_per_loop;
+  int loop = (master->pass_number % passes_per_comp) / passes_per_loop;
+
+  if (phase == 0)
+    master->trellis_bits_before = cinfo->master->gather_bits;
+  else if (phase == 1)
+    master->trellis_bits_after = cinfo->master->gather_bits;
+  else if (phase == 2)
+    master->trellis_bits_before += cinfo->master->gather_bits;
+  else
+    master->trellis_bits_after += cinfo->master->gather_bits;
+
+  if (phase < passes_per_loop - 1)
+    return;
+
+  if (loop + 1 > cinfo->master->trellis_loops_used)
+    cinfo->master->trellis_loops_used = loop + 1;
+
+  if (loop + 1 < cinfo->master->trellis_num_loops &&
+      master->trellis_bits_before - master->trellis_bits_after <
+      cinfo->master->trellis_loop_threshold * master->trellis_bits_before)
+    master->pass_number += passes_per_comp - 1 -
+                           master->pass_number % passes_per_comp;
+}
+
+
 /*
  * Finish up at end of pass.
  */
@@ -838,6 +1636,16 @@ finish_pass_master (j_compress_ptr cinfo)
   case huff_opt_pass:
     /* next pass is always output of current scan */
     master->pass_type = (master->pass_number < master->pass_number_scan_opt_base-1) ? trellis_pass : output_pass;
+    if (master->estimate_scan_sizes && master->scan_number > 0 &&
+        master->pass_number >= master->pass_number_scan_opt_base) {
+      /* Skip the output pass (see estimate_scan_size()) */
+      master->scan_size[master->scan_number] = estimate_scan_size(cinfo);
+      master->pass_type = huff_opt_pass;
+      master->pass_number++;
+      select_scans(cinfo, master->scan_number + 1);
+      master->scan_number++;
+      master->pub.is_last_pass = (master->scan_number == cinfo->num_scans);
+    }
     break;
   case output_pass:
     /* next pass is either optimization or output of next scan */
@@ -877,7 +1685,16 @@ finish_pass_master (j_compress_ptr cinfo)
     break;
   }
 
+  if (master->trellis_adaptive &&
+      master->pass_number < master->pass_number_scan_opt_base)
+    update_trellis_loop(cinfo);
+
   master->pass_number++;
+
+  /* The coefficients are final once we get to the first scan. */
+  if (master->parallel_scan_search && master->scan_number == 0 &&
+      master->pass_number >= master->pass_number_scan_opt_base)
+    search_scans_parallel(cinfo);
 }
 
 
@@ -913,6 +1730,15 @@ jinit_c_master_control (j_compress_ptr cinfo, boolean transcode_only)
   if (cinfo->progressive_mode && !cinfo->arith_code)  /*  TEMPORARY HACK ??? */
     cinfo->optimize_coding = TRUE; /* assume default tables no good for progressive mode */
 
+  /* Pre-trained tables take the place of optimized ones for sequential
+   * Huffman coding, so that the image can be encoded in a single pass
+   * (unless trellis quantization or multiple scans still need the full-image
+   * buffer.)
+   */
+  if (cinfo->master->huff_table_library && !cinfo->progressive_mode &&
+      !cinfo->arith_code && jpeg_set_trained_huff_tables(cinfo))
+    cinfo->optimize_coding = FALSE;
+
   /* Initialize my private state */
   if (transcode_only) {
     /* no main pass in transcoding */
@@ -944,13 +1770,59 @@ jinit_c_master_control (j_compress_ptr cinfo, boolean transcode_only)
         ((cinfo->master->use_scans_in_trellis) ? 2 : 1) * cinfo->num_components *
         cinfo->master->trellis_num_loops + 1;
     master->total_passes += master->pass_number_scan_opt_base;
-}
+
+    /* Adaptive termination relies on the statistics gathered in every pass
+     * of a trellis loop, which we only have with Huffman optimization.  It
+     * is also incompatible with trellis_q_opt, which resets and updates the
+     * quantization tables at fixed pass numbers (see prepare_for_pass() and
+     * finish_pass_master()), so skipping loops would misalign them.
+     */
+    master->trellis_adaptive = cinfo->optimize_coding && !cinfo->arith_code &&
+      !cinfo->master->trellis_q_opt &&
+      cinfo->master->trellis_num_loops > 1 &&
+      cinfo->master->trellis_loop_threshold > 0.0;
+    cinfo->master->trellis_loops_used = master->trellis_adaptive ?
+      0 : cinfo->master->trellis_num_loops;
+  } else {
+    master->trellis_adaptive = FALSE;
+    cinfo->master->trellis_loops_used = 0;
+  }
   
   if (cinfo->master->optimize_scans) {
     int i;
     master->best_Al_chroma = 0;
     
     for (i = 0; i < cinfo->num_scans; i++)
-      master->scan_buffer[i] = NULL;
+      master->scan_in_arena[i] = FALSE;
+    master->first_scan_written = FALSE;
+    master->scan_arena = NULL;
+    master->scan_arena_size = master->scan_arena_used = 0;
+    master->scan_discarded = 0;
+    master->scan_dest.init_destination = init_scan_destination;
+    master->scan_dest.empty_output_buffer = empty_scan_buffer;
+    master->scan_dest.term_destination = term_scan_destination;
   }
+
+  cinfo->master->scan_buffer_peak = 0;
+  master->output_stage = 0;
+
+  master->estimate_scan_sizes =
+    cinfo->master->optimize_scans && cinfo->master->scan_size_mode == 1 &&
+    cinfo->scan_info != NULL && cinfo->master->num_scans_luma > 0 &&
+    cinfo->optimize_coding && !cinfo->arith_code;
+
+  /* The parallel scan search takes over once the first pass (and any trellis
+   * passes) have filled the coefficient buffer, so the first pass must not
+   * produce output.  Without thread support, it would only add work.
+   */
+#ifdef THREADS_SUPPORTED
+  master->parallel_scan_search =
+    cinfo->master->optimize_scans && cinfo->master->num_threads > 1 &&
+    !master->estimate_scan_sizes && cinfo->master->scan_buffer_limit == 0 &&
+    cinfo->scan_info != NULL && cinfo->master->num_scans_luma > 0 &&
+    !transcode_only &&
+    (cinfo->optimize_coding || cinfo->master->trellis_quant);
+#else
+  master->parallel_scan_search = FALSE;
+#endif
 }
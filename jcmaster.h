@@ -20,6 +20,20 @@ typedef enum {
         trellis_pass            /* trellis quantization pass */
 } c_pass_type;
 
+/* A candidate scan encoded ahead of time by the parallel scan search.
+ * This holds what the scan's Huffman optimization and output passes would
+ * have produced, apart from the marker segments that precede the scan.
+ */
+
+typedef struct {
+  unsigned char * data;         /* entropy-coded segment (malloc()ed) */
+  unsigned long size;           /* length of data */
+  boolean new_dc_tbl[NUM_HUFF_TBLS]; /* TRUE=optimized table was generated */
+  boolean new_ac_tbl[NUM_HUFF_TBLS];
+  JHUFF_TBL dc_tbl[NUM_HUFF_TBLS]; /* the generated tables */
+  JHUFF_TBL ac_tbl[NUM_HUFF_TBLS];
+} scan_result;
+
 typedef struct {
   struct jpeg_comp_master pub;  /* public fields */
 
@@ -32,8 +46,15 @@ typedef struct {
 
   /* fields for scan optimisation */
   int pass_number_scan_opt_base; /* pass number where scan optimization begins */
-  unsigned char * scan_buffer[64]; /* buffer for a given scan */
+  JOCTET * scan_arena; /* buffer holding the candidate scans (malloc()ed) */
+  size_t scan_arena_size; /* allocated size of scan_arena */
+  size_t scan_arena_used; /* # of bytes of scan_arena in use */
+  struct jpeg_destination_mgr scan_dest; /* destination writing to scan_arena */
+  size_t scan_offset[64]; /* offset of a given scan in scan_arena */
+  boolean scan_in_arena[64]; /* TRUE=data for a given scan is in scan_arena */
+  size_t scan_discarded; /* # of bytes of the current scan not kept in scan_arena */
   unsigned long scan_size[64]; /* size for a given scan */
+  int output_stage; /* # of groups of selected scans written to the output */
   int actual_Al[64]; /* actual value of Al used for a scan */
   unsigned long best_cost; /* bit count for best frequency split */
   int best_freq_split_idx_luma; /* index for best frequency split (luma) */
@@ -42,6 +63,15 @@ typedef struct {
   int best_Al_chroma; /* best value for Al found in scan search (luma) */
   boolean interleave_chroma_dc; /* indicate whether to interleave chroma DC scans */
   struct jpeg_destination_mgr * saved_dest; /* saved value of cinfo->dest */
+  boolean parallel_scan_search; /* TRUE=encode candidate scans in parallel */
+  scan_result * scan_results; /* candidate scans encoded in parallel */
+  boolean estimate_scan_sizes; /* TRUE=estimate candidate scan sizes */
+  boolean first_scan_written; /* TRUE=the main pass output scan 0 directly */
+
+  /* fields for adaptive trellis loop termination */
+  boolean trellis_adaptive; /* TRUE=stop trellis loops once they converge */
+  double trellis_bits_before; /* estimated size before the current loop */
+  double trellis_bits_after; /* estimated size after the current loop */
 
   /*
    * This is here so we can add libjpeg-turbo version/build information to the
@@ -488,6 +488,10 @@ jpeg_set_defaults (j_compress_ptr cinfo)
   jpeg_default_colorspace(cinfo);
   
   cinfo->master->dc_scan_opt_mode = 1;
+  cinfo->master->scan_size_mode = 0;
+  cinfo->master->scan_buffer_limit = 0;
+  cinfo->master->huff_table_mode = 0;
+  cinfo->master->huff_table_library = FALSE;
   
 #ifdef C_PROGRESSIVE_SUPPORTED
   if (cinfo->master->compress_profile == JCP_MAX_COMPRESSION) {
@@ -511,6 +515,8 @@ jpeg_set_defaults (j_compress_ptr cinfo)
   cinfo->master->trellis_q_opt = FALSE;
   cinfo->master->trellis_quant_dc = TRUE;
   cinfo->master->trellis_delta_dc_weight = 0.0;
+  cinfo->master->trellis_loop_threshold = 0.0;
+  cinfo->master->num_threads = 1;
 }
 
 
@@ -19,7 +19,8 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
-#include "jchuff.h"             /* Declarations shared with jchuff.c */
+#include "jsimd.h"              /* includes jchuff.h, with declarations
+                                   shared with jchuff.c */
 
 #ifdef C_PROGRESSIVE_SUPPORTED
 
@@ -49,6 +50,7 @@ typedef struct {
   unsigned int BE;              /* # of buffered correction bits before MCU */
   char *bit_buffer;             /* buffer for correction bits (1 per char) */
   /* packing correction bits tightly would save some space but cost time... */
+  long corr_bits;               /* # of correction bits seen when gathering */
 
   unsigned int restarts_to_go;  /* MCUs left in this restart interval */
   int next_restart_num;         /* next restart number to write (0-7) */
@@ -61,6 +63,22 @@ typedef struct {
 
   /* Statistics tables for optimization; again, one set is enough */
   long *count_ptrs[NUM_HUFF_TBLS];
+
+  /* Routines that examine a block's spectral band before it is encoded
+   * (C or SIMD implementations of the *_prepare() functions below).  Most
+   * passes of a progressive encode use the side information computed by the
+   * coefficient controller instead (see encode_mcu_AC_first_prepare_info()),
+   * so these only serve the passes without it: the statistics passes of
+   * trellis quantization, which see coefficients that are not final yet,
+   * transcoding (see jctrans.c), and scans with an Al beyond the range of
+   * the side information.
+   */
+  void (*AC_first_prepare) (const JCOEF *block,
+                            const int *jpeg_natural_order_start, int Sl,
+                            int Al, JCOEF *values, size_t *bits);
+  int (*AC_refine_prepare) (const JCOEF *block,
+                            const int *jpeg_natural_order_start, int Sl,
+                            int Al, JCOEF *absvalues, size_t *bits);
 } phuff_entropy_encoder;
 
 typedef phuff_entropy_encoder *phuff_entropy_ptr;
@@ -89,6 +107,40 @@ typedef phuff_entropy_encoder *phuff_entropy_ptr;
 #define IRIGHT_SHIFT(x,shft)    ((x) >> (shft))
 #endif
 
+/* Count the trailing zero bits of a nonzero bitmap word, and find the index
+ * of its most significant 1 bit.
+ */
+
+#if defined(__GNUC__)
+#define COUNT_TRAILING_ZEROS(x)  __builtin_ctzll((unsigned long long) (x))
+#define HIGHEST_BIT(x)  (63 - __builtin_clzll((unsigned long long) (x)))
+#else
+#define COUNT_TRAILING_ZEROS(x)  count_trailing_zeros(x)
+#define HIGHEST_BIT(x)  highest_bit(x)
+
+LOCAL(int)
+count_trailing_zeros (size_t x)
+{
+  int n = 0;
+
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
+
+LOCAL(int)
+highest_bit (size_t x)
+{
+  int n = 0;
+
+  while (x >>= 1)
+    n++;
+  return n;
+}
+#endif
+
 /* Forward declarations */
 METHODDEF(boolean) encode_mcu_DC_first (j_compress_ptr cinfo,
                                         JBLOCKROW *MCU_data);
@@ -190,6 +242,7 @@ start_pass_phuff (j_compress_ptr cinfo, boolean gather_statistics)
   /* Initialize AC stuff */
   entropy->EOBRUN = 0;
   entropy->BE = 0;
+  entropy->corr_bits = 0;
 
   /* Initialize bit buffer to empty */
   entropy->put_buffer = 0;
@@ -307,8 +360,10 @@ LOCAL(void)
 emit_buffered_bits (phuff_entropy_ptr entropy, char *bufstart,
                     unsigned int nbits)
 {
-  if (entropy->gather_statistics)
-    return;                     /* no real work */
+  if (entropy->gather_statistics) {
+    entropy->corr_bits += nbits; /* just count them */
+    return;
+  }
 
   while (nbits > 0) {
     emit_bits(entropy, (unsigned int) (*bufstart), 1);
@@ -465,6 +520,113 @@ encode_mcu_DC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Prepare a block for an AC initial scan: for each of the Sl coefficients of
+ * the spectral band, store the absolute value after the point transform by
+ * Al in values[] and the bits to be emitted for it (the value, or the
+ * complement of its magnitude if negative) in values[DCTSIZE2 ...], and set
+ * the bits of the coefficients that are nonzero after the point transform.
+ */
+
+LOCAL(void)
+encode_mcu_AC_first_prepare (const JCOEF *block,
+                             const int *jpeg_natural_order_start, int Sl,
+                             int Al, JCOEF *values, size_t *bits)
+{
+  register int temp, k;
+  int sign;
+
+  MEMZERO(bits, BITMAP_WORDS * sizeof(size_t));
+
+  for (k = 0; k < Sl; k++) {
+    temp = block[jpeg_natural_order_start[k]];
+
+    /* We must apply the point transform by Al.  For AC coefficients this
+     * is an integer division with rounding towards 0.  The code is
+     * interwoven with finding the abs value (temp) and output bits.
+     */
+#ifdef RIGHT_SHIFT_IS_UNSIGNED
+    sign = (temp < 0) ? ~0 : 0;
+#else
+    sign = temp >> (8*sizeof(temp)-1);
+#endif
+    temp += sign;
+    temp = (temp ^ sign) >> Al;
+    values[k] = (JCOEF) temp;
+    values[k + DCTSIZE2] = (JCOEF) (temp ^ sign);
+    if (temp)
+      bits[k / BITMAP_WORD_BITS] |= ((size_t) 1) << (k % BITMAP_WORD_BITS);
+  }
+}
+
+
+/*
+ * Extract the bitmap of the Sl coefficients of a spectral band starting with
+ * coefficient Ss from the bitmap of a block.
+ */
+
+LOCAL(void)
+extract_band (const size_t *block_bits, int Ss, int Sl, size_t *bits)
+{
+  int w, k, n, shift;
+
+  for (w = 0; w < BITMAP_WORDS; w++) {
+    k = Ss + w * BITMAP_WORD_BITS;      /* first coefficient of this word */
+    n = Sl - w * BITMAP_WORD_BITS;      /* # of coefficients left in band */
+    if (n <= 0) {
+      bits[w] = 0;
+      continue;
+    }
+    shift = k % BITMAP_WORD_BITS;
+    bits[w] = block_bits[k / BITMAP_WORD_BITS] >> shift;
+    if (shift != 0 && k / BITMAP_WORD_BITS + 1 < BITMAP_WORDS)
+      bits[w] |= block_bits[k / BITMAP_WORD_BITS + 1] <<
+                 (BITMAP_WORD_BITS - shift);
+    if (n < BITMAP_WORD_BITS)
+      bits[w] &= (((size_t) 1) << n) - 1;
+  }
+}
+
+
+/*
+ * Prepare a block for an AC initial scan using the side information computed
+ * by the coefficient controller (see jccoefct.c.)  The results are the same as
+ * those of encode_mcu_AC_first_prepare(), except that values[] is only filled
+ * in for the coefficients that are nonzero after the point transform, which
+ * are the only ones examined.  Requires Al <= BLOCK_INFO_MAX_AL.
+ */
+
+LOCAL(void)
+encode_mcu_AC_first_prepare_info (const JCOEF *block, const jblock_info *info,
+                                  int Ss, int Sl, int Al, JCOEF *values,
+                                  size_t *bits)
+{
+  register int temp, k;
+  int sign, w;
+  size_t bitmap;
+
+  extract_band(info->nonzero[Al], Ss, Sl, bits);
+
+  for (w = 0; w < BITMAP_WORDS; w++) {
+    bitmap = bits[w];
+    while (bitmap) {
+      k = w * BITMAP_WORD_BITS + COUNT_TRAILING_ZEROS(bitmap);
+      bitmap &= bitmap - 1;
+      temp = block[jpeg_natural_order[Ss + k]];
+#ifdef RIGHT_SHIFT_IS_UNSIGNED
+      sign = (temp < 0) ? ~0 : 0;
+#else
+      sign = temp >> (8*sizeof(temp)-1);
+#endif
+      temp += sign;
+      temp = (temp ^ sign) >> Al;
+      values[k] = (JCOEF) temp;
+      values[k + DCTSIZE2] = (JCOEF) (temp ^ sign);
+    }
+  }
+}
+
+
 /*
  * MCU encoding for AC initial scan (either spectral selection,
  * or first pass of successive approximation).
@@ -477,11 +639,10 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   register int temp, temp2;
   register int nbits;
   register int r, k;
-  int Se = cinfo->Se;
-  int Al = cinfo->Al;
-  JBLOCKROW block;
-  int deadzone = (1 << Al) - 1;
-  int sign;
+  int Sl = cinfo->Se - cinfo->Ss + 1;
+  int last, w;
+  JCOEF values[2 * DCTSIZE2];
+  size_t bits[BITMAP_WORDS], bitmap;
 
   entropy->next_output_byte = cinfo->dest->next_output_byte;
   entropy->free_in_buffer = cinfo->dest->free_in_buffer;
@@ -492,60 +653,58 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
       emit_restart(entropy, entropy->next_restart_num);
 
   /* Encode the MCU data block */
-  block = MCU_data[0];
+  if (cinfo->coef->MCU_info != NULL && cinfo->Al <= BLOCK_INFO_MAX_AL)
+    encode_mcu_AC_first_prepare_info(MCU_data[0][0], cinfo->coef->MCU_info[0],
+                                     cinfo->Ss, Sl, cinfo->Al, values, bits);
+  else
+    (*entropy->AC_first_prepare) (MCU_data[0][0],
+                                  jpeg_natural_order + cinfo->Ss, Sl,
+                                  cinfo->Al, values, bits);
 
-  /* Encode the AC coefficients per section G.1.2.2, fig. G.3 */
+  /* Encode the AC coefficients per section G.1.2.2, fig. G.3.  Only the
+   * nonzero coefficients are visited; the run length of zeros preceding
+   * each one follows from its position.
+   */
 
-  r = 0;                        /* r = run length of zeros */
+  last = -1;                    /* index of the last nonzero coefficient */
+
+  for (w = 0; w < BITMAP_WORDS; w++) {
+    bitmap = bits[w];
+    while (bitmap) {
+      k = w * BITMAP_WORD_BITS + COUNT_TRAILING_ZEROS(bitmap);
+      bitmap &= bitmap - 1;
+      r = k - last - 1;         /* r = run length of zeros */
+      last = k;
+      temp = values[k] & 0xFFFF; /* the magnitude may be 32768 */
+      temp2 = values[k + DCTSIZE2];
+
+      /* Emit any pending EOBRUN */
+      if (entropy->EOBRUN > 0)
+        emit_eobrun(entropy);
+      /* if run length > 15, must emit special run-length-16 codes (0xF0) */
+      while (r > 15) {
+        emit_symbol(entropy, entropy->ac_tbl_no, 0xF0);
+        r -= 16;
+      }
 
-  for (k = cinfo->Ss; k <= Se; k++) {
-    temp = (*block)[jpeg_natural_order[k]];
-    if ((unsigned)(temp + deadzone) <= 2*deadzone) {
-      r++;
-      continue;
-    }
+      /* Find the number of bits needed for the magnitude of the coefficient */
+      nbits = 1;                /* there must be at least one 1 bit */
+      while ((temp >>= 1))
+        nbits++;
+      /* Check for out-of-range coefficient values */
+      if (nbits > MAX_COEF_BITS)
+        ERREXIT(cinfo, JERR_BAD_DCT_COEF);
 
-    /* We must apply the point transform by Al.  For AC coefficients this
-     * is an integer division with rounding towards 0.  The code is
-     * interwoven with finding the abs value (temp) and output bits (temp2).
-     */
-#ifdef RIGHT_SHIFT_IS_UNSIGNED
-    sign = (temp < 0) ? ~0 : 0;
-#else
-    sign = temp >> (8*sizeof(temp)-1);
-#endif
-    temp += sign;
-    temp = (temp ^ sign) >> Al;
-    temp2 = temp ^ sign;
+      /* Count/emit Huffman symbol for run length / number of bits */
+      emit_symbol(entropy, entropy->ac_tbl_no, (r << 4) + nbits);
 
-    /* Emit any pending EOBRUN */
-    if (entropy->EOBRUN > 0)
-      emit_eobrun(entropy);
-    /* if run length > 15, must emit special run-length-16 codes (0xF0) */
-    while (r > 15) {
-      emit_symbol(entropy, entropy->ac_tbl_no, 0xF0);
-      r -= 16;
+      /* Emit that number of bits of the value, if positive, */
+      /* or the complement of its magnitude, if negative. */
+      emit_bits(entropy, (unsigned int) temp2, nbits);
     }
-
-    /* Find the number of bits needed for the magnitude of the coefficient */
-    nbits = 1;                  /* there must be at least one 1 bit */
-    while ((temp >>= 1))
-      nbits++;
-    /* Check for out-of-range coefficient values */
-    if (nbits > MAX_COEF_BITS)
-      ERREXIT(cinfo, JERR_BAD_DCT_COEF);
-
-    /* Count/emit Huffman symbol for run length / number of bits */
-    emit_symbol(entropy, entropy->ac_tbl_no, (r << 4) + nbits);
-
-    /* Emit that number of bits of the value, if positive, */
-    /* or the complement of its magnitude, if negative. */
-    emit_bits(entropy, (unsigned int) temp2, nbits);
-
-    r = 0;                      /* reset zero run length */
   }
 
-  if (r > 0) {                  /* If there are trailing zeroes, */
+  if (last < Sl - 1) {          /* If there are trailing zeroes, */
     entropy->EOBRUN++;          /* count an EOB */
     if (entropy->EOBRUN == 0x7FFF)
       emit_eobrun(entropy);     /* force it out to avoid overflow */
@@ -617,6 +776,103 @@ encode_mcu_DC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Prepare a block for an AC refinement scan: for each of the Sl coefficients
+ * of the spectral band, store the absolute value after the point transform by
+ * Al in absvalues[], and set the bits of the coefficients that are nonzero
+ * after the point transform in bits[0 .. BITMAP_WORDS-1] and those of the
+ * coefficients that are not negative in bits[BITMAP_WORDS ...].  Returns the
+ * index of the last coefficient whose transformed absolute value is 1 (that
+ * is, of the last newly-nonzero coefficient), or -1 if there is none.
+ */
+
+LOCAL(int)
+encode_mcu_AC_refine_prepare (const JCOEF *block,
+                              const int *jpeg_natural_order_start, int Sl,
+                              int Al, JCOEF *absvalues, size_t *bits)
+{
+  register int temp, k;
+  int EOB = -1;
+  size_t bit;
+
+  MEMZERO(bits, 2 * BITMAP_WORDS * sizeof(size_t));
+
+  for (k = 0; k < Sl; k++) {
+    temp = block[jpeg_natural_order_start[k]];
+    bit = ((size_t) 1) << (k % BITMAP_WORD_BITS);
+    if (temp >= 0)
+      bits[BITMAP_WORDS + k / BITMAP_WORD_BITS] |= bit;
+    /* We must apply the point transform by Al.  For AC coefficients this
+     * is an integer division with rounding towards 0.  To do this portably
+     * in C, we shift after obtaining the absolute value.
+     */
+    if (temp < 0)
+      temp = -temp;             /* temp is abs value of input */
+    temp >>= Al;                /* apply the point transform */
+    absvalues[k] = (JCOEF) temp; /* save abs value for main pass */
+    if (temp) {
+      bits[k / BITMAP_WORD_BITS] |= bit;
+      if (temp == 1)
+        EOB = k;                /* EOB = index of last newly-nonzero coef */
+    }
+  }
+
+  return EOB;
+}
+
+
+/*
+ * Prepare a block for an AC refinement scan using the side information
+ * computed by the coefficient controller (see jccoefct.c.)  The results are
+ * the same as those of encode_mcu_AC_refine_prepare(), except that
+ * absvalues[] and the sign bits are only filled in for the coefficients that
+ * are nonzero after the point transform, which are the only ones examined.
+ * Requires Al < BLOCK_INFO_MAX_AL.
+ */
+
+LOCAL(int)
+encode_mcu_AC_refine_prepare_info (const JCOEF *block, const jblock_info *info,
+                                   int Ss, int Sl, int Al, JCOEF *absvalues,
+                                   size_t *bits)
+{
+  register int temp, k;
+  int w, EOB = -1;
+  size_t bitmap, prev_bits[BITMAP_WORDS];
+
+  extract_band(info->nonzero[Al], Ss, Sl, bits);
+  extract_band(info->nonzero[Al + 1], Ss, Sl, prev_bits);
+
+  /* EOB = index of last newly-nonzero coef, that is, of the last coef that
+   * is nonzero now but was zero in the previous stage
+   */
+  for (w = BITMAP_WORDS - 1; w >= 0; w--) {
+    bitmap = bits[w] & ~prev_bits[w];
+    if (bitmap) {
+      EOB = w * BITMAP_WORD_BITS + HIGHEST_BIT(bitmap);
+      break;
+    }
+  }
+
+  MEMZERO(bits + BITMAP_WORDS, BITMAP_WORDS * sizeof(size_t));
+
+  for (w = 0; w < BITMAP_WORDS; w++) {
+    bitmap = bits[w];
+    while (bitmap) {
+      k = COUNT_TRAILING_ZEROS(bitmap);
+      bitmap &= bitmap - 1;
+      temp = block[jpeg_natural_order[Ss + w * BITMAP_WORD_BITS + k]];
+      if (temp >= 0)
+        bits[BITMAP_WORDS + w] |= ((size_t) 1) << k;
+      else
+        temp = -temp;
+      absvalues[w * BITMAP_WORD_BITS + k] = (JCOEF) (temp >> Al);
+    }
+  }
+
+  return EOB;
+}
+
+
 /*
  * MCU encoding for AC successive approximation refinement scan.
  */
@@ -630,10 +886,10 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   int EOB;
   char *BR_buffer;
   unsigned int BR;
-  int Se = cinfo->Se;
-  int Al = cinfo->Al;
-  JBLOCKROW block;
-  int absvalues[DCTSIZE2];
+  int Sl = cinfo->Se - cinfo->Ss + 1;
+  int last, w;
+  JCOEF absvalues[DCTSIZE2];
+  size_t bits[2 * BITMAP_WORDS], bitmap;
 
   entropy->next_output_byte = cinfo->dest->next_output_byte;
   entropy->free_in_buffer = cinfo->dest->free_in_buffer;
@@ -644,79 +900,86 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
       emit_restart(entropy, entropy->next_restart_num);
 
   /* Encode the MCU data block */
-  block = MCU_data[0];
 
   /* It is convenient to make a pre-pass to determine the transformed
    * coefficients' absolute values and the EOB position.
    */
-  EOB = 0;
-  for (k = cinfo->Ss; k <= Se; k++) {
-    temp = (*block)[jpeg_natural_order[k]];
-    /* We must apply the point transform by Al.  For AC coefficients this
-     * is an integer division with rounding towards 0.  To do this portably
-     * in C, we shift after obtaining the absolute value.
-     */
-    if (temp < 0)
-      temp = -temp;             /* temp is abs value of input */
-    temp >>= Al;                /* apply the point transform */
-    absvalues[k] = temp;        /* save abs value for main pass */
-    if (temp == 1)
-      EOB = k;                  /* EOB = index of last newly-nonzero coef */
-  }
-
-  /* Encode the AC coefficients per section G.1.2.3, fig. G.7 */
+  if (cinfo->coef->MCU_info != NULL && cinfo->Al < BLOCK_INFO_MAX_AL)
+    EOB = encode_mcu_AC_refine_prepare_info(MCU_data[0][0],
+                                            cinfo->coef->MCU_info[0],
+                                            cinfo->Ss, Sl, cinfo->Al,
+                                            absvalues, bits);
+  else
+    EOB = (*entropy->AC_refine_prepare) (MCU_data[0][0],
+                                         jpeg_natural_order + cinfo->Ss, Sl,
+                                         cinfo->Al, absvalues, bits);
+
+  /* Encode the AC coefficients per section G.1.2.3, fig. G.7.  Only the
+   * nonzero coefficients are visited.  The zeros skipped on the way to each
+   * one are added to the run length, which is reset only when a symbol is
+   * emitted.
+   */
 
   r = 0;                        /* r = run length of zeros */
   BR = 0;                       /* BR = count of buffered bits added now */
   BR_buffer = entropy->bit_buffer + entropy->BE; /* Append bits to buffer */
+  last = -1;                    /* index of the last nonzero coefficient */
+
+  for (w = 0; w < BITMAP_WORDS; w++) {
+    bitmap = bits[w];
+    while (bitmap) {
+      k = w * BITMAP_WORD_BITS + COUNT_TRAILING_ZEROS(bitmap);
+      bitmap &= bitmap - 1;
+      r += k - last - 1;
+      last = k;
+      temp = absvalues[k] & 0xFFFF; /* the magnitude may be 32768 */
+
+      /* Emit any required ZRLs, but not if they can be folded into EOB */
+      while (r > 15 && k <= EOB) {
+        /* emit any pending EOBRUN and the BE correction bits */
+        emit_eobrun(entropy);
+        /* Emit ZRL */
+        emit_symbol(entropy, entropy->ac_tbl_no, 0xF0);
+        r -= 16;
+        /* Emit buffered correction bits that must be associated with ZRL */
+        emit_buffered_bits(entropy, BR_buffer, BR);
+        BR_buffer = entropy->bit_buffer; /* BE bits are gone now */
+        BR = 0;
+      }
 
-  for (k = cinfo->Ss; k <= Se; k++) {
-    if ((temp = absvalues[k]) == 0) {
-      r++;
-      continue;
-    }
+      /* If the coef was previously nonzero, it only needs a correction bit.
+       * NOTE: a straight translation of the spec's figure G.7 would suggest
+       * that we also need to test r > 15.  But if r > 15, we can only get
+       * here if k > EOB, which implies that this coefficient is not 1.
+       */
+      if (temp > 1) {
+        /* The correction bit is the next bit of the absolute value. */
+        BR_buffer[BR++] = (char) (temp & 1);
+        continue;
+      }
 
-    /* Emit any required ZRLs, but not if they can be folded into EOB */
-    while (r > 15 && k <= EOB) {
-      /* emit any pending EOBRUN and the BE correction bits */
+      /* Emit any pending EOBRUN and the BE correction bits */
       emit_eobrun(entropy);
-      /* Emit ZRL */
-      emit_symbol(entropy, entropy->ac_tbl_no, 0xF0);
-      r -= 16;
-      /* Emit buffered correction bits that must be associated with ZRL */
+
+      /* Count/emit Huffman symbol for run length / number of bits */
+      emit_symbol(entropy, entropy->ac_tbl_no, (r << 4) + 1);
+
+      /* Emit output bit for newly-nonzero coef */
+      temp = (int) ((bits[BITMAP_WORDS + w] >> (k % BITMAP_WORD_BITS)) & 1);
+      emit_bits(entropy, (unsigned int) temp, 1);
+
+      /* Emit buffered correction bits that must be associated with this
+       * code
+       */
       emit_buffered_bits(entropy, BR_buffer, BR);
       BR_buffer = entropy->bit_buffer; /* BE bits are gone now */
       BR = 0;
+      r = 0;                    /* reset zero run length */
     }
-
-    /* If the coef was previously nonzero, it only needs a correction bit.
-     * NOTE: a straight translation of the spec's figure G.7 would suggest
-     * that we also need to test r > 15.  But if r > 15, we can only get here
-     * if k > EOB, which implies that this coefficient is not 1.
-     */
-    if (temp > 1) {
-      /* The correction bit is the next bit of the absolute value. */
-      BR_buffer[BR++] = (char) (temp & 1);
-      continue;
-    }
-
-    /* Emit any pending EOBRUN and the BE correction bits */
-    emit_eobrun(entropy);
-
-    /* Count/emit Huffman symbol for run length / number of bits */
-    emit_symbol(entropy, entropy->ac_tbl_no, (r << 4) + 1);
-
-    /* Emit output bit for newly-nonzero coef */
-    temp = ((*block)[jpeg_natural_order[k]] < 0) ? 0 : 1;
-    emit_bits(entropy, (unsigned int) temp, 1);
-
-    /* Emit buffered correction bits that must be associated with this code */
-    emit_buffered_bits(entropy, BR_buffer, BR);
-    BR_buffer = entropy->bit_buffer; /* BE bits are gone now */
-    BR = 0;
-    r = 0;                      /* reset zero run length */
   }
 
+  r += Sl - 1 - last;           /* trailing zeroes */
+
   if (r > 0 || BR > 0) {        /* If there are trailing zeroes, */
     entropy->EOBRUN++;          /* count an EOB */
     entropy->BE += BR;          /* concat my correction bits to older ones */
@@ -779,6 +1042,7 @@ finish_pass_gather_phuff (j_compress_ptr cinfo)
   jpeg_component_info *compptr;
   JHUFF_TBL **htblptr;
   boolean did[NUM_HUFF_TBLS];
+  long counts[257];
 
   /* Flush out buffered data (all we care about is counting the EOB symbol) */
   emit_eobrun(entropy);
@@ -789,6 +1053,7 @@ finish_pass_gather_phuff (j_compress_ptr cinfo)
    * per table, because it clobbers the input frequency counts!
    */
   MEMZERO(did, sizeof(did));
+  cinfo->master->gather_bits = (double) entropy->corr_bits;
 
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
     compptr = cinfo->cur_comp_info[ci];
@@ -806,7 +1071,9 @@ finish_pass_gather_phuff (j_compress_ptr cinfo)
         htblptr = & cinfo->ac_huff_tbl_ptrs[tbl];
       if (*htblptr == NULL)
         *htblptr = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+      MEMCOPY(counts, entropy->count_ptrs[tbl], sizeof(counts));
       jpeg_gen_optimal_table(cinfo, *htblptr, entropy->count_ptrs[tbl]);
+      cinfo->master->gather_bits += jpeg_huff_table_bits(*htblptr, counts);
       did[tbl] = TRUE;
     }
   }
@@ -835,6 +1102,15 @@ jinit_phuff_encoder (j_compress_ptr cinfo)
     entropy->count_ptrs[i] = NULL;
   }
   entropy->bit_buffer = NULL;   /* needed only in AC refinement scan */
+
+  if (jsimd_can_encode_mcu_AC_first_prepare())
+    entropy->AC_first_prepare = jsimd_encode_mcu_AC_first_prepare;
+  else
+    entropy->AC_first_prepare = encode_mcu_AC_first_prepare;
+  if (jsimd_can_encode_mcu_AC_refine_prepare())
+    entropy->AC_refine_prepare = jsimd_encode_mcu_AC_refine_prepare;
+  else
+    entropy->AC_refine_prepare = encode_mcu_AC_refine_prepare;
 }
 
 #endif /* C_PROGRESSIVE_SUPPORTED */
@@ -394,6 +394,7 @@ transencode_coef_controller (j_compress_ptr cinfo,
   cinfo->coef = (struct jpeg_c_coef_controller *) coef;
   coef->pub.start_pass = start_pass_coef;
   coef->pub.compress_data = compress_output;
+  coef->pub.MCU_info = NULL;
 
   /* Save pointer to virtual arrays */
   coef->whole_image = coef_arrays;
@@ -244,6 +244,61 @@ jpeg_crop_scanline (j_decompress_ptr cinfo, JDIMENSION *xoffset,
 }
 
 
+/*
+ * Random-access decompression of sequential Huffman-coded images that are
+ * held in memory.  jpeg_build_mcu_index() records where every interval'th
+ * MCU begins (see jdhuff.c) and returns the index in a buffer allocated with
+ * malloc(), which the caller must free().  After the index has been passed to
+ * jpeg_set_mcu_index(), the entropy decoder seeks to the nearest recorded MCU
+ * instead of decoding all of the MCUs that precede the rows that are read
+ * (after jpeg_skip_scanlines()) or the columns that are read (after
+ * jpeg_crop_scanline()).
+ *
+ * Both must be called after jpeg_start_decompress() and before any calls to
+ * jpeg_read_scanlines(), jpeg_read_raw_data() or jpeg_skip_scanlines().  They
+ * return FALSE, without changing the state of the decompressor, if the image
+ * cannot be indexed or the index does not match it.
+ */
+
+LOCAL(boolean)
+mcu_index_ok (j_decompress_ptr cinfo)
+{
+  if (cinfo->global_state != DSTATE_SCANNING || cinfo->output_scanline != 0)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  /* The whole scan must still be waiting in the source buffer */
+  return !cinfo->progressive_mode && !cinfo->arith_code &&
+         !cinfo->inputctl->has_multiple_scans && cinfo->input_iMCU_row == 0;
+}
+
+GLOBAL(boolean)
+jpeg_build_mcu_index (j_decompress_ptr cinfo, JDIMENSION interval,
+                      unsigned char **outbuffer, unsigned long *outsize)
+{
+  if (outbuffer == NULL || outsize == NULL)
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  if (! mcu_index_ok(cinfo))
+    return FALSE;
+  return jpeg_huff_build_index(cinfo, interval, outbuffer, outsize);
+}
+
+GLOBAL(boolean)
+jpeg_set_mcu_index (j_decompress_ptr cinfo, const unsigned char *inbuffer,
+                    unsigned long insize)
+{
+  if (inbuffer == NULL)
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  /* The index is used only when decompressing a single scan in one pass */
+  if (! mcu_index_ok(cinfo) || cinfo->coef->coef_arrays != NULL ||
+      ! jpeg_huff_set_index(cinfo, inbuffer, insize))
+    return FALSE;
+  cinfo->master->use_mcu_index = TRUE;
+  return TRUE;
+}
+
+
 /*
  * Read some scanlines of data from the JPEG decompressor.
  *
@@ -453,8 +508,17 @@ jpeg_skip_scanlines (j_decompress_ptr cinfo, JDIMENSION num_lines)
   /* For images requiring multiple scans (progressive, non-interleaved, etc.),
    * all of the entropy decoding occurs in jpeg_start_decompress(), assuming
    * that the input data source is non-suspending.  This makes skipping easy.
+   * The same goes for any image that is decoded into the whole-image
+   * coefficient buffer (buffered-image mode, or restart intervals decoded on
+   * worker threads.)  The output side can move straight to the target iMCU
+   * row without any IDCT, upsampling or color conversion of the rows in
+   * between, and the coefficient controller will consume whatever input it
+   * still needs when that row is read.  Decoding the skipped MCUs here instead
+   * would run the entropy decoder out of sync with the input side (and past
+   * the end of the scan once the input is complete.)
    */
-  if (cinfo->inputctl->has_multiple_scans) {
+  if (cinfo->inputctl->has_multiple_scans ||
+      cinfo->coef->coef_arrays != NULL) {
     if (cinfo->upsample->need_context_rows) {
       cinfo->output_scanline += lines_to_skip;
       cinfo->output_iMCU_row += lines_to_skip / lines_per_iMCU_row;
@@ -472,23 +536,31 @@ jpeg_skip_scanlines (j_decompress_ptr cinfo, JDIMENSION num_lines)
     return num_lines;
   }
 
-  /* Skip the iMCU rows that we can safely skip. */
+  /* Skip the iMCU rows that we can safely skip.  With an MCU index, the
+   * entropy decoder seeks past them when the next MCU is needed.
+   */
   for (i = 0; i < lines_to_skip; i += lines_per_iMCU_row) {
-    for (y = 0; y < coef->MCU_rows_per_iMCU_row; y++) {
-      for (x = 0; x < cinfo->MCUs_per_row; x++) {
-        /* Calling decode_mcu() with a NULL pointer causes it to discard the
-         * decoded coefficients.  This is ~5% faster for large subsets, but
-         * it's tough to tell a difference for smaller images.
-         */
-        (*cinfo->entropy->decode_mcu) (cinfo, NULL);
+    if (! cinfo->master->use_mcu_index) {
+      for (y = 0; y < coef->MCU_rows_per_iMCU_row; y++) {
+        for (x = 0; x < cinfo->MCUs_per_row; x++) {
+          /* Calling decode_mcu() with a NULL pointer causes it to discard the
+           * decoded coefficients.  This is ~5% faster for large subsets, but
+           * it's tough to tell a difference for smaller images.
+           */
+          (*cinfo->entropy->decode_mcu) (cinfo, NULL);
+        }
       }
     }
     cinfo->input_iMCU_row++;
     cinfo->output_iMCU_row++;
     if (cinfo->input_iMCU_row < cinfo->total_iMCU_rows)
       start_iMCU_row(cinfo);
-    else
+    else {
+      if (cinfo->master->use_mcu_index)
+        jpeg_huff_seek_mcu(cinfo,
+                           cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan);
       (*cinfo->inputctl->finish_input_pass) (cinfo);
+    }
   }
   cinfo->output_scanline += lines_to_skip;
 
@@ -43,6 +43,9 @@ typedef struct {
 
   /* Statistics bin for coding with fixed probability 0.5 */
   unsigned char fixed_bin[4];
+
+  /* Combined probability estimation and state transition table */
+  JLONG trans[256];
 } arith_entropy_decoder;
 
 typedef arith_entropy_decoder *arith_entropy_ptr;
@@ -63,6 +66,28 @@ typedef arith_entropy_decoder *arith_entropy_ptr;
 #define DC_STAT_BINS 64
 #define AC_STAT_BINS 256
 
+/* RENORM_SHIFT(a) returns the number of left shifts that renormalize the
+ * interval size a (0 < a < 0x8000), i.e. that bring it to 0x8000 or above.
+ */
+
+#if defined(__GNUC__)
+#define RENORM_SHIFT(a)  (__builtin_clz((unsigned int) (a)) - 16)
+#else
+#define RENORM_SHIFT(a)  renorm_shift(a)
+
+LOCAL(int)
+renorm_shift (JLONG a)
+{
+  int n = 0;
+
+  while (a < 0x8000L) {
+    a <<= 1;
+    n++;
+  }
+  return n;
+}
+#endif
+
 
 LOCAL(int)
 get_byte (j_decompress_ptr cinfo)
@@ -81,10 +106,6 @@ get_byte (j_decompress_ptr cinfo)
 /*
  * The core arithmetic decoding routine (common in JPEG and JBIG).
  * This needs to go as fast as possible.
- * Machine-dependent optimization facilities
- * are not utilized in this portable implementation.
- * However, this code should be fairly efficient and
- * may be a good base for further optimizations anyway.
  *
  * Return value is 0 or 1 (binary decision).
  *
@@ -100,21 +121,32 @@ get_byte (j_decompress_ptr cinfo)
  * we can do away with any renormalization update
  * of C (except for new data insertion, of course).
  *
- * I've also introduced a new scheme for accessing
- * the probability estimation state machine table,
- * derived from Markus Kuhn's JBIG implementation.
+ * The probability estimation state machine is accessed through the
+ * combined table built by jpeg_make_arith_trans_tbl(), which yields Qe and
+ * both successor states with a single lookup.  Renormalization consumes all
+ * of the bits that are already in the bit buffer at once, falling back to
+ * the bit-by-bit procedure only when a new byte must be fetched.
  */
 
 LOCAL(int)
 arith_decode (j_decompress_ptr cinfo, unsigned char *st)
 {
   register arith_entropy_ptr e = (arith_entropy_ptr) cinfo->entropy;
-  register unsigned char nl, nm;
-  register JLONG qe, temp;
-  register int sv, data;
+  register JLONG qe, t, temp;
+  register int sv, n, data;
 
   /* Renormalization & data input per section D.2.6 */
   while (e->a < 0x8000L) {
+    if (e->ct > 0) {
+      /* Shift as many bits as the bit buffer holds in one step
+       * (A is never 0 while CT > 0) */
+      n = RENORM_SHIFT(e->a);
+      if (n > e->ct)
+        n = e->ct;
+      e->ct -= n;
+      e->a <<= n;
+      continue;
+    }
     if (--e->ct < 0) {
       /* Need to fetch next data byte */
       if (cinfo->unread_marker)
@@ -148,13 +180,9 @@ arith_decode (j_decompress_ptr cinfo, unsigned char *st)
     e->a <<= 1;
   }
 
-  /* Fetch values from our compact representation of Table D.2:
-   * Qe values and probability estimation state machine
-   */
   sv = *st;
-  qe = jpeg_aritab[sv & 0x7F];  /* => Qe_Value */
-  nl = qe & 0xFF; qe >>= 8;     /* Next_Index_LPS + Switch_MPS */
-  nm = qe & 0xFF; qe >>= 8;     /* Next_Index_MPS */
+  t = e->trans[sv];
+  qe = t >> 16;                 /* => Qe_Value */
 
   /* Decode & estimation procedures per sections D.2.4 & D.2.5 */
   temp = e->a - qe;
@@ -165,19 +193,19 @@ arith_decode (j_decompress_ptr cinfo, unsigned char *st)
     /* Conditional LPS (less probable symbol) exchange */
     if (e->a < qe) {
       e->a = qe;
-      *st = (sv & 0x80) ^ nm;   /* Estimate_after_MPS */
+      *st = (unsigned char) t;          /* Estimate_after_MPS */
     } else {
       e->a = qe;
-      *st = (sv & 0x80) ^ nl;   /* Estimate_after_LPS */
+      *st = (unsigned char) (t >> 8);   /* Estimate_after_LPS */
       sv ^= 0x80;               /* Exchange LPS/MPS */
     }
   } else if (e->a < 0x8000L) {
     /* Conditional MPS (more probable symbol) exchange */
     if (e->a < qe) {
-      *st = (sv & 0x80) ^ nl;   /* Estimate_after_LPS */
+      *st = (unsigned char) (t >> 8);   /* Estimate_after_LPS */
       sv ^= 0x80;               /* Exchange LPS/MPS */
     } else {
-      *st = (sv & 0x80) ^ nm;   /* Estimate_after_MPS */
+      *st = (unsigned char) t;          /* Estimate_after_MPS */
     }
   }
 
@@ -752,6 +780,8 @@ jinit_arith_decoder (j_decompress_ptr cinfo)
   /* Initialize index for fixed probability estimation */
   entropy->fixed_bin[0] = 113;
 
+  jpeg_make_arith_trans_tbl(entropy->trans);
+
   if (cinfo->progressive_mode) {
     /* Create progression status table */
     int *coef_bit_ptr, ci;
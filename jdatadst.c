@@ -197,6 +197,75 @@ term_mem_destination (j_compress_ptr cinfo)
 #endif
 
 
+/*
+ * Write a block of data to the destination in one step, rather than through
+ * the destination's buffer, if the destination is one of the managers in
+ * this file.  This is used to emit the scans buffered by the scan optimizer
+ * (jcmaster.c.)  Returns FALSE, having written nothing, for any other kind
+ * of destination.
+ */
+
+GLOBAL(boolean)
+jpeg_write_direct (j_compress_ptr cinfo, const JOCTET *data, size_t datacount)
+{
+  if (cinfo->dest->empty_output_buffer == empty_output_buffer) {
+    my_dest_ptr dest = (my_dest_ptr) cinfo->dest;
+    size_t pending = OUTPUT_BUF_SIZE - dest->pub.free_in_buffer;
+
+    /* Write any data remaining in the buffer, then the block itself */
+    if (pending > 0) {
+      if (JFWRITE(dest->outfile, dest->buffer, pending) != pending)
+        ERREXIT(cinfo, JERR_FILE_WRITE);
+    }
+    if (JFWRITE(dest->outfile, data, datacount) != datacount)
+      ERREXIT(cinfo, JERR_FILE_WRITE);
+
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
+    return TRUE;
+  }
+
+#if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
+  if (cinfo->dest->empty_output_buffer == empty_mem_output_buffer) {
+    my_mem_dest_ptr dest = (my_mem_dest_ptr) cinfo->dest;
+    size_t used = dest->bufsize - dest->pub.free_in_buffer;
+
+    if (datacount > dest->pub.free_in_buffer) {
+      /* Grow the buffer just once, to at least double size */
+      size_t nextsize = dest->bufsize * 2;
+      JOCTET *nextbuffer;
+
+      if (nextsize < used + datacount)
+        nextsize = used + datacount;
+      nextbuffer = (JOCTET *) malloc(nextsize);
+      if (nextbuffer == NULL)
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+
+      MEMCOPY(nextbuffer, dest->buffer, used);
+
+      if (dest->newbuffer != NULL)
+        free(dest->newbuffer);
+
+      dest->newbuffer = nextbuffer;
+
+      dest->pub.next_output_byte = nextbuffer + used;
+      dest->pub.free_in_buffer = nextsize - used;
+
+      dest->buffer = nextbuffer;
+      dest->bufsize = nextsize;
+    }
+
+    MEMCOPY(dest->pub.next_output_byte, data, datacount);
+    dest->pub.next_output_byte += datacount;
+    dest->pub.free_in_buffer -= datacount;
+    return TRUE;
+  }
+#endif
+
+  return FALSE;
+}
+
+
 /*
  * Prepare for output to a stdio stream.
  * The caller must have already opened the stream, and is responsible
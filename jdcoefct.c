@@ -61,7 +61,7 @@ start_output_pass (j_decompress_ptr cinfo)
   my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
 
   /* If multipass, check to see whether to use block smoothing on this pass */
-  if (coef->pub.coef_arrays != NULL) {
+  if (coef->pub.coef_arrays != NULL && !coef->dc_only) {
     if (cinfo->do_block_smoothing && smoothing_ok(cinfo))
       coef->pub.decompress_data = decompress_smooth_data;
     else
@@ -87,6 +87,7 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 {
   my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
   JDIMENSION MCU_col_num;       /* index of current MCU within row */
+  JDIMENSION MCU_row_num;       /* index of current MCU row within scan */
   JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
   int blkn, ci, xindex, yindex, yoffset, useful_width;
@@ -100,6 +101,23 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
        yoffset++) {
     for (MCU_col_num = coef->MCU_ctr; MCU_col_num <= last_MCU_col;
          MCU_col_num++) {
+      /* With an MCU index, decode only the MCUs within the cropping region,
+       * bringing the entropy decoder to each row of them via the index.
+       */
+      if (cinfo->master->use_mcu_index) {
+        if (MCU_col_num < cinfo->master->first_iMCU_col ||
+            MCU_col_num > cinfo->master->last_iMCU_col)
+          continue;
+        MCU_row_num = cinfo->input_iMCU_row *
+          (cinfo->comps_in_scan > 1 ? 1 :
+           cinfo->cur_comp_info[0]->v_samp_factor) + yoffset;
+        if (! jpeg_huff_seek_mcu(cinfo, MCU_row_num * cinfo->MCUs_per_row +
+                                        MCU_col_num)) {
+          coef->MCU_vert_offset = yoffset;
+          coef->MCU_ctr = MCU_col_num;
+          return JPEG_SUSPENDED;
+        }
+      }
       /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed. */
       jzero_far((void *) coef->MCU_buffer[0],
                 (size_t) (cinfo->blocks_in_MCU * sizeof(JBLOCK)));
@@ -162,6 +180,8 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     return JPEG_ROW_COMPLETED;
   }
   /* Completed the scan */
+  if (cinfo->master->use_mcu_index)
+    jpeg_huff_seek_mcu(cinfo, cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan);
   (*cinfo->inputctl->finish_input_pass) (cinfo);
   return JPEG_SCAN_COMPLETED;
 }
@@ -180,6 +200,41 @@ dummy_consume_data (j_decompress_ptr cinfo)
 
 #ifdef D_MULTISCAN_FILES_SUPPORTED
 
+/*
+ * Decode the whole of a sequential scan that has a restart interval on
+ * worker threads.  Returns FALSE, having consumed no input, if this is not
+ * possible; the caller then proceeds one iMCU row at a time.
+ */
+
+LOCAL(boolean)
+consume_restarts_mt (j_decompress_ptr cinfo)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
+  jpeg_component_info *compptr;
+  int ci;
+
+  /* Make the whole scan accessible at once (the virtual arrays were
+   * requested with a full-height window for this purpose.)
+   */
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    buffer[ci] = (*cinfo->mem->access_virt_barray)
+      ((j_common_ptr) cinfo, coef->whole_image[compptr->component_index],
+       (JDIMENSION) 0,
+       (JDIMENSION) jround_up((long) compptr->height_in_blocks,
+                              (long) compptr->v_samp_factor), TRUE);
+  }
+
+  if (! jpeg_huff_decode_restarts_mt(cinfo, buffer))
+    return FALSE;
+
+  cinfo->input_iMCU_row = cinfo->total_iMCU_rows;
+  (*cinfo->inputctl->finish_input_pass) (cinfo);
+  return TRUE;
+}
+
+
 /*
  * Consume input data and store it in the full-image coefficient buffer.
  * We read as much as one fully interleaved MCU row ("iMCU" row) per call,
@@ -198,6 +253,12 @@ consume_data (j_decompress_ptr cinfo)
   JBLOCKROW buffer_ptr;
   jpeg_component_info *compptr;
 
+  /* At the start of the scan, try to decode all of it on worker threads. */
+  if (cinfo->master->parallel_restarts && cinfo->input_iMCU_row == 0 &&
+      coef->MCU_ctr == 0 && coef->MCU_vert_offset == 0 &&
+      consume_restarts_mt(cinfo))
+    return JPEG_SCAN_COMPLETED;
+
   /* Align the virtual buffers for the components used in this scan. */
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
     compptr = cinfo->cur_comp_info[ci];
@@ -321,6 +382,156 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   return JPEG_SCAN_COMPLETED;
 }
 
+
+/*
+ * Consume input data in DC-only mode.  This is the same as consume_data,
+ * except that only the DC coefficients are kept, and scans that contain no
+ * DC coefficients (progressive AC scans) are skipped over without decoding
+ * them at all.
+ */
+
+METHODDEF(int)
+consume_dc_data (j_decompress_ptr cinfo)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JDIMENSION MCU_col_num;       /* index of current MCU within row */
+  int blkn, ci, xindex, yindex, yoffset;
+  JDIMENSION start_col;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
+  JCOEFPTR plane_ptr, dc_ptr[D_MAX_BLOCKS_IN_MCU];
+  jpeg_component_info *compptr;
+
+  if (cinfo->Ss > 0) {
+    if (! (*cinfo->marker->skip_scan_data) (cinfo))
+      return JPEG_SUSPENDED;
+    cinfo->input_iMCU_row = cinfo->total_iMCU_rows;
+    (*cinfo->inputctl->finish_input_pass) (cinfo);
+    return JPEG_SCAN_COMPLETED;
+  }
+
+  /* Align the virtual buffers for the components used in this scan. */
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    buffer[ci] = (*cinfo->mem->access_virt_barray)
+      ((j_common_ptr) cinfo, coef->whole_image[compptr->component_index],
+       cinfo->input_iMCU_row * compptr->v_samp_factor,
+       (JDIMENSION) compptr->v_samp_factor, TRUE);
+  }
+
+  /* Loop to process one whole iMCU row */
+  for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
+       yoffset++) {
+    for (MCU_col_num = coef->MCU_ctr; MCU_col_num < cinfo->MCUs_per_row;
+         MCU_col_num++) {
+      /* Load the MCU's DC coefficients into the workspace.  The entropy
+       * decoder needs the previous values when refining them, and it leaves
+       * the AC coefficients alone since every block is scaled to 1x1.
+       */
+      blkn = 0;                 /* index of current DCT block within MCU */
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        compptr = cinfo->cur_comp_info[ci];
+        start_col = MCU_col_num * compptr->MCU_width;
+        for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+          plane_ptr = (JCOEFPTR) buffer[ci][yindex+yoffset] + start_col;
+          for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+            dc_ptr[blkn] = plane_ptr;
+            coef->MCU_buffer[blkn++][0][0] = *plane_ptr++;
+          }
+        }
+      }
+      /* Try to fetch the MCU. */
+      if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
+        /* Suspension forced; update state counters and exit */
+        coef->MCU_vert_offset = yoffset;
+        coef->MCU_ctr = MCU_col_num;
+        return JPEG_SUSPENDED;
+      }
+      for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+        *dc_ptr[blkn] = coef->MCU_buffer[blkn][0][0];
+    }
+    /* Completed an MCU row, but perhaps not an iMCU row */
+    coef->MCU_ctr = 0;
+  }
+  /* Completed the iMCU row, advance counters for next one */
+  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
+    start_iMCU_row(cinfo);
+    return JPEG_ROW_COMPLETED;
+  }
+  /* Completed the scan */
+  (*cinfo->inputctl->finish_input_pass) (cinfo);
+  return JPEG_SCAN_COMPLETED;
+}
+
+
+/*
+ * Decompress and return some data in DC-only mode.  Each block becomes a
+ * single sample, so the 1x1 inverse DCT needs nothing but the DC coefficient
+ * from the virtual arrays.
+ */
+
+METHODDEF(int)
+decompress_dc_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
+  JDIMENSION block_num;
+  int ci, block_row, block_rows;
+  JBLOCKARRAY buffer;
+  JCOEFPTR plane_ptr;
+  JSAMPARRAY output_ptr;
+  JDIMENSION output_col;
+  jpeg_component_info *compptr;
+  inverse_DCT_method_ptr inverse_DCT;
+
+  /* Force some input to be done if we are getting ahead of the input. */
+  while (cinfo->input_scan_number < cinfo->output_scan_number ||
+         (cinfo->input_scan_number == cinfo->output_scan_number &&
+          cinfo->input_iMCU_row <= cinfo->output_iMCU_row)) {
+    if ((*cinfo->inputctl->consume_input)(cinfo) == JPEG_SUSPENDED)
+      return JPEG_SUSPENDED;
+  }
+
+  /* OK, output from the virtual arrays. */
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    /* Don't bother to IDCT an uninteresting component. */
+    if (! compptr->component_needed)
+      continue;
+    /* Align the virtual buffer for this component. */
+    buffer = (*cinfo->mem->access_virt_barray)
+      ((j_common_ptr) cinfo, coef->whole_image[ci],
+       cinfo->output_iMCU_row * compptr->v_samp_factor,
+       (JDIMENSION) compptr->v_samp_factor, FALSE);
+    /* Count non-dummy DCT block rows in this iMCU row. */
+    if (cinfo->output_iMCU_row < last_iMCU_row)
+      block_rows = compptr->v_samp_factor;
+    else {
+      /* NB: can't use last_row_height here; it is input-side-dependent! */
+      block_rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
+      if (block_rows == 0) block_rows = compptr->v_samp_factor;
+    }
+    inverse_DCT = cinfo->idct->inverse_DCT[ci];
+    output_ptr = output_buf[ci];
+    /* Loop over all DCT blocks to be processed. */
+    for (block_row = 0; block_row < block_rows; block_row++) {
+      plane_ptr = (JCOEFPTR) buffer[block_row] +
+                  cinfo->master->first_MCU_col[ci];
+      output_col = 0;
+      for (block_num = cinfo->master->first_MCU_col[ci];
+           block_num <= cinfo->master->last_MCU_col[ci]; block_num++) {
+        (*inverse_DCT) (cinfo, compptr, plane_ptr, output_ptr, output_col);
+        plane_ptr++;
+        output_col++;
+      }
+      output_ptr++;
+    }
+  }
+
+  if (++(cinfo->output_iMCU_row) < cinfo->total_iMCU_rows)
+    return JPEG_ROW_COMPLETED;
+  return JPEG_SCAN_COMPLETED;
+}
+
 #endif /* D_MULTISCAN_FILES_SUPPORTED */
 
 
@@ -648,14 +859,33 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     int ci, access_rows;
     jpeg_component_info *compptr;
 
+    coef->dc_only = DC_ONLY_DECOMPRESS(cinfo);
     for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
          ci++, compptr++) {
       access_rows = compptr->v_samp_factor;
+      if (coef->dc_only) {
+        /* Keep one coefficient per block, DCTSIZE2 of them to a JBLOCK. */
+        coef->whole_image[ci] = (*cinfo->mem->request_virt_barray)
+          ((j_common_ptr) cinfo, JPOOL_IMAGE, TRUE,
+           (JDIMENSION) jdiv_round_up(jround_up((long) compptr->width_in_blocks,
+                                                (long) compptr->h_samp_factor),
+                                      (long) DCTSIZE2),
+           (JDIMENSION) jround_up((long) compptr->height_in_blocks,
+                                  (long) compptr->v_samp_factor),
+           (JDIMENSION) access_rows);
+        continue;
+      }
 #ifdef BLOCK_SMOOTHING_SUPPORTED
       /* If block smoothing could be used, need a bigger window */
       if (cinfo->progressive_mode)
         access_rows *= 3;
 #endif
+      /* Decoding restart intervals on worker threads accesses the whole
+       * image at once.
+       */
+      if (cinfo->master->parallel_restarts)
+        access_rows = (int) jround_up((long) compptr->height_in_blocks,
+                                      (long) compptr->v_samp_factor);
       coef->whole_image[ci] = (*cinfo->mem->request_virt_barray)
         ((j_common_ptr) cinfo, JPOOL_IMAGE, TRUE,
          (JDIMENSION) jround_up((long) compptr->width_in_blocks,
@@ -664,8 +894,22 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
                                 (long) compptr->v_samp_factor),
          (JDIMENSION) access_rows);
     }
-    coef->pub.consume_data = consume_data;
-    coef->pub.decompress_data = decompress_data;
+    if (coef->dc_only) {
+      JBLOCKROW buffer;
+      int i;
+
+      buffer = (JBLOCKROW)
+        (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                    D_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
+      for (i = 0; i < D_MAX_BLOCKS_IN_MCU; i++) {
+        coef->MCU_buffer[i] = buffer + i;
+      }
+      coef->pub.consume_data = consume_dc_data;
+      coef->pub.decompress_data = decompress_dc_data;
+    } else {
+      coef->pub.consume_data = consume_data;
+      coef->pub.decompress_data = decompress_data;
+    }
     coef->pub.coef_arrays = coef->whole_image; /* link to virtual arrays */
 #else
     ERREXIT(cinfo, JERR_NOT_COMPILED);
@@ -681,6 +925,7 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     for (i = 0; i < D_MAX_BLOCKS_IN_MCU; i++) {
       coef->MCU_buffer[i] = buffer + i;
     }
+    coef->dc_only = FALSE;
     coef->pub.consume_data = dummy_consume_data;
     coef->pub.decompress_data = decompress_onepass;
     coef->pub.coef_arrays = NULL; /* flag for no virtual arrays */
@@ -48,6 +48,12 @@ typedef struct {
   jvirt_barray_ptr whole_image[MAX_COMPONENTS];
 #endif
 
+  /* In DC-only mode, the virtual arrays hold only the DC coefficient of each
+   * block, packed DCTSIZE2 to a JBLOCK, and MCU_buffer points to a one-MCU
+   * workspace as in single-pass mode.
+   */
+  boolean dc_only;
+
 #ifdef BLOCK_SMOOTHING_SUPPORTED
   /* When doing block smoothing, we latch coefficient Al values here */
   int *coef_bits_latch;
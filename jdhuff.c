@@ -22,6 +22,7 @@
 #include "jpeglib.h"
 #include "jdhuff.h"             /* Declarations shared with jdphuff.c */
 #include "jpegcomp.h"
+#include "jthread.h"
 #include "jstdhuff.c"
 
 
@@ -65,6 +66,14 @@ typedef struct {
 
   /* These fields are NOT loaded into local working state. */
   unsigned int restarts_to_go;  /* MCUs left in this restart interval */
+  JDIMENSION next_MCU;          /* # of MCUs decoded so far in this scan */
+
+  /* Random-access MCU index, if one is in use (see jpeg_huff_set_index) */
+  const JOCTET *index;          /* first checkpoint, or NULL if none */
+  JDIMENSION index_interval;    /* MCUs between checkpoints */
+  const JOCTET *scan_start;     /* first byte of entropy-coded data */
+  size_t scan_length;           /* # of bytes of entropy-coded data */
+  size_t scan_bytes;            /* # of bytes in buffer from scan_start */
 
   /* Pointers to derived tables (these workspaces have image lifespan) */
   d_derived_tbl *dc_derived_tbls[NUM_HUFF_TBLS];
@@ -141,6 +150,90 @@ start_pass_huff_decoder (j_decompress_ptr cinfo)
 
   /* Initialize restart counter */
   entropy->restarts_to_go = cinfo->restart_interval;
+  entropy->next_MCU = 0;
+}
+
+
+/*
+ * Build the multi-symbol lookahead table (see jdhuff.h for the layout.)
+ * Rather than decoding each of the 1<<HUFF_FAST_BITS possible bit patterns,
+ * we enumerate the events that fit and fill in the range of entries that
+ * begins with each one.  The second event of an AC entry is enumerated in
+ * the same way within the range of the first.
+ */
+
+/* Figure F.12: extend sign bit (for s > 0) */
+#define FAST_EXTEND(v,s)  ((v) < (1 << ((s) - 1)) ? (v) - (1 << (s)) + 1 : (v))
+
+LOCAL(void)
+make_fast_tbl (d_derived_tbl *dtbl, boolean isDC, const char *huffsize,
+               const unsigned int *huffcode, int numsymbols)
+{
+  unsigned int *fast = dtbl->fast;
+  const UINT8 *huffval = dtbl->pub->huffval;
+  int p1, p2, l1, l2, r1, r2, s1, s2, m1, m2, nb1, nb2, i;
+  int base1, base2, span1, span2;
+  unsigned int e1, e2;
+
+  MEMZERO(fast, sizeof(dtbl->fast));
+
+  for (p1 = 0; p1 < numsymbols && huffsize[p1] <= HUFF_FAST_BITS; p1++) {
+    l1 = huffsize[p1];
+    r1 = isDC ? 0 : huffval[p1] >> 4;
+    s1 = isDC ? huffval[p1] : huffval[p1] & 15;
+
+    if (!isDC && s1 == 0 && r1 != 15) {
+      /* EOB */
+      base1 = huffcode[p1] << (HUFF_FAST_BITS - l1);
+      span1 = 1 << (HUFF_FAST_BITS - l1);
+      for (i = 0; i < span1; i++)
+        fast[base1 + i] = FAST_EOB1 | (r1 << 8) | l1;
+      continue;
+    }
+    nb1 = l1 + s1;
+    if (s1 > 8 || nb1 > HUFF_FAST_BITS)
+      continue;
+
+    for (m1 = 0; m1 < (1 << s1); m1++) {
+      base1 = ((huffcode[p1] << s1) | m1) << (HUFF_FAST_BITS - nb1);
+      span1 = 1 << (HUFF_FAST_BITS - nb1);
+      e1 = (s1 ? (unsigned int) FAST_EXTEND(m1, s1) << 23 : 0) | (r1 << 8) |
+           nb1;
+      for (i = 0; i < span1; i++)
+        fast[base1 + i] = e1;
+      if (isDC)
+        continue;
+
+      /* Second event, decoded from the bits that remain */
+      for (p2 = 0; p2 < numsymbols && huffsize[p2] <= HUFF_FAST_BITS - nb1;
+           p2++) {
+        l2 = huffsize[p2];
+        r2 = huffval[p2] >> 4;
+        s2 = huffval[p2] & 15;
+
+        if (s2 == 0 && r2 != 15) {
+          base2 = base1 | (huffcode[p2] << (HUFF_FAST_BITS - nb1 - l2));
+          span2 = 1 << (HUFF_FAST_BITS - nb1 - l2);
+          for (i = 0; i < span2; i++)
+            fast[base2 + i] |= FAST_EOB2 | (r2 << 12) | (l2 << 4);
+          continue;
+        }
+        nb2 = l2 + s2;
+        if (s2 > 4 || nb1 + nb2 > HUFF_FAST_BITS)
+          continue;
+
+        for (m2 = 0; m2 < (1 << s2); m2++) {
+          base2 = base1 | (((huffcode[p2] << s2) | m2) <<
+                           (HUFF_FAST_BITS - nb1 - nb2));
+          span2 = 1 << (HUFF_FAST_BITS - nb1 - nb2);
+          e2 = (s2 ? ((unsigned int) FAST_EXTEND(m2, s2) & 0x1F) << 18 : 0) |
+               (r2 << 12) | (nb2 << 4);
+          for (i = 0; i < span2; i++)
+            fast[base2 + i] |= e2;
+        }
+      }
+    }
+  }
 }
 
 
@@ -270,6 +363,9 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
         ERREXIT(cinfo, JERR_BAD_HUFF_TABLE);
     }
   }
+
+  /* Compute the multi-symbol lookahead table. */
+  make_fast_tbl(dtbl, isDC, huffsize, huffcode, numsymbols);
 }
 
 
@@ -321,6 +417,27 @@ jpeg_fill_bit_buffer (bitread_working_state *state,
         next_input_byte = cinfo->src->next_input_byte;
         bytes_in_buffer = cinfo->src->bytes_in_buffer;
       }
+
+      /* If the next word of input contains no 0xFF byte, load as many of its
+       * bytes as fit in get_buffer without checking them one at a time.
+       */
+      if (bytes_in_buffer >= sizeof(size_t)) {
+        size_t w;
+
+        MEMCOPY(&w, next_input_byte, sizeof(size_t));
+        if (!HAS_FF_BYTE(w)) {
+          int n = (BIT_BUF_SIZE - bits_left) >> 3;
+
+          if (n > (int) sizeof(size_t))
+            n = (int) sizeof(size_t);
+          bytes_in_buffer -= n;
+          bits_left += n * 8;
+          while (n-- > 0)
+            get_buffer = (get_buffer << 8) | GETJOCTET(*next_input_byte++);
+          continue;
+        }
+      }
+
       bytes_in_buffer--;
       c = GETJOCTET(*next_input_byte++);
 
@@ -396,50 +513,6 @@ jpeg_fill_bit_buffer (bitread_working_state *state,
 }
 
 
-/* Macro version of the above, which performs much better but does not
-   handle markers.  We have to hand off any blocks with markers to the
-   slower routines. */
-
-#define GET_BYTE \
-{ \
-  register int c0, c1; \
-  c0 = GETJOCTET(*buffer++); \
-  c1 = GETJOCTET(*buffer); \
-  /* Pre-execute most common case */ \
-  get_buffer = (get_buffer << 8) | c0; \
-  bits_left += 8; \
-  if (c0 == 0xFF) { \
-    /* Pre-execute case of FF/00, which represents an FF data byte */ \
-    buffer++; \
-    if (c1 != 0) { \
-      /* Oops, it's actually a marker indicating end of compressed data. */ \
-      cinfo->unread_marker = c1; \
-      /* Back out pre-execution and fill the buffer with zero bits */ \
-      buffer -= 2; \
-      get_buffer &= ~0xFF; \
-    } \
-  } \
-}
-
-#if SIZEOF_SIZE_T==8 || defined(_WIN64)
-
-/* Pre-fetch 48 bytes, because the holding register is 64-bit */
-#define FILL_BIT_BUFFER_FAST \
-  if (bits_left <= 16) { \
-    GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE \
-  }
-
-#else
-
-/* Pre-fetch 16 bytes, because the holding register is 32-bit */
-#define FILL_BIT_BUFFER_FAST \
-  if (bits_left <= 16) { \
-    GET_BYTE GET_BYTE \
-  }
-
-#endif
-
-
 /*
  * Out-of-line code for Huffman code decoding.
  * See jdhuff.h for info about usage.
@@ -668,12 +741,24 @@ decode_mcu_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     d_derived_tbl *dctbl = entropy->dc_cur_tbls[blkn];
     d_derived_tbl *actbl = entropy->ac_cur_tbls[blkn];
     register int s, k, r, l;
+    register unsigned int e;
 
-    HUFF_DECODE_FAST(s, l, dctbl);
-    if (s) {
-      FILL_BIT_BUFFER_FAST
-      r = GET_BITS(s);
-      s = HUFF_EXTEND(r, s);
+    /* Most DC differences and AC run/value pairs are decoded, along with
+     * their magnitude bits, by a single lookup in the multi-symbol table.
+     * The rest take the symbol-at-a-time path.
+     */
+    FILL_BIT_BUFFER_FAST;
+    e = dctbl->fast[PEEK_BITS(HUFF_FAST_BITS)];
+    if (e) {
+      DROP_BITS(FAST_NB1(e));
+      s = FAST_VAL1(e);
+    } else {
+      HUFF_DECODE_FAST(s, l, dctbl);
+      if (s) {
+        FILL_BIT_BUFFER_FAST
+        r = GET_BITS(s);
+        s = HUFF_EXTEND(r, s);
+      }
     }
 
     if (entropy->dc_needed[blkn]) {
@@ -687,6 +772,25 @@ decode_mcu_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     if (entropy->ac_needed[blkn] && block) {
 
       for (k = 1; k < DCTSIZE2; k++) {
+        FILL_BIT_BUFFER_FAST;
+        e = actbl->fast[PEEK_BITS(HUFF_FAST_BITS)];
+        if (e) {
+          DROP_BITS(FAST_NB1(e));
+          if (e & FAST_EOB1) break;
+          k += FAST_RUN1(e);
+          (*block)[jpeg_natural_order[k]] = (JCOEF) FAST_VAL1(e);
+          /* The second event belongs to this block only if the first one
+           * didn't fill it.
+           */
+          if (FAST_NB2(e) && k < DCTSIZE2 - 1) {
+            DROP_BITS(FAST_NB2(e));
+            if (e & FAST_EOB2) break;
+            k += FAST_RUN2(e) + 1;
+            (*block)[jpeg_natural_order[k]] = (JCOEF) FAST_VAL2(e);
+          }
+          continue;
+        }
+
         HUFF_DECODE_FAST(s, l, actbl);
         r = s >> 4;
         s &= 15;
@@ -706,6 +810,20 @@ decode_mcu_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     } else {
 
       for (k = 1; k < DCTSIZE2; k++) {
+        FILL_BIT_BUFFER_FAST;
+        e = actbl->fast[PEEK_BITS(HUFF_FAST_BITS)];
+        if (e) {
+          DROP_BITS(FAST_NB1(e));
+          if (e & FAST_EOB1) break;
+          k += FAST_RUN1(e);
+          if (FAST_NB2(e) && k < DCTSIZE2 - 1) {
+            DROP_BITS(FAST_NB2(e));
+            if (e & FAST_EOB2) break;
+            k += FAST_RUN2(e) + 1;
+          }
+          continue;
+        }
+
         HUFF_DECODE_FAST(s, l, actbl);
         r = s >> 4;
         s &= 15;
@@ -787,7 +905,723 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 
   /* Account for restart interval (no-op if not using restarts) */
   entropy->restarts_to_go--;
+  entropy->next_MCU++;
+
+  return TRUE;
+}
+
+
+/*
+ * Multi-threaded decoding of restart intervals.
+ *
+ * The entropy-coded data of a scan with a restart interval consists of
+ * independent segments separated by RSTn markers, each of which starts with
+ * an empty bit buffer and zero DC predictions.  If the whole scan is already
+ * in the source buffer (as is the case with a memory source), we locate the
+ * segments up front, decode them concurrently straight into the coefficient
+ * arrays, and leave the source positioned at the marker that ends the scan.
+ *
+ * The segment decoder touches neither the data source nor the error handler.
+ * If anything is amiss (an RSTn marker that is missing or out of sequence, a
+ * bad Huffman code, a segment that ends too early or has data left over), we
+ * give up and let decode_mcu() handle the scan, so that damaged files produce
+ * the same warnings and output as they otherwise would.
+ */
+
+typedef struct {
+  const JOCTET *start;          /* first byte of entropy-coded data */
+  const JOCTET *end;            /* first byte of the marker that follows */
+} restart_segment;
+
+typedef struct {
+  j_decompress_ptr cinfo;
+  JBLOCKARRAY *buffer;          /* coefficient arrays, indexed by scan comp */
+  restart_segment *segs;
+  JDIMENSION num_segs;
+  JDIMENSION segs_per_task;
+  JDIMENSION total_MCUs;
+  volatile int failed;          /* set by any task that gives up */
+} restart_job;
+
+
+/*
+ * Locate the segments of the scan in the source buffer.  Returns the number
+ * of segments found, or 0 if the data does not consist of exactly num_segs
+ * segments with RSTn markers in the proper sequence, followed by some other
+ * marker, within the source buffer.
+ */
+
+LOCAL(JDIMENSION)
+find_restart_segments (j_decompress_ptr cinfo, restart_segment *segs,
+                       JDIMENSION num_segs)
+{
+  const JOCTET *p = cinfo->src->next_input_byte;
+  const JOCTET *buf_end = p + cinfo->src->bytes_in_buffer;
+  const JOCTET *q;
+  JDIMENSION n = 0;
+  int c;
+
+  segs[0].start = p;
+  while (p < buf_end) {
+    p += jfind_ff(p, (size_t) (buf_end - p));
+    if (p >= buf_end)
+      break;
+    /* Skip any fill bytes and look at what follows the 0xFF */
+    q = p + 1;
+    while (q < buf_end && GETJOCTET(*q) == 0xFF)
+      q++;
+    if (q >= buf_end)
+      return 0;
+    c = GETJOCTET(*q);
+    if (c == 0) {
+      p = q + 1;                /* stuffed data byte */
+      continue;
+    }
+    segs[n].end = p;
+    if (++n == num_segs)        /* the marker that ends the scan */
+      return (c < JPEG_RST0 || c > JPEG_RST0 + 7) ? n : 0;
+    if (c != JPEG_RST0 + (int) ((n - 1) & 7))
+      return 0;
+    segs[n].start = p = q + 1;
+  }
+  return 0;
+}
+
+
+#define GET_BYTE_SEGMENT \
+{ \
+  register int c0 = 0; \
+  if (buffer < buffer_end) { \
+    c0 = GETJOCTET(*buffer++); \
+    /* find_restart_segments() established that a data byte of 0xFF is \
+     * followed by a stuffed zero (possibly after fill bytes) */ \
+    if (c0 == 0xFF) { \
+      while (GETJOCTET(*buffer) == 0xFF) \
+        buffer++; \
+      buffer++; \
+    } \
+  } else \
+    pad_bits += 8; \
+  get_buffer = (get_buffer << 8) | c0; \
+  bits_left += 8; \
+}
+
+#if SIZEOF_SIZE_T==8 || defined(_WIN64)
+#define FILL_BIT_BUFFER_SEGMENT \
+  if (bits_left <= 16) { \
+    GET_BYTE_SEGMENT GET_BYTE_SEGMENT GET_BYTE_SEGMENT \
+    GET_BYTE_SEGMENT GET_BYTE_SEGMENT GET_BYTE_SEGMENT \
+  }
+#else
+#define FILL_BIT_BUFFER_SEGMENT \
+  if (bits_left <= 16) { \
+    GET_BYTE_SEGMENT GET_BYTE_SEGMENT \
+  }
+#endif
+
+/* Like HUFF_DECODE_FAST, but rejects invalid codes */
+#define HUFF_DECODE_SEGMENT(s,nb,htbl) \
+  FILL_BIT_BUFFER_SEGMENT; \
+  s = PEEK_BITS(HUFF_LOOKAHEAD); \
+  s = htbl->lookup[s]; \
+  nb = s >> HUFF_LOOKAHEAD; \
+  DROP_BITS(nb); \
+  s = s & ((1 << HUFF_LOOKAHEAD) - 1); \
+  if (nb > HUFF_LOOKAHEAD) { \
+    s = (get_buffer >> bits_left) & ((1 << (nb)) - 1); \
+    while (s > htbl->maxcode[nb]) { \
+      s <<= 1; \
+      s |= GET_BITS(1); \
+      nb++; \
+    } \
+    if (nb > 16) \
+      return FALSE; \
+    s = htbl->pub->huffval[ (int) (s + htbl->valoffset[nb]) & 0xFF ]; \
+  }
+
+
+/*
+ * Decode one segment into the coefficient arrays.  Returns FALSE if the
+ * segment cannot be decoded exactly as decode_mcu() would without warnings.
+ */
+
+LOCAL(boolean)
+decode_restart_segment (restart_job *job, JDIMENSION seg)
+{
+  j_decompress_ptr cinfo = job->cinfo;
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  const JOCTET *buffer = job->segs[seg].start;
+  const JOCTET *buffer_end = job->segs[seg].end;
+  register bit_buf_type get_buffer = 0;
+  register int bits_left = 0;
+  int pad_bits = 0;             /* # of zero bits inserted past buffer_end */
+  int last_dc_val[MAX_COMPS_IN_SCAN];
+  JDIMENSION MCU_num, last_MCU, MCU_row, MCU_col;
+  int blkn, ci;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+    last_dc_val[ci] = 0;
+
+  MCU_num = seg * cinfo->restart_interval;
+  last_MCU = MIN(MCU_num + cinfo->restart_interval, job->total_MCUs);
+
+  for (; MCU_num < last_MCU; MCU_num++) {
+    MCU_row = MCU_num / cinfo->MCUs_per_row;
+    MCU_col = MCU_num % cinfo->MCUs_per_row;
+
+    blkn = 0;
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      jpeg_component_info *compptr = cinfo->cur_comp_info[ci];
+      int xindex, yindex;
+
+      for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+        JBLOCKROW block_row = job->buffer[ci][MCU_row * compptr->MCU_height +
+                                              yindex] +
+                              MCU_col * compptr->MCU_width;
+
+        for (xindex = 0; xindex < compptr->MCU_width; xindex++, blkn++) {
+          JBLOCKROW block = block_row + xindex;
+          d_derived_tbl *dctbl = entropy->dc_cur_tbls[blkn];
+          d_derived_tbl *actbl = entropy->ac_cur_tbls[blkn];
+          register int s, k, r, l;
+
+          HUFF_DECODE_SEGMENT(s, l, dctbl);
+          if (s) {
+            FILL_BIT_BUFFER_SEGMENT
+            r = GET_BITS(s);
+            s = HUFF_EXTEND(r, s);
+          }
+
+          if (entropy->dc_needed[blkn]) {
+            s += last_dc_val[ci];
+            last_dc_val[ci] = s;
+            (*block)[0] = (JCOEF) s;
+          }
+
+          if (entropy->ac_needed[blkn]) {
+
+            for (k = 1; k < DCTSIZE2; k++) {
+              HUFF_DECODE_SEGMENT(s, l, actbl);
+              r = s >> 4;
+              s &= 15;
+
+              if (s) {
+                k += r;
+                FILL_BIT_BUFFER_SEGMENT
+                r = GET_BITS(s);
+                s = HUFF_EXTEND(r, s);
+                (*block)[jpeg_natural_order[k]] = (JCOEF) s;
+              } else {
+                if (r != 15) break;
+                k += 15;
+              }
+            }
+
+          } else {
+
+            for (k = 1; k < DCTSIZE2; k++) {
+              HUFF_DECODE_SEGMENT(s, l, actbl);
+              r = s >> 4;
+              s &= 15;
+
+              if (s) {
+                k += r;
+                FILL_BIT_BUFFER_SEGMENT
+                DROP_BITS(s);
+              } else {
+                if (r != 15) break;
+                k += 15;
+              }
+            }
+          }
+        }
+      }
+    }
+
+    /* decode_mcu() would have warned about running out of data */
+    if (pad_bits > bits_left)
+      return FALSE;
+  }
+
+  /* ... or about extraneous data before the RSTn marker.  (We don't check
+   * the final segment, since decode_mcu() doesn't either.)
+   */
+  if (seg < job->num_segs - 1 &&
+      (buffer < buffer_end || bits_left - pad_bits >= 8))
+    return FALSE;
+
+  return TRUE;
+}
+
+
+METHODDEF(void)
+restart_task (void *arg, int task, int worker)
+{
+  restart_job *job = (restart_job *) arg;
+  JDIMENSION seg = (JDIMENSION) task * job->segs_per_task;
+  JDIMENSION last_seg = MIN(seg + job->segs_per_task, job->num_segs);
+
+  for (; seg < last_seg && !job->failed; seg++) {
+    if (! decode_restart_segment(job, seg))
+      job->failed = TRUE;
+  }
+}
+
+
+/*
+ * Decode the whole current scan into the coefficient arrays buffer[] (one per
+ * component in the scan, covering the whole image) using worker threads.
+ * This must be called at the start of the scan, before any MCU has been
+ * decoded.  Returns FALSE, without consuming any input and leaving the
+ * coefficient arrays zeroed, if this is not possible.
+ */
+
+GLOBAL(boolean)
+jpeg_huff_decode_restarts_mt (j_decompress_ptr cinfo, JBLOCKARRAY *buffer)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  restart_job job;
+  JDIMENSION MCU_num, MCU_row, MCU_col;
+  int num_tasks, ci, yindex;
+  size_t used;
+
+  if (cinfo->restart_interval == 0 || cinfo->unread_marker != 0 ||
+      entropy->bitstate.bits_left != 0 || entropy->pub.insufficient_data)
+    return FALSE;
+
+  job.cinfo = cinfo;
+  job.buffer = buffer;
+  job.total_MCUs = cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan;
+  job.num_segs = (job.total_MCUs + cinfo->restart_interval - 1) /
+                 cinfo->restart_interval;
+  job.segs = (restart_segment *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                job.num_segs * sizeof(restart_segment));
+  if (find_restart_segments(cinfo, job.segs, job.num_segs) != job.num_segs)
+    return FALSE;
+
+  /* Give each worker several tasks, so that the load stays balanced even if
+   * the segments differ in size.
+   */
+  num_tasks = cinfo->master->num_threads * 4;
+  if ((JDIMENSION) num_tasks > job.num_segs)
+    num_tasks = (int) job.num_segs;
+  job.segs_per_task = (job.num_segs + num_tasks - 1) / num_tasks;
+  num_tasks = (int) ((job.num_segs + job.segs_per_task - 1) /
+                     job.segs_per_task);
+  job.failed = FALSE;
+
+  jthread_run_tasks(cinfo->master->num_threads, num_tasks, restart_task,
+                    &job);
+
+  if (job.failed) {
+    /* Undo any partial decoding; the serial path expects zeroed blocks */
+    for (MCU_num = 0; MCU_num < job.total_MCUs; MCU_num++) {
+      MCU_row = MCU_num / cinfo->MCUs_per_row;
+      MCU_col = MCU_num % cinfo->MCUs_per_row;
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        jpeg_component_info *compptr = cinfo->cur_comp_info[ci];
+
+        for (yindex = 0; yindex < compptr->MCU_height; yindex++)
+          jzero_far((void *) (buffer[ci][MCU_row * compptr->MCU_height +
+                                         yindex] +
+                              MCU_col * compptr->MCU_width),
+                    compptr->MCU_width * sizeof(JBLOCK));
+      }
+    }
+    return FALSE;
+  }
+
+  /* Leave the source positioned at the marker that ends the scan */
+  used = (size_t) (job.segs[job.num_segs - 1].end -
+                   cinfo->src->next_input_byte);
+  cinfo->src->next_input_byte += used;
+  cinfo->src->bytes_in_buffer -= used;
+  return TRUE;
+}
+
+
+/*
+ * Random-access MCU index.
+ *
+ * An MCU can be decoded only once its position in the bit stream and the DC
+ * predictions it starts with are known, and normally the only way to find
+ * them is to decode all of the MCUs before it.  The index records this state
+ * at regular MCU intervals ("checkpoints"), so that the decoder can resume at
+ * the nearest checkpoint instead.  The restart state at a checkpoint follows
+ * from its MCU number; a checkpoint at the start of a restart interval lies
+ * just past the RSTn marker.
+ *
+ * The index is built in a single pass over a scan that is entirely in the
+ * source buffer, by reading it in the same way as the segment decoder above,
+ * and is serialized as
+ * follows (all values little-endian):
+ *
+ *   header:      INDEX_MAGIC, image_width, image_height, restart_interval,
+ *                total # of MCUs, # of bytes of entropy-coded data,
+ *                checkpoint interval, # of checkpoints and comps_in_scan
+ *                (32 bits each)
+ *   checkpoints: bit position within the entropy-coded data (32 bits),
+ *                followed by the DC prediction for each component in the
+ *                scan (16 bits each)
+ */
+
+#define INDEX_MAGIC        0x5849434DL  /* "MCIX" */
+#define INDEX_HEADER_SIZE  36
+#define CHECKPOINT_SIZE(ncomps)  (4 + 2 * (ncomps))
+
+LOCAL(void)
+put_uint32 (JOCTET *p, unsigned long v)
+{
+  p[0] = (JOCTET) (v & 0xFF);
+  p[1] = (JOCTET) ((v >> 8) & 0xFF);
+  p[2] = (JOCTET) ((v >> 16) & 0xFF);
+  p[3] = (JOCTET) ((v >> 24) & 0xFF);
+}
+
+LOCAL(unsigned long)
+get_uint32 (const JOCTET *p)
+{
+  return (unsigned long) GETJOCTET(p[0]) |
+         ((unsigned long) GETJOCTET(p[1]) << 8) |
+         ((unsigned long) GETJOCTET(p[2]) << 16) |
+         ((unsigned long) GETJOCTET(p[3]) << 24);
+}
+
+
+/*
+ * Back up over n data bytes, given a pointer to the byte that follows them.
+ * A data byte of 0xFF is stored as 0xFF, possibly some fill bytes, and a
+ * stuffed zero, none of which can otherwise follow 0xFF within a segment.
+ */
+
+LOCAL(const JOCTET *)
+back_up_data_bytes (const JOCTET *p, int n)
+{
+  while (n-- > 0) {
+    p--;
+    if (GETJOCTET(p[0]) == 0 && GETJOCTET(p[-1]) == 0xFF) {
+      p--;
+      while (GETJOCTET(p[-1]) == 0xFF)
+        p--;
+    }
+  }
+  return p;
+}
+
+
+/*
+ * Decode one segment for the index, recording a checkpoint at the start of
+ * each MCU whose number is a multiple of interval.  Returns FALSE if the
+ * segment cannot be decoded without warnings.
+ */
+
+LOCAL(boolean)
+index_restart_segment (j_decompress_ptr cinfo, restart_segment *segs,
+                       JDIMENSION seg, JDIMENSION num_segs,
+                       JDIMENSION total_MCUs, JDIMENSION interval,
+                       JOCTET *checkpoints)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  const JOCTET *scan_start = segs[0].start;
+  const JOCTET *buffer = segs[seg].start;
+  const JOCTET *buffer_end = segs[seg].end;
+  register bit_buf_type get_buffer = 0;
+  register int bits_left = 0;
+  int pad_bits = 0;             /* # of zero bits inserted past buffer_end */
+  int last_dc_val[MAX_COMPS_IN_SCAN];
+  JDIMENSION MCU_num, last_MCU;
+  int blkn, ci;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+    last_dc_val[ci] = 0;
+
+  if (cinfo->restart_interval) {
+    MCU_num = seg * cinfo->restart_interval;
+    last_MCU = MIN(MCU_num + cinfo->restart_interval, total_MCUs);
+  } else {
+    MCU_num = 0;
+    last_MCU = total_MCUs;
+  }
+
+  for (; MCU_num < last_MCU; MCU_num++) {
+    if (MCU_num % interval == 0) {
+      /* The next unread bit lies within the data byte that begins at pos */
+      JOCTET *ckpt = checkpoints +
+        (MCU_num / interval) * CHECKPOINT_SIZE(cinfo->comps_in_scan);
+      int unread = bits_left - pad_bits;
+      const JOCTET *pos = buffer;
+      int bit = 0;
+
+      if (unread > 0) {
+        pos = back_up_data_bytes(buffer, (unread + 7) / 8);
+        bit = (8 - unread % 8) % 8;
+      }
+      put_uint32(ckpt, (unsigned long) (pos - scan_start) * 8 + bit);
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        if (last_dc_val[ci] < -32768 || last_dc_val[ci] > 32767)
+          return FALSE;
+        ckpt[4 + ci * 2] = (JOCTET) (last_dc_val[ci] & 0xFF);
+        ckpt[5 + ci * 2] = (JOCTET) ((last_dc_val[ci] >> 8) & 0xFF);
+      }
+    }
+
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
+      d_derived_tbl *dctbl = entropy->dc_cur_tbls[blkn];
+      d_derived_tbl *actbl = entropy->ac_cur_tbls[blkn];
+      register int s, k, r, l;
+
+      HUFF_DECODE_SEGMENT(s, l, dctbl);
+      if (s) {
+        FILL_BIT_BUFFER_SEGMENT
+        r = GET_BITS(s);
+        s = HUFF_EXTEND(r, s);
+      }
+      /* Track the DC predictions even for components we don't need now */
+      ci = cinfo->MCU_membership[blkn];
+      last_dc_val[ci] += s;
+
+      for (k = 1; k < DCTSIZE2; k++) {
+        HUFF_DECODE_SEGMENT(s, l, actbl);
+        r = s >> 4;
+        s &= 15;
+
+        if (s) {
+          k += r;
+          FILL_BIT_BUFFER_SEGMENT
+          DROP_BITS(s);
+        } else {
+          if (r != 15) break;
+          k += 15;
+        }
+      }
+    }
+
+    if (pad_bits > bits_left)
+      return FALSE;
+  }
+
+  if (seg < num_segs - 1 &&
+      (buffer < buffer_end || bits_left - pad_bits >= 8))
+    return FALSE;
+
+  return TRUE;
+}
+
+
+/*
+ * Build an index for the current scan.  This must be called at the start of
+ * the scan, before any MCU has been decoded, and consumes no input.  The
+ * index is returned in a buffer allocated with malloc(), which the caller
+ * must free().  Returns FALSE if the scan is not entirely in the source
+ * buffer or cannot be decoded without warnings.
+ */
+
+GLOBAL(boolean)
+jpeg_huff_build_index (j_decompress_ptr cinfo, JDIMENSION interval,
+                       unsigned char **outbuffer, unsigned long *outsize)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  restart_segment *segs;
+  JDIMENSION total_MCUs, num_segs, num_checkpoints, seg;
+  size_t scan_length, size;
+  JOCTET *index;
+
+  if (interval == 0 || entropy->next_MCU != 0 || cinfo->unread_marker != 0 ||
+      entropy->bitstate.bits_left != 0 || entropy->pub.insufficient_data)
+    return FALSE;
+
+  total_MCUs = cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan;
+  if (interval > total_MCUs)
+    interval = total_MCUs;
+  num_segs = 1;
+  if (cinfo->restart_interval)
+    num_segs = (total_MCUs + cinfo->restart_interval - 1) /
+               cinfo->restart_interval;
+  segs = (restart_segment *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                num_segs * sizeof(restart_segment));
+  if (find_restart_segments(cinfo, segs, num_segs) != num_segs)
+    return FALSE;
+  /* Bit positions must fit in 32 bits */
+  scan_length = (size_t) (segs[num_segs - 1].end - segs[0].start);
+  if (scan_length >= 0x20000000L)
+    return FALSE;
+
+  num_checkpoints = (total_MCUs + interval - 1) / interval;
+  size = INDEX_HEADER_SIZE +
+         (size_t) num_checkpoints * CHECKPOINT_SIZE(cinfo->comps_in_scan);
+  index = (JOCTET *) malloc(size);
+  if (index == NULL)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+
+  for (seg = 0; seg < num_segs; seg++) {
+    if (! index_restart_segment(cinfo, segs, seg, num_segs, total_MCUs,
+                                interval, index + INDEX_HEADER_SIZE)) {
+      free(index);
+      return FALSE;
+    }
+  }
+
+  put_uint32(index, INDEX_MAGIC);
+  put_uint32(index + 4, (unsigned long) cinfo->image_width);
+  put_uint32(index + 8, (unsigned long) cinfo->image_height);
+  put_uint32(index + 12, (unsigned long) cinfo->restart_interval);
+  put_uint32(index + 16, (unsigned long) total_MCUs);
+  put_uint32(index + 20, (unsigned long) scan_length);
+  put_uint32(index + 24, (unsigned long) interval);
+  put_uint32(index + 28, (unsigned long) num_checkpoints);
+  put_uint32(index + 32, (unsigned long) cinfo->comps_in_scan);
+
+  *outbuffer = index;
+  *outsize = (unsigned long) size;
+  return TRUE;
+}
+
+
+/*
+ * Start using an index built by jpeg_huff_build_index(), which must remain
+ * valid until the scan has been decoded.  Like jpeg_huff_build_index(), this
+ * must be called at the start of the scan.  Returns FALSE if the index does
+ * not match the scan or if the scan is not entirely in the source buffer.
+ */
+
+GLOBAL(boolean)
+jpeg_huff_set_index (j_decompress_ptr cinfo, const unsigned char *index,
+                     unsigned long indexsize)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  const JOCTET *scan_start = cinfo->src->next_input_byte;
+  size_t scan_bytes = cinfo->src->bytes_in_buffer;
+  JDIMENSION total_MCUs = cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan;
+  unsigned long scan_length, interval, num_checkpoints, bitpos, i;
+  size_t ckpt_size = CHECKPOINT_SIZE(cinfo->comps_in_scan);
+
+  if (entropy->next_MCU != 0 || cinfo->unread_marker != 0 ||
+      entropy->bitstate.bits_left != 0 || entropy->pub.insufficient_data)
+    return FALSE;
+
+  if (indexsize < INDEX_HEADER_SIZE ||
+      get_uint32(index) != INDEX_MAGIC ||
+      get_uint32(index + 4) != (unsigned long) cinfo->image_width ||
+      get_uint32(index + 8) != (unsigned long) cinfo->image_height ||
+      get_uint32(index + 12) != (unsigned long) cinfo->restart_interval ||
+      get_uint32(index + 16) != (unsigned long) total_MCUs ||
+      get_uint32(index + 32) != (unsigned long) cinfo->comps_in_scan)
+    return FALSE;
+  scan_length = get_uint32(index + 20);
+  interval = get_uint32(index + 24);
+  num_checkpoints = get_uint32(index + 28);
+  if (interval == 0 || interval > total_MCUs ||
+      num_checkpoints != (total_MCUs + interval - 1) / interval ||
+      (indexsize - INDEX_HEADER_SIZE) / ckpt_size < num_checkpoints)
+    return FALSE;
 
+  /* The scan must be followed by a marker within the source buffer */
+  if (scan_length >= scan_bytes || GETJOCTET(scan_start[scan_length]) != 0xFF)
+    return FALSE;
+  index += INDEX_HEADER_SIZE;
+  for (i = 0; i < num_checkpoints; i++) {
+    bitpos = get_uint32(index + i * ckpt_size);
+    if ((bitpos >> 3) + ((bitpos & 7) ? 1 : 0) > scan_length)
+      return FALSE;
+  }
+
+  entropy->index = index;
+  entropy->index_interval = (JDIMENSION) interval;
+  entropy->scan_start = scan_start;
+  entropy->scan_length = (size_t) scan_length;
+  entropy->scan_bytes = scan_bytes;
+  return TRUE;
+}
+
+
+/*
+ * Restore the decoder state recorded at a checkpoint.
+ */
+
+LOCAL(void)
+restore_checkpoint (j_decompress_ptr cinfo, JDIMENSION checkpoint)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  const JOCTET *ckpt = entropy->index +
+    checkpoint * CHECKPOINT_SIZE(cinfo->comps_in_scan);
+  JDIMENSION MCU_num = checkpoint * entropy->index_interval;
+  unsigned long bitpos = get_uint32(ckpt);
+  size_t offset = (size_t) (bitpos >> 3);
+  int ci, c;
+
+  entropy->bitstate.get_buffer = 0;
+  entropy->bitstate.bits_left = 0;
+  if (bitpos & 7) {
+    /* Load the partly consumed data byte, skipping any stuffing */
+    c = GETJOCTET(entropy->scan_start[offset++]);
+    if (c == 0xFF) {
+      while (offset < entropy->scan_length &&
+             GETJOCTET(entropy->scan_start[offset]) == 0xFF)
+        offset++;
+      offset++;
+    }
+    entropy->bitstate.get_buffer = (bit_buf_type) c;
+    entropy->bitstate.bits_left = 8 - (int) (bitpos & 7);
+  }
+  cinfo->src->next_input_byte = entropy->scan_start + offset;
+  cinfo->src->bytes_in_buffer = entropy->scan_bytes - offset;
+  cinfo->unread_marker = 0;
+  entropy->pub.insufficient_data = FALSE;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+    entropy->saved.last_dc_val[ci] =
+      (int) (short) (GETJOCTET(ckpt[4 + ci * 2]) |
+                     (GETJOCTET(ckpt[5 + ci * 2]) << 8));
+
+  if (cinfo->restart_interval) {
+    entropy->restarts_to_go = cinfo->restart_interval -
+                              MCU_num % cinfo->restart_interval;
+    cinfo->marker->next_restart_num =
+      (int) ((MCU_num / cinfo->restart_interval) & 7);
+  }
+  entropy->next_MCU = MCU_num;
+}
+
+
+/*
+ * Position the decoder so that the next call to decode_mcu() decodes MCU
+ * number MCU_num of the scan, resuming at the nearest checkpoint if that
+ * saves decoding MCUs.  If MCU_num is the number of MCUs in the scan, the
+ * source is instead positioned at the marker that ends the scan.  Returns
+ * FALSE if the data source requested suspension.
+ */
+
+GLOBAL(boolean)
+jpeg_huff_seek_mcu (j_decompress_ptr cinfo, JDIMENSION MCU_num)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  JDIMENSION total_MCUs = cinfo->MCUs_per_row * cinfo->MCU_rows_in_scan;
+  JDIMENSION checkpoint;
+
+  if (MCU_num >= total_MCUs) {
+    if (entropy->next_MCU < total_MCUs) {
+      cinfo->src->next_input_byte = entropy->scan_start +
+                                    entropy->scan_length;
+      cinfo->src->bytes_in_buffer = entropy->scan_bytes -
+                                    entropy->scan_length;
+      cinfo->unread_marker = 0;
+      entropy->bitstate.bits_left = 0;
+      entropy->next_MCU = total_MCUs;
+    }
+    return TRUE;
+  }
+
+  checkpoint = MCU_num / entropy->index_interval;
+  if (MCU_num < entropy->next_MCU ||
+      checkpoint * entropy->index_interval > entropy->next_MCU)
+    restore_checkpoint(cinfo, checkpoint);
+
+  while (entropy->next_MCU < MCU_num) {
+    if (! decode_mcu(cinfo, NULL))
+      return FALSE;
+  }
   return TRUE;
 }
 
@@ -819,4 +1653,5 @@ jinit_huff_decoder (j_decompress_ptr cinfo)
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
     entropy->dc_derived_tbls[i] = entropy->ac_derived_tbls[i] = NULL;
   }
+  entropy->index = NULL;
 }
@@ -19,6 +19,7 @@
 /* Derived data constructed for each Huffman table */
 
 #define HUFF_LOOKAHEAD  8       /* # of bits of lookahead */
+#define HUFF_FAST_BITS  11      /* # of bits of multi-symbol lookahead */
 
 typedef struct {
   /* Basic tables: (element [0] of each array is unused) */
@@ -44,8 +45,39 @@ typedef struct {
    * symbol.
    */
   int lookup[1<<HUFF_LOOKAHEAD];
+
+  /* Multi-symbol lookahead table: indexed by the next HUFF_FAST_BITS bits
+   * of the input data stream.  Each entry decodes up to two events, where an
+   * event is a Huffman code together with the magnitude bits that follow it,
+   * provided that they all fit in HUFF_FAST_BITS bits.  For a DC table, the
+   * event is the (sign-extended) DC difference.  For an AC table, the first
+   * event is a run of zeroes followed by a coefficient value, or an EOB; if
+   * the first event is not an EOB, there may be a second one, which is
+   * restricted to small values.  (A ZRL is treated as a run of 15 zeroes
+   * followed by a zero coefficient.)  The zero run of an EOB event holds the
+   * r of the EOBr symbol, which the progressive decoder needs.
+   *
+   *   bits 0-3    # of bits in the first event (0 if no entry)
+   *   bits 4-7    # of bits in the second event (0 if none)
+   *   bits 8-11   zero run of the first event
+   *   bits 12-15  zero run of the second event
+   *   bit 16      first event is an EOB
+   *   bit 17      second event is an EOB
+   *   bits 18-22  value of the second event (-15..15)
+   *   bits 23-31  value of the first event (-255..255)
+   */
+  unsigned int fast[1<<HUFF_FAST_BITS];
 } d_derived_tbl;
 
+#define FAST_NB1(e)   ((int) ((e) & 15))
+#define FAST_NB2(e)   ((int) (((e) >> 4) & 15))
+#define FAST_RUN1(e)  ((int) (((e) >> 8) & 15))
+#define FAST_RUN2(e)  ((int) (((e) >> 12) & 15))
+#define FAST_EOB1     0x10000
+#define FAST_EOB2     0x20000
+#define FAST_VAL1(e)  (((int) (e)) >> 23)
+#define FAST_VAL2(e)  (((int) ((e) << 9)) >> 27)
+
 /* Expand a Huffman table definition into the derived format */
 EXTERN(void) jpeg_make_d_derived_tbl
         (j_decompress_ptr cinfo, boolean isDC, int tblno,
@@ -208,6 +240,83 @@ slowlabel: \
   } \
 }
 
+/*
+ * Macro version of jpeg_fill_bit_buffer(), which performs much better but
+ * does not handle markers.  These macros use the local variable "buffer" in
+ * place of br_state.next_input_byte and may run up to 8 bytes past the data
+ * they actually consume, so the caller must ensure that plenty of data
+ * remains in the source buffer.  If a marker is reached, cinfo->unread_marker
+ * is set and zeroes are returned from then on; the caller is expected to
+ * discard its work and hand off to the slower routines.
+ */
+
+#define GET_BYTE \
+{ \
+  register int c0, c1; \
+  c0 = GETJOCTET(*buffer++); \
+  c1 = GETJOCTET(*buffer); \
+  /* Pre-execute most common case */ \
+  get_buffer = (get_buffer << 8) | c0; \
+  bits_left += 8; \
+  if (c0 == 0xFF) { \
+    /* Pre-execute case of FF/00, which represents an FF data byte */ \
+    buffer++; \
+    if (c1 != 0) { \
+      /* Oops, it's actually a marker indicating end of compressed data. */ \
+      cinfo->unread_marker = c1; \
+      /* Back out pre-execution and fill the buffer with zero bits */ \
+      buffer -= 2; \
+      get_buffer &= ~0xFF; \
+    } \
+  } \
+}
+
+#if SIZEOF_SIZE_T==8 || defined(_WIN64)
+
+/* The first 6 bytes of the 8-byte word w, loaded from buffer, as a 48-bit
+   big-endian value */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define FIRST_48_BITS(w)  ((bit_buf_type) (__builtin_bswap64(w) >> 16))
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+      __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FIRST_48_BITS(w)  ((bit_buf_type) ((w) >> 16))
+#else
+#define FIRST_48_BITS(w) \
+  (((bit_buf_type) GETJOCTET(buffer[0]) << 40) | \
+   ((bit_buf_type) GETJOCTET(buffer[1]) << 32) | \
+   ((bit_buf_type) GETJOCTET(buffer[2]) << 24) | \
+   ((bit_buf_type) GETJOCTET(buffer[3]) << 16) | \
+   ((bit_buf_type) GETJOCTET(buffer[4]) << 8) | \
+   (bit_buf_type) GETJOCTET(buffer[5]))
+#endif
+
+/* Pre-fetch 48 bits, because the holding register is 64-bit.  If none of the
+   next 8 bytes is 0xFF (by far the most common case), there is no stuffed
+   byte or marker to deal with, so the 6 bytes are loaded in one go. */
+#define FILL_BIT_BUFFER_FAST \
+  if (bits_left <= 16) { \
+    size_t w; \
+    MEMCOPY(&w, buffer, sizeof(size_t)); \
+    if (!HAS_FF_BYTE(w)) { \
+      get_buffer = (get_buffer << 48) | FIRST_48_BITS(w); \
+      buffer += 6; \
+      bits_left += 48; \
+    } else { \
+      GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE \
+    } \
+  }
+
+#else
+
+/* Pre-fetch 16 bytes, because the holding register is 32-bit */
+#define FILL_BIT_BUFFER_FAST \
+  if (bits_left <= 16) { \
+    GET_BYTE GET_BYTE \
+  }
+
+#endif
+
 #define HUFF_DECODE_FAST(s,nb,htbl) \
   FILL_BIT_BUFFER_FAST; \
   s = PEEK_BITS(HUFF_LOOKAHEAD); \
@@ -896,12 +896,17 @@ next_marker (j_decompress_ptr cinfo)
   for (;;) {
     INPUT_BYTE(cinfo, c, return FALSE);
     /* Skip any non-FF bytes.
-     * This may look a bit inefficient, but it will not occur in a valid file.
-     * We sync after each discarded byte so that a suspending data source
-     * can discard the byte from its buffer.
+     * This will not occur in a valid file, but corrupt data can contain a
+     * lot of it, so we skip whatever is in the buffer in bulk.
+     * We sync after discarding so that a suspending data source can discard
+     * the bytes from its buffer.
      */
     while (c != 0xFF) {
-      cinfo->marker->discarded_bytes++;
+      size_t n = jfind_ff(next_input_byte, bytes_in_buffer);
+
+      cinfo->marker->discarded_bytes += 1 + (unsigned int) n;
+      next_input_byte += n;
+      bytes_in_buffer -= n;
       INPUT_SYNC(cinfo);
       INPUT_BYTE(cinfo, c, return FALSE);
     }
@@ -1156,6 +1161,52 @@ read_restart_marker (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Skip over the entropy-coded data of the current scan without decoding it.
+ * Returns FALSE if suspension is required.
+ *
+ * This is called by the coefficient controller in DC-only mode, for scans
+ * that carry no DC coefficients.  Stuffed zero bytes (FF/00) and restart
+ * markers are part of the scan data, so they are skipped silently.  We stop
+ * at the first other marker, leaving it in cinfo->unread_marker for
+ * read_markers to process.
+ */
+
+METHODDEF(boolean)
+skip_scan_data (j_decompress_ptr cinfo)
+{
+  int c;
+  INPUT_VARS(cinfo);
+
+  for (;;) {
+    /* Skip the data bytes preceding the next FF in bulk, syncing after each
+     * buffer load so that a suspending data source can discard them.
+     */
+    MAKE_BYTE_AVAIL(cinfo, return FALSE);
+    if (GETJOCTET(*next_input_byte) != 0xFF) {
+      size_t n = jfind_ff(next_input_byte, bytes_in_buffer);
+
+      next_input_byte += n;
+      bytes_in_buffer -= n;
+      INPUT_SYNC(cinfo);
+      continue;
+    }
+    /* Swallow the FF along with any fill bytes after it. */
+    do {
+      INPUT_BYTE(cinfo, c, return FALSE);
+    } while (c == 0xFF);
+    if (c != 0 && (c < (int) M_RST0 || c > (int) M_RST7))
+      break;                    /* found the end of the scan */
+    INPUT_SYNC(cinfo);
+  }
+
+  cinfo->unread_marker = c;
+
+  INPUT_SYNC(cinfo);
+  return TRUE;
+}
+
+
 /*
  * This is the default resync_to_restart method for data source managers
  * to use if they don't have any better approach.  Some data source managers
@@ -1290,6 +1341,7 @@ jinit_marker_reader (j_decompress_ptr cinfo)
   marker->pub.reset_marker_reader = reset_marker_reader;
   marker->pub.read_markers = read_markers;
   marker->pub.read_restart_marker = read_restart_marker;
+  marker->pub.skip_scan_data = skip_scan_data;
   /* Initialize COM/APPn processing.
    * By default, we examine and then discard APP0 and APP14,
    * but simply discard COM and all other APPn.
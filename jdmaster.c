@@ -281,7 +281,10 @@ jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
     int ssize = cinfo->_min_DCT_scaled_size;
-    while (ssize < DCTSIZE &&
+    /* In DC-only mode, every component is reduced to one sample per block,
+     * since the chroma components have no AC coefficients to scale up with.
+     */
+    while (ssize < DCTSIZE && !DC_ONLY_DECOMPRESS(cinfo) &&
            ((cinfo->max_h_samp_factor * cinfo->_min_DCT_scaled_size) %
             (compptr->h_samp_factor * ssize * 2) == 0) &&
            ((cinfo->max_v_samp_factor * cinfo->_min_DCT_scaled_size) %
@@ -550,7 +553,19 @@ master_selection (j_decompress_ptr cinfo)
   }
 
   /* Initialize principal buffer controllers. */
-  use_c_buffer = cinfo->inputctl->has_multiple_scans || cinfo->buffered_image;
+  /* Restart intervals can be decoded on worker threads only if the whole
+   * (single) sequential Huffman scan is decoded into the coefficient buffer.
+   */
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+  cinfo->master->parallel_restarts = cinfo->master->num_threads > 1 &&
+    cinfo->restart_interval > 0 && !cinfo->progressive_mode &&
+    !cinfo->arith_code && !cinfo->inputctl->has_multiple_scans &&
+    !cinfo->buffered_image && !DC_ONLY_DECOMPRESS(cinfo);
+#else
+  cinfo->master->parallel_restarts = FALSE;
+#endif
+  use_c_buffer = cinfo->inputctl->has_multiple_scans ||
+                 cinfo->buffered_image || cinfo->master->parallel_restarts;
   jinit_d_coef_controller(cinfo, use_c_buffer);
 
   if (! cinfo->raw_data_out)
@@ -567,6 +582,7 @@ master_selection (j_decompress_ptr cinfo)
    */
   cinfo->master->first_iMCU_col = 0;
   cinfo->master->last_iMCU_col = cinfo->MCUs_per_row - 1;
+  cinfo->master->use_mcu_index = FALSE;
 
 #ifdef D_MULTISCAN_FILES_SUPPORTED
   /* If jpeg_start_decompress will read the whole file, initialize
@@ -25,6 +25,18 @@
 
 #ifdef D_PROGRESSIVE_SUPPORTED
 
+/* The fast path for AC refinement scans keeps a bitmap of the nonzero
+ * coefficients of a block in a single word, and it tests four coefficients at
+ * a time by loading them into a word.  This requires 64-bit words and a
+ * little-endian byte order.
+ */
+
+#if (SIZEOF_SIZE_T == 8 && defined(__BYTE_ORDER__) && \
+     __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN64)
+#define FAST_REFINE_SUPPORTED
+#endif
+
+
 /*
  * Expanded entropy decoder object for progressive Huffman decoding.
  *
@@ -72,6 +84,13 @@ typedef struct {
   d_derived_tbl *derived_tbls[NUM_HUFF_TBLS];
 
   d_derived_tbl *ac_derived_tbl; /* active table during an AC scan */
+
+#ifdef FAST_REFINE_SUPPORTED
+  /* zigzag_bits[r][b] is the zigzag-order bitmap of the coefficients in row r
+   * of a block whose columns are the set bits of b (built on first use)
+   */
+  size_t (*zigzag_bits)[256];
+#endif
 } phuff_entropy_decoder;
 
 typedef phuff_entropy_decoder *phuff_entropy_ptr;
@@ -91,6 +110,43 @@ METHODDEF(boolean) decode_mcu_AC_refine (j_decompress_ptr cinfo,
  * Initialize for a Huffman-compressed scan.
  */
 
+#ifdef FAST_REFINE_SUPPORTED
+
+/*
+ * Build the table that converts the nonzero coefficients of a block row,
+ * given as a byte with one bit per column, into a zigzag-order bitmap.
+ */
+
+LOCAL(void)
+build_zigzag_bits (j_decompress_ptr cinfo)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  int zigzag[DCTSIZE2];
+  int k, row, b, col;
+  size_t bits;
+
+  entropy->zigzag_bits = (size_t (*)[256])
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                DCTSIZE * 256 * sizeof(size_t));
+
+  for (k = 0; k < DCTSIZE2; k++)
+    zigzag[jpeg_natural_order[k]] = k;
+
+  for (row = 0; row < DCTSIZE; row++) {
+    for (b = 0; b < 256; b++) {
+      bits = 0;
+      for (col = 0; col < DCTSIZE; col++) {
+        if (b & (1 << col))
+          bits |= (size_t) 1 << zigzag[row * DCTSIZE + col];
+      }
+      entropy->zigzag_bits[row][b] = bits;
+    }
+  }
+}
+
+#endif
+
+
 METHODDEF(void)
 start_pass_phuff_decoder (j_decompress_ptr cinfo)
 {
@@ -179,6 +235,10 @@ start_pass_phuff_decoder (j_decompress_ptr cinfo)
       jpeg_make_d_derived_tbl(cinfo, FALSE, tbl, pdtbl);
       /* remember the single active table */
       entropy->ac_derived_tbl = entropy->derived_tbls[tbl];
+#ifdef FAST_REFINE_SUPPORTED
+      if (cinfo->Ah != 0 && entropy->zigzag_bits == NULL)
+        build_zigzag_bits(cinfo);
+#endif
     }
     /* Initialize DC predictions to 0 */
     entropy->saved.last_dc_val[ci] = 0;
@@ -354,6 +414,303 @@ decode_mcu_DC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+/*
+ * Fast paths for the AC scans.  These are used when there is plenty of data
+ * in the source buffer and no marker has been reached, so that the bit
+ * buffer can be refilled in bulk (see FILL_BIT_BUFFER_FAST in jdhuff.h) and
+ * a Huffman code can be decoded, along with its magnitude bits, by a single
+ * lookup in the multi-symbol table.  If a marker or corrupt data is
+ * encountered, they return FALSE without having updated the permanent state,
+ * and the caller decodes the MCU again using the regular code, which knows
+ * how to deal with those.  That includes cinfo->unread_marker, which the
+ * bulk refill may have set (the caller only uses the fast paths when it is
+ * 0): the regular code must see the marker in the data stream again rather
+ * than take it as already read.
+ */
+
+#define BUFSIZE (DCTSIZE2 * 8)
+
+LOCAL(boolean)
+decode_mcu_AC_first_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  int Se = cinfo->Se;
+  int Al = cinfo->Al;
+  register int s, k, r, l;
+  register unsigned int e;
+  int eobr = -1;
+  unsigned int EOBRUN;
+  JBLOCKROW block = MCU_data[0];
+  BITREAD_STATE_VARS;
+  JOCTET *buffer;
+  d_derived_tbl *tbl = entropy->ac_derived_tbl;
+
+  EOBRUN = entropy->saved.EOBRUN;
+  if (EOBRUN > 0) {             /* band of zeroes, nothing to decode */
+    entropy->saved.EOBRUN = EOBRUN - 1;
+    return TRUE;
+  }
+
+  BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
+  buffer = (JOCTET *) br_state.next_input_byte;
+
+  for (k = cinfo->Ss; k <= Se; k++) {
+    FILL_BIT_BUFFER_FAST;
+    e = tbl->fast[PEEK_BITS(HUFF_FAST_BITS)];
+    if (e & FAST_EOB1) {
+      DROP_BITS(FAST_NB1(e));
+      eobr = FAST_RUN1(e);
+      break;
+    }
+    if (e) {
+      /* A ZRL has a value of 0 and stores nothing, since the coefficient
+       * at the end of the run may lie outside of the band.
+       */
+      DROP_BITS(FAST_NB1(e));
+      k += FAST_RUN1(e);
+      if ((s = FAST_VAL1(e)) != 0)
+        (*block)[jpeg_natural_order[k]] = (JCOEF) LEFT_SHIFT(s, Al);
+      if (FAST_NB2(e) && k < Se) {
+        DROP_BITS(FAST_NB2(e));
+        if (e & FAST_EOB2) {
+          eobr = FAST_RUN2(e);
+          break;
+        }
+        k += FAST_RUN2(e) + 1;
+        if ((s = FAST_VAL2(e)) != 0)
+          (*block)[jpeg_natural_order[k]] = (JCOEF) LEFT_SHIFT(s, Al);
+      }
+      continue;
+    }
+
+    HUFF_DECODE_FAST(s, l, tbl);
+    if (l > 16)                 /* invalid code */
+      goto bailout;
+    r = s >> 4;
+    s &= 15;
+    if (s) {
+      k += r;
+      FILL_BIT_BUFFER_FAST;
+      r = GET_BITS(s);
+      s = HUFF_EXTEND(r, s);
+      (*block)[jpeg_natural_order[k]] = (JCOEF) LEFT_SHIFT(s, Al);
+    } else if (r == 15) {       /* ZRL */
+      k += 15;
+    } else {
+      eobr = r;
+      break;
+    }
+  }
+
+  if (eobr >= 0) {              /* EOBr, run length is 2^r + appended bits */
+    EOBRUN = 1 << eobr;
+    if (eobr) {
+      FILL_BIT_BUFFER_FAST;
+      EOBRUN += GET_BITS(eobr);
+    }
+    EOBRUN--;                   /* this band is processed at this moment */
+  }
+
+  if (cinfo->unread_marker != 0)
+    goto bailout;
+
+  br_state.bytes_in_buffer -= (buffer - br_state.next_input_byte);
+  br_state.next_input_byte = buffer;
+  BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
+  entropy->saved.EOBRUN = EOBRUN;
+  return TRUE;
+
+bailout:
+  cinfo->unread_marker = 0;
+  return FALSE;
+}
+
+
+#ifdef FAST_REFINE_SUPPORTED
+
+#if defined(__GNUC__)
+#define COUNT_TRAILING_ZEROS(x)  __builtin_ctzll((unsigned long long) (x))
+#else
+#define COUNT_TRAILING_ZEROS(x)  count_trailing_zeros(x)
+
+LOCAL(int)
+count_trailing_zeros (size_t x)
+{
+  int n = 0;
+
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
+#endif
+
+/* Given a word w holding four coefficients, return a 4-bit mask of the
+ * nonzero ones.  The high bit of each 16-bit lane is set if the lane is
+ * nonzero, and a multiply gathers those bits into the top nibble.
+ */
+#define LANE_ONES  ((size_t) ~((size_t) 0) / 0xFFFF)  /* 0x0001000100010001 */
+#define NONZERO_LANES(w) \
+  ((int) (((((((w) & (LANE_ONES * 0x7FFF)) + LANE_ONES * 0x7FFF) | (w)) >> \
+            15 & LANE_ONES) * (((size_t) 1 << 48) | ((size_t) 1 << 33) | \
+                               ((size_t) 1 << 18) | 8)) >> 48))
+
+/* Append a correction bit to each already-nonzero coefficient whose zigzag
+ * position is set in bitmap m, clearing m.  A correction bit is 1 if the
+ * absolute value of the coefficient must be increased.
+ */
+#define CORRECT_NONZERO(m) \
+  while (m) { \
+    thiscoef = *block + jpeg_natural_order[COUNT_TRAILING_ZEROS(m)]; \
+    m &= m - 1; \
+    FILL_BIT_BUFFER_FAST; \
+    if (GET_BITS(1) && (*thiscoef & p1) == 0) /* do nothing if already set */ \
+      *thiscoef += (JCOEF) (*thiscoef >= 0 ? p1 : m1); \
+  }
+
+/* Rather than stepping through the band one coefficient at a time, the
+ * refinement fast path works from bitmaps of the nonzero and zero
+ * coefficients in zigzag order, so that the end of a run and the coefficients
+ * that receive correction bits can be found directly.
+ */
+
+LOCAL(boolean)
+decode_mcu_AC_refine_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  int Se = cinfo->Se;
+  int p1 = 1 << cinfo->Al;        /* 1 in the bit position being coded */
+  int m1 = (NEG_1) << cinfo->Al;  /* -1 in the bit position being coded */
+  register int s, k, r, l;
+  register unsigned int e;
+  unsigned int EOBRUN;
+  boolean eob;
+  size_t nonzero, zero, m;
+  JBLOCKROW block = MCU_data[0];
+  JCOEFPTR thiscoef;
+  BITREAD_STATE_VARS;
+  JOCTET *buffer;
+  d_derived_tbl *tbl = entropy->ac_derived_tbl;
+  int num_newnz = 0;
+  int newnz_pos[DCTSIZE2];
+
+  BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
+  buffer = (JOCTET *) br_state.next_input_byte;
+  EOBRUN = entropy->saved.EOBRUN;
+
+  k = cinfo->Ss;
+
+  /* Bitmaps of the nonzero and zero coefficients in the band */
+  nonzero = 0;
+  for (r = 0; r < DCTSIZE; r++) {
+    MEMCOPY(&m, &(*block)[r * DCTSIZE], sizeof(size_t));
+    l = NONZERO_LANES(m);
+    MEMCOPY(&m, &(*block)[r * DCTSIZE + 4], sizeof(size_t));
+    nonzero |= entropy->zigzag_bits[r][l | NONZERO_LANES(m) << 4];
+  }
+  m = (((size_t) 2 << Se) - 1) & ((~(size_t) 0) << k);
+  nonzero &= m;
+  zero = ~nonzero & m;
+
+  if (EOBRUN == 0) {
+    while (k <= Se) {
+      /* Correction bits follow each code, so only the first event of a
+       * multi-symbol table entry is usable, and only if it is an EOBr, a ZRL,
+       * or a newly nonzero coefficient of size 1.  Anything else takes the
+       * symbol-at-a-time path.
+       */
+      FILL_BIT_BUFFER_FAST;
+      e = tbl->fast[PEEK_BITS(HUFF_FAST_BITS)];
+      s = FAST_VAL1(e);
+      if (e != 0 && s >= -1 && s <= 1) {
+        DROP_BITS(FAST_NB1(e));
+        r = FAST_RUN1(e);
+        eob = (e & FAST_EOB1) != 0;
+        if (s > 0)
+          s = p1;
+        else if (s < 0)
+          s = m1;
+      } else {
+        HUFF_DECODE_FAST(s, l, tbl);
+        r = s >> 4;
+        s &= 15;
+        if (l > 16 || s > 1)    /* invalid code or bad coefficient size */
+          goto undoit;
+        if (s)                  /* at least 1 bit remains after the code */
+          s = GET_BITS(1) ? p1 : m1;
+        eob = (s == 0 && r != 15);
+      }
+      if (eob) {
+        EOBRUN = 1 << r;        /* EOBr, run length is 2^r + appended bits */
+        if (r) {
+          FILL_BIT_BUFFER_FAST;
+          EOBRUN += GET_BITS(r);
+        }
+        break;                  /* rest of block is handled by EOB logic */
+      }
+      /* Find the (r+1)th zero coefficient at or after k, which is the target
+       * of the run.  Running off the end of the band never happens with valid
+       * data, so leave that to decode_mcu_AC_refine().
+       */
+      m = zero;
+      while (r-- > 0)
+        m &= m - 1;
+      if (m == 0)
+        goto undoit;
+      r = COUNT_TRAILING_ZEROS(m);
+      zero = m & (m - 1);       /* the zeroes after the target */
+      /* Advance over the already-nonzero coefs before the target */
+      m = nonzero & (((size_t) 1 << r) - 1) & ((~(size_t) 0) << k);
+      CORRECT_NONZERO(m);
+      if (s) {
+        int pos = jpeg_natural_order[r];
+        /* Output newly nonzero coefficient */
+        (*block)[pos] = (JCOEF) s;
+        /* Remember its position in case we have to back out */
+        newnz_pos[num_newnz++] = pos;
+      }
+      k = r + 1;
+    }
+  }
+
+  if (EOBRUN > 0) {
+    /* Append correction bits to the nonzero coefficients that remain after
+     * the end-of-band (the ones made nonzero above lie before k.)
+     */
+    if (k <= Se) {
+      m = nonzero & ((~(size_t) 0) << k);
+      CORRECT_NONZERO(m);
+    }
+    /* Count one block completed in EOB run */
+    EOBRUN--;
+  }
+
+  if (cinfo->unread_marker != 0)
+    goto undoit;
+
+  br_state.bytes_in_buffer -= (buffer - br_state.next_input_byte);
+  br_state.next_input_byte = buffer;
+  BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
+  entropy->saved.EOBRUN = EOBRUN;
+  return TRUE;
+
+undoit:
+  /* Re-zero any output coefficients that we made newly nonzero */
+  while (num_newnz > 0)
+    (*block)[newnz_pos[--num_newnz]] = 0;
+
+  cinfo->unread_marker = 0;
+  return FALSE;
+}
+
+#else
+
+#define decode_mcu_AC_refine_fast(cinfo, MCU_data)  FALSE
+
+#endif /* FAST_REFINE_SUPPORTED */
+
+
 /*
  * MCU decoding for AC initial scan (either spectral selection,
  * or first pass of successive approximation).
@@ -370,18 +727,24 @@ decode_mcu_AC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   JBLOCKROW block;
   BITREAD_STATE_VARS;
   d_derived_tbl *tbl;
+  int usefast = 1;
 
   /* Process restart marker if needed; may have to suspend */
   if (cinfo->restart_interval) {
     if (entropy->restarts_to_go == 0)
       if (! process_restart(cinfo))
         return FALSE;
+    usefast = 0;
   }
 
+  if (cinfo->src->bytes_in_buffer < BUFSIZE || cinfo->unread_marker != 0)
+    usefast = 0;
+
   /* If we've run out of data, just leave the MCU set to zeroes.
    * This way, we return uniform gray for the remainder of the segment.
    */
-  if (! entropy->pub.insufficient_data) {
+  if (! entropy->pub.insufficient_data &&
+      ! (usefast && decode_mcu_AC_first_fast(cinfo, MCU_data))) {
 
     /* Load up working state.
      * We can avoid loading/saving bitread state if in an EOB run.
@@ -508,17 +871,23 @@ decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   d_derived_tbl *tbl;
   int num_newnz;
   int newnz_pos[DCTSIZE2];
+  int usefast = 1;
 
   /* Process restart marker if needed; may have to suspend */
   if (cinfo->restart_interval) {
     if (entropy->restarts_to_go == 0)
       if (! process_restart(cinfo))
         return FALSE;
+    usefast = 0;
   }
 
+  if (cinfo->src->bytes_in_buffer < BUFSIZE || cinfo->unread_marker != 0)
+    usefast = 0;
+
   /* If we've run out of data, don't modify the MCU.
    */
-  if (! entropy->pub.insufficient_data) {
+  if (! entropy->pub.insufficient_data &&
+      ! (usefast && decode_mcu_AC_refine_fast(cinfo, MCU_data))) {
 
     /* Load up working state */
     BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
@@ -660,6 +1029,9 @@ jinit_phuff_decoder (j_decompress_ptr cinfo)
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
     entropy->derived_tbls[i] = NULL;
   }
+#ifdef FAST_REFINE_SUPPORTED
+  entropy->zigzag_bits = NULL;
+#endif
 
   /* Create progression status table */
   cinfo->coef_bits = (int (*)[DCTSIZE2])
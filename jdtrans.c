@@ -101,6 +101,8 @@ transdecode_master_selection (j_decompress_ptr cinfo)
 {
   /* This is effectively a buffered-image operation. */
   cinfo->buffered_image = TRUE;
+  /* Whole DCT blocks must be kept, not just their DC coefficients. */
+  cinfo->master->dc_only = FALSE;
 
 #if JPEG_LIB_VERSION >= 80
   /* Compute output image dimensions and related values. */
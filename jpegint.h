@@ -81,6 +81,7 @@ struct jpeg_comp_master {
   boolean trellis_passes; /* TRUE=currently doing trellis-related passes [not exposed] */
   boolean trellis_q_opt; /* TRUE=optimize quant table in trellis loop */
   boolean overshoot_deringing; /* TRUE=preprocess input to reduce ringing of edges on white background */
+  boolean huff_table_library; /* TRUE=use pre-trained Huffman tables for sequential images */
 
   double norm_src[NUM_QUANT_TBLS][DCTSIZE2];
   double norm_coef[NUM_QUANT_TBLS][DCTSIZE2];
@@ -90,6 +91,12 @@ struct jpeg_comp_master {
   int quant_tbl_master_idx; /* Quantization table master index */
   int trellis_freq_split; /* splitting point for frequency in trellis quantization */
   int trellis_num_loops; /* number of trellis loops */
+  int num_threads; /* number of worker threads (1=single-threaded) */
+  int trellis_loops_used; /* number of trellis loops actually run [read-only] */
+  int scan_size_mode; /* how candidate scan sizes are found when optimizing scans */
+  int scan_buffer_limit; /* max. size of the scan buffer in kilobytes (0=no limit) */
+  int scan_buffer_peak; /* peak size of the scan buffer in kilobytes [read-only] */
+  int huff_table_mode; /* how optimized Huffman tables are generated */
 
   int num_scans_luma; /* # of entries in scan_info array pertaining to luma (used when optimize_scans is TRUE */
   int num_scans_luma_dc;
@@ -103,6 +110,9 @@ struct jpeg_comp_master {
   float lambda_log_scale2;
   
   float trellis_delta_dc_weight;
+  float trellis_loop_threshold; /* min. relative size reduction for another trellis loop */
+
+  double gather_bits; /* estimated size of the scan counted by the last statistics-gathering pass [not exposed] */
 };
 
 #ifdef C_ARITH_CODING_SUPPORTED
@@ -131,6 +141,28 @@ typedef struct {
 } arith_rates;
 #endif
 
+/* Scratch storage used by quantize_trellis() and quantize_trellis_arith()
+ * for one row of blocks.  The coefficient controller allocates one of these
+ * per worker thread from the image pool, sized for the widest component, so
+ * that the trellis quantizer never needs to allocate memory itself.
+ */
+
+#define DC_TRELLIS_MAX_CANDIDATES 9
+
+typedef struct {
+  JDIMENSION max_blocks;        /* # of blocks the arrays can hold */
+  /* Used if trellis_eob_opt is set */
+  float *accumulated_zero_block_cost;   /* max_blocks + 1 entries */
+  float *accumulated_block_cost;        /* max_blocks + 1 entries */
+  int *block_run_start;                 /* max_blocks entries */
+  int *requires_eob;                    /* max_blocks + 1 entries */
+  /* Used if trellis_quant_dc is set (dc_context only for arithmetic coding) */
+  float *accumulated_dc_cost[DC_TRELLIS_MAX_CANDIDATES];
+  int *dc_cost_backtrack[DC_TRELLIS_MAX_CANDIDATES];
+  JCOEF *dc_candidate[DC_TRELLIS_MAX_CANDIDATES];
+  int *dc_context[DC_TRELLIS_MAX_CANDIDATES];
+} trellis_workspace;
+
 /* Main buffer control (downsampled-data buffer) */
 struct jpeg_c_main_controller {
   void (*start_pass) (j_compress_ptr cinfo, J_BUF_MODE pass_mode);
@@ -148,10 +180,38 @@ struct jpeg_c_prep_controller {
                             JDIMENSION out_row_groups_avail);
 };
 
+/* Bitmaps of the coefficients of a block or of a spectral band are kept in
+ * arrays of BITMAP_WORDS size_t words.  Bit k % BITMAP_WORD_BITS of word
+ * k / BITMAP_WORD_BITS corresponds to the k'th coefficient of the block or
+ * band, in zigzag order.
+ */
+
+#define BITMAP_WORD_BITS  (8 * (int) sizeof(size_t))
+#define BITMAP_WORDS      (DCTSIZE2 / BITMAP_WORD_BITS)
+
+/* Side information about a block of quantized coefficients, which the
+ * coefficient controller computes once the coefficients are final, so that
+ * the passes of a progressive encode need not rediscover it (see jccoefct.c.)
+ * Bit k of nonzero[Al] is set if AC coefficient k is nonzero after the point
+ * transform by Al, that is, if its absolute value is at least 1 << Al.
+ */
+
+#define BLOCK_INFO_MAX_AL  3    /* bitmaps are kept for Al = 0..3 */
+
+typedef struct {
+  size_t nonzero[BLOCK_INFO_MAX_AL + 1][BITMAP_WORDS];
+} jblock_info;
+
 /* Coefficient buffer control */
 struct jpeg_c_coef_controller {
   void (*start_pass) (j_compress_ptr cinfo, J_BUF_MODE pass_mode);
   boolean (*compress_data) (j_compress_ptr cinfo, JSAMPIMAGE input_buf);
+
+  /* Side information for the blocks of the MCU being passed to the entropy
+   * encoder, in the same order as the blocks, or NULL if there is none in
+   * the current pass
+   */
+  jblock_info **MCU_info;
 };
 
 /* Colorspace conversion */
@@ -220,8 +280,27 @@ struct jpeg_decomp_master {
   JDIMENSION first_MCU_col[MAX_COMPS_IN_SCAN];
   JDIMENSION last_MCU_col[MAX_COMPS_IN_SCAN];
   boolean jinit_upsampler_no_alloc;
+
+  /* Multi-threaded decoding */
+  int num_threads;              /* number of worker threads (0 or 1=single) */
+  boolean parallel_restarts;    /* True to decode restart intervals on
+                                   worker threads (see jdhuff.c) */
+
+  /* Random-access decompression */
+  boolean use_mcu_index;        /* True to decode only the MCUs needed,
+                                   seeking via an MCU index (see jdhuff.c) */
+
+  /* DC-only decompression */
+  boolean dc_only;              /* True to decode only the DC coefficients
+                                   when scaling by 1/8 (see jdcoefct.c) */
 };
 
+/* DC-only decompression takes effect only if the output is scaled by 1/8,
+ * so that each DCT block is reduced to a single sample.
+ */
+#define DC_ONLY_DECOMPRESS(cinfo) \
+  ((cinfo)->master->dc_only && (cinfo)->_min_DCT_scaled_size == 1)
+
 /* Input control module */
 struct jpeg_input_controller {
   int (*consume_input) (j_decompress_ptr cinfo);
@@ -279,6 +358,11 @@ struct jpeg_marker_reader {
   boolean saw_SOF;              /* found SOF? */
   int next_restart_num;         /* next restart number expected (0-7) */
   unsigned int discarded_bytes; /* # of bytes skipped looking for a marker */
+
+  /* Skip the entropy-coded data of the current scan, up to the next marker
+   * other than RSTn --- exported for use by coefficient controller only
+   */
+  boolean (*skip_scan_data) (j_decompress_ptr cinfo);
 };
 
 /* Entropy decoding */
@@ -373,6 +457,8 @@ EXTERN(void) jinit_c_prep_controller (j_compress_ptr cinfo,
                                       boolean need_full_buffer);
 EXTERN(void) jinit_c_coef_controller (j_compress_ptr cinfo,
                                       boolean need_full_buffer);
+EXTERN(void) jinit_c_coef_controller_shared (j_compress_ptr cinfo,
+                                             j_compress_ptr src);
 EXTERN(void) jinit_color_converter (j_compress_ptr cinfo);
 EXTERN(void) jinit_downsampler (j_compress_ptr cinfo);
 EXTERN(void) jinit_forward_dct (j_compress_ptr cinfo);
@@ -391,6 +477,17 @@ EXTERN(void) jinit_d_post_controller (j_decompress_ptr cinfo,
 EXTERN(void) jinit_input_controller (j_decompress_ptr cinfo);
 EXTERN(void) jinit_marker_reader (j_decompress_ptr cinfo);
 EXTERN(void) jinit_huff_decoder (j_decompress_ptr cinfo);
+EXTERN(boolean) jpeg_huff_decode_restarts_mt (j_decompress_ptr cinfo,
+                                              JBLOCKARRAY *buffer);
+EXTERN(boolean) jpeg_huff_build_index (j_decompress_ptr cinfo,
+                                       JDIMENSION interval,
+                                       unsigned char **outbuffer,
+                                       unsigned long *outsize);
+EXTERN(boolean) jpeg_huff_set_index (j_decompress_ptr cinfo,
+                                     const unsigned char *index,
+                                     unsigned long indexsize);
+EXTERN(boolean) jpeg_huff_seek_mcu (j_decompress_ptr cinfo,
+                                    JDIMENSION MCU_num);
 EXTERN(void) jinit_phuff_decoder (j_decompress_ptr cinfo);
 EXTERN(void) jinit_arith_decoder (j_decompress_ptr cinfo);
 EXTERN(void) jinit_inverse_dct (j_decompress_ptr cinfo);
@@ -411,6 +508,18 @@ EXTERN(void) jcopy_sample_rows (JSAMPARRAY input_array, int source_row,
 EXTERN(void) jcopy_block_row (JBLOCKROW input_row, JBLOCKROW output_row,
                               JDIMENSION num_blocks);
 EXTERN(void) jzero_far (void *target, size_t bytestozero);
+EXTERN(size_t) jfind_ff (const JOCTET *buf, size_t len);
+/* Nonzero if any byte of the size_t word w is 0xFF.  (~w has a zero byte
+ * wherever w has an 0xFF byte, which the usual "has zero byte" test detects
+ * exactly.)
+ */
+#define WORD_ONES       ((size_t) ~((size_t) 0) / 0xFF)  /* 0x0101...01 */
+#define HAS_FF_BYTE(w)  ((~(w) - WORD_ONES) & (w) & (WORD_ONES << 7))
+/* Direct output in jdatadst.c */
+EXTERN(boolean) jpeg_write_direct (j_compress_ptr cinfo, const JOCTET *data,
+                                   size_t datacount);
+/* Pre-trained Huffman tables in jchufflib.c */
+EXTERN(boolean) jpeg_set_trained_huff_tables (j_compress_ptr cinfo);
 
 #ifdef C_ARITH_CODING_SUPPORTED
 EXTERN(void) jget_arith_rates (j_compress_ptr cinfo, int dc_tbl_no, int ac_tbl_no, arith_rates *r);
@@ -418,7 +527,7 @@ EXTERN(void) jget_arith_rates (j_compress_ptr cinfo, int dc_tbl_no, int ac_tbl_n
 EXTERN(void) quantize_trellis_arith
 (j_compress_ptr cinfo, arith_rates *r, JBLOCKROW coef_blocks, JBLOCKROW src, JDIMENSION num_blocks,
  JQUANT_TBL * qtbl, double *norm_src, double *norm_coef, JCOEF *last_dc_val,
- JBLOCKROW coef_blocks_above, JBLOCKROW src_above);
+ JBLOCKROW coef_blocks_above, JBLOCKROW src_above, trellis_workspace *ws);
 #endif
 
 /* Constant tables in jutils.c */
@@ -429,6 +538,7 @@ extern const int jpeg_natural_order[]; /* zigzag coef order to natural order */
 
 /* Arithmetic coding probability estimation tables in jaricom.c */
 extern const JLONG jpeg_aritab[];
+EXTERN(void) jpeg_make_arith_trans_tbl (JLONG *tbl);
 
 /* Suppress undefined-structure complaints if necessary. */
 
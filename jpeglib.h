@@ -283,7 +283,8 @@ typedef enum {
   JBOOLEAN_USE_LAMBDA_WEIGHT_TBL = 0x339DB65F, /* TRUE=use lambda weighting table */
   JBOOLEAN_USE_SCANS_IN_TRELLIS = 0xFD841435, /* TRUE=use scans in trellis optimization */
   JBOOLEAN_TRELLIS_Q_OPT = 0xE12AE269, /* TRUE=optimize quant table in trellis loop */
-  JBOOLEAN_OVERSHOOT_DERINGING = 0x3F4BBBF9 /* TRUE=preprocess input to reduce ringing of edges on white background */
+  JBOOLEAN_OVERSHOOT_DERINGING = 0x3F4BBBF9, /* TRUE=preprocess input to reduce ringing of edges on white background */
+  JBOOLEAN_HUFF_TABLE_LIBRARY = 0x92D5E07B /* TRUE=use pre-trained Huffman tables for sequential images */
 } J_BOOLEAN_PARAM;
 
 /* Floating point parameters */
@@ -291,7 +292,8 @@ typedef enum {
 typedef enum {
   JFLOAT_LAMBDA_LOG_SCALE1 = 0x5B61A599,
   JFLOAT_LAMBDA_LOG_SCALE2 = 0xB9BBAE03,
-  JFLOAT_TRELLIS_DELTA_DC_WEIGHT = 0x13775453
+  JFLOAT_TRELLIS_DELTA_DC_WEIGHT = 0x13775453,
+  JFLOAT_TRELLIS_LOOP_THRESHOLD = 0x2E8D5A17 /* min. relative size reduction for another trellis loop */
 } J_FLOAT_PARAM;
 
 /* Integer parameters */
@@ -301,7 +303,13 @@ typedef enum {
   JINT_TRELLIS_FREQ_SPLIT = 0x6FAFF127, /* splitting point for frequency in trellis quantization */
   JINT_TRELLIS_NUM_LOOPS = 0xB63EBF39, /* number of trellis loops */
   JINT_BASE_QUANT_TBL_IDX = 0x44492AB1, /* base quantization table index */
-  JINT_DC_SCAN_OPT_MODE = 0x0BE7AD3C /* DC scan optimization mode */
+  JINT_DC_SCAN_OPT_MODE = 0x0BE7AD3C, /* DC scan optimization mode */
+  JINT_NUM_THREADS = 0x7A4E1C52, /* number of worker threads (1=single-threaded) */
+  JINT_TRELLIS_LOOPS_USED = 0x93C1F06B, /* number of trellis loops actually run (read-only) */
+  JINT_SCAN_SIZE_MODE = 0x5D2B8E46, /* how candidate scan sizes are found when optimizing scans */
+  JINT_SCAN_BUFFER_LIMIT = 0x1F6C3A95, /* max. size of the scan buffer in kilobytes (0=no limit) */
+  JINT_SCAN_BUFFER_PEAK = 0xA47E02D8, /* peak size of the scan buffer in kilobytes (read-only) */
+  JINT_HUFF_TABLE_MODE = 0x6C03D2E9 /* how optimized Huffman tables are generated */
 } J_INT_PARAM;
 
 
@@ -1046,6 +1054,13 @@ EXTERN(JDIMENSION) jpeg_skip_scanlines (j_decompress_ptr cinfo,
                                         JDIMENSION num_lines);
 EXTERN(void) jpeg_crop_scanline (j_decompress_ptr cinfo, JDIMENSION *xoffset,
                                  JDIMENSION *width);
+EXTERN(boolean) jpeg_build_mcu_index (j_decompress_ptr cinfo,
+                                      JDIMENSION interval,
+                                      unsigned char **outbuffer,
+                                      unsigned long *outsize);
+EXTERN(boolean) jpeg_set_mcu_index (j_decompress_ptr cinfo,
+                                    const unsigned char *inbuffer,
+                                    unsigned long insize);
 EXTERN(boolean) jpeg_finish_decompress (j_decompress_ptr cinfo);
 
 /* Replaces jpeg_read_scanlines when reading raw downsampled data. */
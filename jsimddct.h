@@ -34,6 +34,19 @@ EXTERN(void) jsimd_quantize (JCOEFPTR coef_block, DCTELEM *divisors,
 EXTERN(void) jsimd_quantize_float (JCOEFPTR coef_block, FAST_FLOAT *divisors,
                                    FAST_FLOAT *workspace);
 
+EXTERN(int) jsimd_can_trellis_prep (void);
+EXTERN(int) jsimd_can_trellis_search (void);
+
+EXTERN(void) jsimd_trellis_prep (JCOEFPTR src, const int *q,
+                                 const float *lambda_tbl, float lambda,
+                                 int *qval, float *zero_dist);
+EXTERN(int) jsimd_trellis_search (int i, int num_preds, const int *preds,
+                                  int num_candidates,
+                                  const float *candidate_dist,
+                                  float *accumulated_cost,
+                                  const float *accumulated_zero_dist,
+                                  int *run_start, const char *ehufsi);
+
 EXTERN(int) jsimd_can_idct_2x2 (void);
 EXTERN(int) jsimd_can_idct_4x4 (void);
 EXTERN(int) jsimd_can_idct_6x6 (void);
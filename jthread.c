@@ -0,0 +1,195 @@
+/*
+ * jthread.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains a minimal fork/join helper for running independent
+ * tasks on worker threads.  See jthread.h for the calling conventions.
+ *
+ * Threads are created per call rather than kept in a persistent pool.  The
+ * stages that use this helper hand out at most a few calls per pass, each
+ * covering a whole image's worth of work, so thread creation cost is
+ * negligible and no thread ever outlives the library call that started it.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jconfigint.h"
+#include "jthread.h"
+
+#ifdef THREADS_SUPPORTED
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#endif
+
+
+/* Shared state for one jthread_run_tasks() call */
+
+typedef struct {
+  jthread_task_ptr task;
+  void *arg;
+  int num_tasks;
+#ifdef THREADS_SUPPORTED
+#ifdef _WIN32
+  volatile LONG next_task;
+#else
+  int next_task;
+  pthread_mutex_t lock;
+#endif
+#else
+  int next_task;
+#endif
+} task_queue;
+
+typedef struct {
+  task_queue *queue;
+  int worker;
+} worker_info;
+
+
+LOCAL(int)
+claim_task (task_queue *queue)
+/* Return the index of the next unclaimed task */
+{
+  int t;
+
+#ifdef THREADS_SUPPORTED
+#ifdef _WIN32
+  t = (int) InterlockedIncrement(&queue->next_task) - 1;
+#else
+  pthread_mutex_lock(&queue->lock);
+  t = queue->next_task++;
+  pthread_mutex_unlock(&queue->lock);
+#endif
+#else
+  t = queue->next_task++;
+#endif
+  return t;
+}
+
+
+LOCAL(void)
+run_worker (task_queue *queue, int worker)
+{
+  int t;
+
+  while ((t = claim_task(queue)) < queue->num_tasks)
+    (*queue->task) (queue->arg, t, worker);
+}
+
+
+#ifdef THREADS_SUPPORTED
+
+#ifdef _WIN32
+static DWORD WINAPI
+worker_main (LPVOID param)
+#else
+static void *
+worker_main (void *param)
+#endif
+{
+  worker_info *info = (worker_info *) param;
+
+  run_worker(info->queue, info->worker);
+  return 0;
+}
+
+#endif
+
+
+GLOBAL(void)
+jthread_run_tasks (int num_threads, int num_tasks, jthread_task_ptr task,
+                   void *arg)
+{
+  task_queue queue;
+#ifdef THREADS_SUPPORTED
+  worker_info *info = NULL;
+  int i, started = 0;
+#ifdef _WIN32
+  HANDLE *threads = NULL;
+#else
+  pthread_t *threads = NULL;
+#endif
+#endif
+
+  queue.task = task;
+  queue.arg = arg;
+  queue.num_tasks = num_tasks;
+  queue.next_task = 0;
+
+  if (num_threads > num_tasks)
+    num_threads = num_tasks;
+
+#ifdef THREADS_SUPPORTED
+#ifndef _WIN32
+  pthread_mutex_init(&queue.lock, NULL);
+#endif
+  if (num_threads > 1) {
+    /* Failure to allocate bookkeeping or to create a thread is not an error;
+     * it merely leaves more of the work for the calling thread.
+     */
+    info = (worker_info *) malloc((num_threads - 1) * sizeof(worker_info));
+    threads = malloc((num_threads - 1) * sizeof(*threads));
+    if (info != NULL && threads != NULL) {
+      for (i = 0; i < num_threads - 1; i++) {
+        info[i].queue = &queue;
+        info[i].worker = i + 1;
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, worker_main, &info[i], 0, NULL);
+        if (threads[i] == NULL)
+          break;
+#else
+        if (pthread_create(&threads[i], NULL, worker_main, &info[i]) != 0)
+          break;
+#endif
+        started++;
+      }
+    }
+  }
+#endif
+
+  run_worker(&queue, 0);
+
+#ifdef THREADS_SUPPORTED
+  for (i = 0; i < started; i++) {
+#ifdef _WIN32
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+#else
+    pthread_join(threads[i], NULL);
+#endif
+  }
+  free(threads);
+  free(info);
+#ifndef _WIN32
+  pthread_mutex_destroy(&queue.lock);
+#endif
+#endif
+}
+
+
+GLOBAL(int)
+jthread_num_cpus (void)
+{
+#ifdef THREADS_SUPPORTED
+#ifdef _WIN32
+  SYSTEM_INFO info;
+
+  GetSystemInfo(&info);
+  if (info.dwNumberOfProcessors > 1)
+    return (int) info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n > 1)
+    return (int) n;
+#endif
+#endif
+  return 1;
+}
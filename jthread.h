@@ -0,0 +1,40 @@
+/*
+ * jthread.h
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This include file defines the interface to the worker thread helpers used
+ * by the parallel encoding and decoding stages.  No modules other than those
+ * stages need include it.
+ *
+ * The helpers deliberately know nothing about JPEG objects.  A stage splits
+ * its work into independent, numbered tasks and calls jthread_run_tasks();
+ * each task is handed the index of the worker that runs it, so that the
+ * caller can provide per-worker scratch storage.  Worker 0 is always the
+ * calling thread.  If threads are not supported in this build, or cannot be
+ * created at run time, the remaining tasks simply run on the calling thread,
+ * so callers never need a separate fallback path.
+ *
+ * Tasks must not call the error handler (ERREXIT etc.): error_exit()
+ * typically longjmp()s, and doing so from a worker thread is undefined.
+ */
+
+#ifdef NEED_SHORT_EXTERNAL_NAMES
+#define jthread_run_tasks       jTRunTasks
+#define jthread_num_cpus        jTNumCPUs
+#endif
+
+
+typedef void (*jthread_task_ptr) (void *arg, int task, int worker);
+
+/* Run tasks 0 .. num_tasks-1 of task() using at most num_threads workers
+ * (including the calling thread.)  Returns once every task has completed.
+ */
+EXTERN(void) jthread_run_tasks (int num_threads, int num_tasks,
+                                jthread_task_ptr task, void *arg);
+
+/* Return the number of processors available to this process (1 if threads
+ * are not supported.)
+ */
+EXTERN(int) jthread_num_cpus (void);
@@ -131,3 +131,25 @@ jzero_far (void *target, size_t bytestozero)
 {
   MEMZERO(target, bytestozero);
 }
+
+
+GLOBAL(size_t)
+jfind_ff (const JOCTET *buf, size_t len)
+/* Return the number of bytes in buf[] that precede the first 0xFF byte, or */
+/* len if there is none.  This is used to locate stuffed bytes and markers */
+/* in entropy-coded data without examining every byte individually.  */
+{
+  size_t i = 0, w;
+
+  /* Examine a machine word at a time */
+  for (; i + sizeof(size_t) <= len; i += sizeof(size_t)) {
+    MEMCOPY(&w, buf + i, sizeof(size_t));
+    if (HAS_FF_BYTE(w))
+      break;
+  }
+  for (; i < len; i++) {
+    if (GETJOCTET(buf[i]) == 0xFF)
+      break;
+  }
+  return i;
+}
@@ -0,0 +1,460 @@
+/*
+ * mcuindextest.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This program checks jpeg_build_mcu_index() and jpeg_set_mcu_index().  It
+ * decodes regions of sequential images (cropped with jpeg_crop_scanline() and
+ * skipped to with jpeg_skip_scanlines()) with and without an MCU index and
+ * requires the results to be identical.  It also checks that both functions
+ * return FALSE for a progressive image and for an index that was built for a
+ * different image.
+ *
+ * Usage: mcuindextest <image.ppm>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "jpeglib.h"
+#include "jerror.h"
+
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jb;
+} error_mgr;
+
+typedef struct {
+  struct jpeg_destination_mgr pub;
+  unsigned char *buffer;            /* malloc()ed output buffer */
+  unsigned long alloc_size;         /* allocated size of buffer */
+  unsigned long size;               /* total number of bytes written */
+} grow_dest_mgr;
+
+typedef struct {
+  unsigned char *data;
+  unsigned long size;
+} jpeg_image;
+
+typedef struct {
+  JDIMENSION x, w;                  /* columns to crop to */
+  JDIMENSION skip, lines;           /* rows to skip and then to read */
+} region;
+
+static const JOCTET eoi_buffer[2] = { 0xFF, JPEG_EOI };
+
+static unsigned char *image;
+static int width, height;
+static int failures = 0;
+
+
+static void my_error_exit (j_common_ptr cinfo)
+{
+  error_mgr *myerr = (error_mgr *)cinfo->err;
+  (*cinfo->err->output_message) (cinfo);
+  longjmp(myerr->jb, 1);
+}
+
+static void init_grow_dest (j_compress_ptr cinfo)
+{
+  grow_dest_mgr *dest = (grow_dest_mgr *)cinfo->dest;
+  dest->alloc_size = 4096;
+  if ((dest->buffer = (unsigned char *)malloc(dest->alloc_size)) == NULL)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = dest->alloc_size;
+}
+
+static boolean empty_grow_dest (j_compress_ptr cinfo)
+{
+  grow_dest_mgr *dest = (grow_dest_mgr *)cinfo->dest;
+  unsigned char *newbuf =
+    (unsigned char *)realloc(dest->buffer, dest->alloc_size * 2);
+  if (newbuf == NULL)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  dest->buffer = newbuf;
+  dest->pub.next_output_byte = newbuf + dest->alloc_size;
+  dest->pub.free_in_buffer = dest->alloc_size;
+  dest->alloc_size *= 2;
+  return TRUE;
+}
+
+static void term_grow_dest (j_compress_ptr cinfo)
+{
+  grow_dest_mgr *dest = (grow_dest_mgr *)cinfo->dest;
+  dest->size = dest->alloc_size - dest->pub.free_in_buffer;
+}
+
+/* The whole image is in the buffer, so the source never needs refilling */
+
+static void init_mem_source (j_decompress_ptr cinfo)
+{
+}
+
+static boolean fill_mem_input_buffer (j_decompress_ptr cinfo)
+{
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  cinfo->src->next_input_byte = eoi_buffer;
+  cinfo->src->bytes_in_buffer = 2;
+  return TRUE;
+}
+
+static void skip_mem_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  struct jpeg_source_mgr *src = cinfo->src;
+  if (num_bytes <= 0)
+    return;
+  if ((size_t)num_bytes > src->bytes_in_buffer)
+    num_bytes = (long)src->bytes_in_buffer;
+  src->next_input_byte += (size_t)num_bytes;
+  src->bytes_in_buffer -= (size_t)num_bytes;
+}
+
+static void term_mem_source (j_decompress_ptr cinfo)
+{
+}
+
+
+static int load_ppm (const char *filename)
+{
+  FILE *file;
+  int maxval;
+
+  if ((file = fopen(filename, "rb")) == NULL) {
+    fprintf(stderr, "Could not open %s\n", filename);
+    return 0;
+  }
+  if (fscanf(file, "P6 %d %d %d", &width, &height, &maxval) != 3 ||
+      maxval != 255 || fgetc(file) == EOF) {
+    fprintf(stderr, "%s is not a binary 8-bit PPM file\n", filename);
+    fclose(file);
+    return 0;
+  }
+  if ((image = (unsigned char *)malloc(width * height * 3)) == NULL ||
+      fread(image, width * 3, height, file) != (size_t)height) {
+    fprintf(stderr, "Could not read %s\n", filename);
+    fclose(file);
+    return 0;
+  }
+  fclose(file);
+  return 1;
+}
+
+
+/*
+ * Compress the top image_height rows of the image.  samp is the luminance
+ * sampling factor (0 for grayscale), and restart is the restart interval in
+ * MCUs.
+ */
+
+static int compress_image (int image_height, int samp, boolean progressive,
+                           unsigned int restart, jpeg_image *jpeg)
+{
+  struct jpeg_compress_struct cinfo;
+  error_mgr jerr;
+  grow_dest_mgr dest;
+  JSAMPROW row;
+  int retval = 0;
+
+  dest.buffer = NULL;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = my_error_exit;
+  jpeg_create_compress(&cinfo);
+  if (setjmp(jerr.jb))
+    goto bailout;
+
+  dest.pub.init_destination = init_grow_dest;
+  dest.pub.empty_output_buffer = empty_grow_dest;
+  dest.pub.term_destination = term_grow_dest;
+  cinfo.dest = &dest.pub;
+
+  cinfo.image_width = width;
+  cinfo.image_height = image_height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_c_set_int_param(&cinfo, JINT_COMPRESS_PROFILE, JCP_FASTEST);
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 90, TRUE);
+  if (samp == 0)
+    jpeg_set_colorspace(&cinfo, JCS_GRAYSCALE);
+  else
+    cinfo.comp_info[0].h_samp_factor = cinfo.comp_info[0].v_samp_factor = samp;
+  if (progressive)
+    jpeg_simple_progression(&cinfo);
+  cinfo.restart_interval = restart;
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    row = &image[cinfo.next_scanline * width * 3];
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+
+  jpeg->data = dest.buffer;
+  jpeg->size = dest.size;
+  dest.buffer = NULL;
+  retval = 1;
+
+bailout:
+  jpeg_destroy_compress(&cinfo);
+  free(dest.buffer);
+  return retval;
+}
+
+
+static void start_decompress (j_decompress_ptr cinfo,
+                              struct jpeg_source_mgr *src,
+                              const jpeg_image *jpeg)
+{
+  src->init_source = init_mem_source;
+  src->fill_input_buffer = fill_mem_input_buffer;
+  src->skip_input_data = skip_mem_input_data;
+  src->resync_to_restart = jpeg_resync_to_restart;
+  src->term_source = term_mem_source;
+  src->next_input_byte = (const JOCTET *)jpeg->data;
+  src->bytes_in_buffer = (size_t)jpeg->size;
+  cinfo->src = src;
+
+  jpeg_read_header(cinfo, TRUE);
+  jpeg_start_decompress(cinfo);
+}
+
+
+/*
+ * Return the value of jpeg_build_mcu_index() for the image, or -1 if the
+ * decompressor failed.
+ */
+
+static int build_index (const jpeg_image *jpeg, JDIMENSION interval,
+                        jpeg_image *index)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_source_mgr src;
+  error_mgr jerr;
+  int retval = -1;
+
+  index->data = NULL;
+  index->size = 0;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = my_error_exit;
+  jpeg_create_decompress(&cinfo);
+  if (setjmp(jerr.jb))
+    goto bailout;
+
+  start_decompress(&cinfo, &src, jpeg);
+  retval = jpeg_build_mcu_index(&cinfo, interval, &index->data,
+                                &index->size);
+
+bailout:
+  jpeg_destroy_decompress(&cinfo);
+  return retval;
+}
+
+
+/*
+ * Decompress a region of the image, using the index if it is not NULL, and
+ * return the pixels in a malloc()ed buffer (or NULL if the decompressor
+ * failed.)  *index_used receives the value of jpeg_set_mcu_index().
+ */
+
+static unsigned char *decode_region (const jpeg_image *jpeg,
+                                     const jpeg_image *index,
+                                     const region *rgn, boolean *index_used,
+                                     unsigned long *size)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_source_mgr src;
+  error_mgr jerr;
+  unsigned char *volatile pixels = NULL;
+  JDIMENSION x = rgn->x, w = rgn->w, row_size, num_rows, row;
+  JSAMPROW rowptr;
+
+  *index_used = FALSE;
+  *size = 0;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = my_error_exit;
+  jpeg_create_decompress(&cinfo);
+  if (setjmp(jerr.jb)) {
+    free(pixels);
+    pixels = NULL;
+    goto bailout;
+  }
+
+  start_decompress(&cinfo, &src, jpeg);
+  if (index)
+    *index_used = jpeg_set_mcu_index(&cinfo, index->data, index->size);
+  jpeg_crop_scanline(&cinfo, &x, &w);
+  jpeg_skip_scanlines(&cinfo, rgn->skip);
+
+  row_size = cinfo.output_width * cinfo.output_components;
+  num_rows = rgn->lines;
+  if (num_rows > cinfo.output_height - cinfo.output_scanline)
+    num_rows = cinfo.output_height - cinfo.output_scanline;
+  if ((pixels = (unsigned char *)malloc(row_size * num_rows + 1)) == NULL)
+    ERREXIT1(&cinfo, JERR_OUT_OF_MEMORY, 0);
+  for (row = 0; row < num_rows; row++) {
+    rowptr = &pixels[row * row_size];
+    jpeg_read_scanlines(&cinfo, &rowptr, 1);
+  }
+  /* Skip the rest of the image, which must leave the source at the EOI
+   * marker.
+   */
+  jpeg_skip_scanlines(&cinfo, cinfo.output_height - cinfo.output_scanline);
+  jpeg_finish_decompress(&cinfo);
+  if (jerr.pub.num_warnings) {
+    printf("Warning while decoding the region\n");
+    free(pixels);
+    pixels = NULL;
+  }
+  *size = (unsigned long)row_size * num_rows;
+
+bailout:
+  jpeg_destroy_decompress(&cinfo);
+  return pixels;
+}
+
+
+/*
+ * Decode the region with and without the index, and make sure that the
+ * index is (or is not) used and that the results are identical.
+ */
+
+static void check_region (const char *name, const jpeg_image *jpeg,
+                          const jpeg_image *index, boolean expect_used,
+                          const region *rgn)
+{
+  unsigned char *ref, *test;
+  unsigned long ref_size, test_size;
+  boolean used;
+
+  printf("%-26s x=%-3u w=%-3u skip=%-3u lines=%-3u: ", name, rgn->x, rgn->w,
+         rgn->skip, rgn->lines);
+  ref = decode_region(jpeg, NULL, rgn, &used, &ref_size);
+  test = decode_region(jpeg, index, rgn, &used, &test_size);
+  if (!ref || !test) {
+    printf("FAILED (decompression error)\n");
+    failures++;
+  } else if (used != expect_used) {
+    printf("FAILED (jpeg_set_mcu_index() returned %s)\n",
+           used ? "TRUE" : "FALSE");
+    failures++;
+  } else if (ref_size != test_size || memcmp(ref, test, ref_size)) {
+    printf("FAILED (output differs)\n");
+    failures++;
+  } else
+    printf("OK\n");
+  free(ref);
+  free(test);
+}
+
+
+static const region regions[] = {
+  { 0, 0, 0, 0 },                   /* whole image */
+  { 100, 50, 40, 30 },
+  { 0, 64, 64, 64 },
+  { 150, 77, 120, 29 },
+  { 17, 1, 73, 1 },
+  { 60, 100, 0, 1 }
+};
+
+#define NUM_REGIONS  (int)(sizeof(regions) / sizeof(regions[0]))
+
+
+static void check_image (const char *name, int samp, unsigned int restart,
+                         JDIMENSION interval)
+{
+  jpeg_image jpeg, index;
+  region rgn;
+  int i;
+
+  if (!compress_image(height, samp, FALSE, restart, &jpeg)) {
+    printf("%s: compression FAILED\n", name);
+    failures++;
+    return;
+  }
+  if (build_index(&jpeg, interval, &index) != TRUE) {
+    printf("%s: jpeg_build_mcu_index() FAILED\n", name);
+    failures++;
+  } else {
+    for (i = 0; i < NUM_REGIONS; i++) {
+      rgn = regions[i];
+      if (rgn.w == 0) {
+        rgn.w = width;
+        rgn.lines = height;
+      }
+      check_region(name, &jpeg, &index, TRUE, &rgn);
+    }
+  }
+  free(index.data);
+  free(jpeg.data);
+}
+
+
+static void check_false (const char *name, int value)
+{
+  printf("%-26s: ", name);
+  if (value != FALSE) {
+    printf("FAILED (expected FALSE, got %d)\n", value);
+    failures++;
+  } else
+    printf("OK\n");
+}
+
+
+int main (int argc, char **argv)
+{
+  jpeg_image base, restart, shorter, progressive, index, bad_index;
+  region rgn = regions[1];
+
+  if (argc != 2) {
+    fprintf(stderr, "USAGE: %s <image.ppm>\n", argv[0]);
+    return 1;
+  }
+  if (!load_ppm(argv[1]))
+    return 1;
+
+  check_image("4:2:0, interval 1", 2, 0, 1);
+  check_image("4:2:0, interval 4", 2, 0, 4);
+  check_image("4:4:4, restart 5, int. 3", 1, 5, 3);
+  check_image("grayscale, interval 7", 0, 0, 7);
+  check_image("grayscale, restart 1", 0, 1, 2);
+
+  if (!compress_image(height, 2, FALSE, 0, &base) ||
+      !compress_image(height, 2, FALSE, 3, &restart) ||
+      !compress_image(height / 2, 2, FALSE, 0, &shorter) ||
+      !compress_image(height, 2, TRUE, 0, &progressive) ||
+      build_index(&base, 4, &index) != TRUE) {
+    printf("Could not create the test images\n");
+    return 1;
+  }
+
+  /* A progressive image cannot be indexed, but it still decodes normally if
+   * an index is passed to it.
+   */
+  check_false("progressive, build", build_index(&progressive, 4, &bad_index));
+  free(bad_index.data);
+  check_region("progressive, set", &progressive, &index, FALSE, &rgn);
+
+  /* An index does not fit an image with other dimensions or restart markers,
+   * nor can it be truncated.
+   */
+  check_region("other height", &shorter, &index, FALSE, &rgn);
+  check_region("other restart interval", &restart, &index, FALSE, &rgn);
+  bad_index.data = index.data;
+  bad_index.size = 16;
+  check_region("truncated index", &base, &bad_index, FALSE, &rgn);
+
+  free(index.data);
+  free(progressive.data);
+  free(shorter.data);
+  free(restart.data);
+  free(base.data);
+  free(image);
+  if (failures) {
+    printf("%d test(s) FAILED\n", failures);
+    return 1;
+  }
+  return 0;
+}
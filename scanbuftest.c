@@ -0,0 +1,215 @@
+/*
+ * scanbuftest.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This program checks JINT_SCAN_BUFFER_LIMIT and JINT_SCAN_BUFFER_PEAK.  It
+ * compresses an image with scan optimization, with several buffer limits and
+ * numbers of threads, and requires the output to be identical to that
+ * obtained without a limit.  It also requires the reported peak size of the
+ * scan buffer not to exceed the limit, even when a scan is larger than that.
+ *
+ * Usage: scanbuftest <image.ppm>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "jpeglib.h"
+#include "jerror.h"
+
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jb;
+} error_mgr;
+
+typedef struct {
+  struct jpeg_destination_mgr pub;
+  unsigned char *buffer;            /* malloc()ed output buffer */
+  unsigned long alloc_size;         /* allocated size of buffer */
+  unsigned long size;               /* total number of bytes written */
+} grow_dest_mgr;
+
+static unsigned char *image;
+static int width, height;
+static int failures = 0;
+
+
+static void my_error_exit (j_common_ptr cinfo)
+{
+  error_mgr *myerr = (error_mgr *)cinfo->err;
+  (*cinfo->err->output_message) (cinfo);
+  longjmp(myerr->jb, 1);
+}
+
+static void init_grow_dest (j_compress_ptr cinfo)
+{
+  grow_dest_mgr *dest = (grow_dest_mgr *)cinfo->dest;
+  dest->alloc_size = 4096;
+  if ((dest->buffer = (unsigned char *)malloc(dest->alloc_size)) == NULL)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = dest->alloc_size;
+}
+
+static boolean empty_grow_dest (j_compress_ptr cinfo)
+{
+  grow_dest_mgr *dest = (grow_dest_mgr *)cinfo->dest;
+  unsigned char *newbuf =
+    (unsigned char *)realloc(dest->buffer, dest->alloc_size * 2);
+  if (newbuf == NULL)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+  dest->buffer = newbuf;
+  dest->pub.next_output_byte = newbuf + dest->alloc_size;
+  dest->pub.free_in_buffer = dest->alloc_size;
+  dest->alloc_size *= 2;
+  return TRUE;
+}
+
+static void term_grow_dest (j_compress_ptr cinfo)
+{
+  grow_dest_mgr *dest = (grow_dest_mgr *)cinfo->dest;
+  dest->size = dest->alloc_size - dest->pub.free_in_buffer;
+}
+
+
+static int load_ppm (const char *filename)
+{
+  FILE *file;
+  int maxval;
+
+  if ((file = fopen(filename, "rb")) == NULL) {
+    fprintf(stderr, "Could not open %s\n", filename);
+    return 0;
+  }
+  if (fscanf(file, "P6 %d %d %d", &width, &height, &maxval) != 3 ||
+      maxval != 255 || fgetc(file) == EOF) {
+    fprintf(stderr, "%s is not a binary 8-bit PPM file\n", filename);
+    fclose(file);
+    return 0;
+  }
+  if ((image = (unsigned char *)malloc(width * height * 3)) == NULL ||
+      fread(image, width * 3, height, file) != (size_t)height) {
+    fprintf(stderr, "Could not read %s\n", filename);
+    fclose(file);
+    return 0;
+  }
+  fclose(file);
+  return 1;
+}
+
+
+/*
+ * Compress the image with the given scan buffer limit (in kilobytes) and
+ * number of threads.  Returns the value of JINT_SCAN_BUFFER_PEAK, or -1 if
+ * the compressor failed.  The JPEG image is returned in a malloc()ed buffer.
+ */
+
+static int compress_image (int limit, int num_threads, unsigned char **jpeg,
+                           unsigned long *size)
+{
+  struct jpeg_compress_struct cinfo;
+  error_mgr jerr;
+  grow_dest_mgr dest;
+  JSAMPROW row;
+  int peak = -1;
+
+  dest.buffer = NULL;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = my_error_exit;
+  jpeg_create_compress(&cinfo);
+  if (setjmp(jerr.jb))
+    goto bailout;
+
+  dest.pub.init_destination = init_grow_dest;
+  dest.pub.empty_output_buffer = empty_grow_dest;
+  dest.pub.term_destination = term_grow_dest;
+  cinfo.dest = &dest.pub;
+
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 90, TRUE);
+  jpeg_c_set_int_param(&cinfo, JINT_SCAN_BUFFER_LIMIT, limit);
+  jpeg_c_set_int_param(&cinfo, JINT_NUM_THREADS, num_threads);
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    row = &image[cinfo.next_scanline * width * 3];
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+
+  peak = jpeg_c_get_int_param(&cinfo, JINT_SCAN_BUFFER_PEAK);
+  *jpeg = dest.buffer;
+  *size = dest.size;
+  dest.buffer = NULL;
+
+bailout:
+  jpeg_destroy_compress(&cinfo);
+  free(dest.buffer);
+  return peak;
+}
+
+
+static void check (int limit, int num_threads, const unsigned char *ref,
+                   unsigned long ref_size)
+{
+  unsigned char *jpeg = NULL;
+  unsigned long size = 0;
+  int peak = compress_image(limit, num_threads, &jpeg, &size);
+
+  printf("limit %3d KB, %d thread(s): ", limit, num_threads);
+  if (peak < 0) {
+    printf("FAILED (compression error)\n");
+    failures++;
+    return;
+  }
+  printf("peak = %d KB: ", peak);
+  if (size != ref_size || memcmp(jpeg, ref, size)) {
+    printf("FAILED (output differs)\n");
+    failures++;
+  } else if (peak > limit) {
+    printf("FAILED (peak exceeds the limit)\n");
+    failures++;
+  } else
+    printf("OK\n");
+  free(jpeg);
+}
+
+
+int main (int argc, char **argv)
+{
+  static const int limits[] = { 1, 4, 16, 64 };
+  unsigned char *ref = NULL;
+  unsigned long ref_size = 0;
+  int i;
+
+  if (argc != 2) {
+    fprintf(stderr, "USAGE: %s <image.ppm>\n", argv[0]);
+    return 1;
+  }
+  if (!load_ppm(argv[1]))
+    return 1;
+
+  if (compress_image(0, 1, &ref, &ref_size) < 0) {
+    printf("Could not compress the image without a limit\n");
+    return 1;
+  }
+  for (i = 0; i < (int)(sizeof(limits) / sizeof(limits[0])); i++) {
+    check(limits[i], 1, ref, ref_size);
+    check(limits[i], 4, ref, ref_size);
+  }
+
+  free(ref);
+  free(image);
+  if (failures) {
+    printf("%d test(s) FAILED\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * jchuff-avx2.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains an AVX2/BMI2 implementation of encode_one_block()
+ * (jchuff.c.)  The block is reordered and classified with vector operations:
+ * the magnitude category of every coefficient is computed at once, and a
+ * 64-bit mask of the nonzero coefficients lets the encoder jump from one
+ * nonzero coefficient to the next with tzcnt, computing the run lengths as
+ * it goes.  The bits are collected in a 64-bit buffer, which is written out 8
+ * bytes at a time unless it contains a byte that needs to be stuffed.  The
+ * output is identical to that of the C implementation.
+ *
+ * This file must be compiled with AVX2, BMI and BMI2 code generation
+ * enabled, and the routine may only be used if the CPU supports them.
+ */
+
+#define JPEG_INTERNALS
+#include "../jinclude.h"
+#include "../jpeglib.h"
+#include "../jsimd.h"
+#include "../jdct.h"
+#include "jsimd.h"
+#include <immintrin.h>
+
+
+/* The leading fields of working_state (jchuff.c) */
+
+typedef struct {
+  JOCTET *next_output_byte;
+  size_t free_in_buffer;
+  size_t put_buffer;            /* current bit-accumulation buffer */
+  int put_bits;                 /* # of bits now in it */
+} huff_state;
+
+
+/* See jchuff.c for a description of these. */
+
+#define BUFFER_HAS_FF(buf) \
+  ((buf) & 0x8080808080808080 & ~((buf) + 0x0101010101010101))
+
+#define EMIT_FULL_BYTE(shift) { \
+  JOCTET c = (JOCTET) (put_buffer >> (shift)); \
+  *buffer++ = c; \
+  if (c == 0xFF) \
+    *buffer++ = 0; \
+}
+
+#define FLUSH_BUFFER() { \
+  if (BUFFER_HAS_FF(put_buffer)) { \
+    EMIT_FULL_BYTE(56)  EMIT_FULL_BYTE(48) \
+    EMIT_FULL_BYTE(40)  EMIT_FULL_BYTE(32) \
+    EMIT_FULL_BYTE(24)  EMIT_FULL_BYTE(16) \
+    EMIT_FULL_BYTE(8)   EMIT_FULL_BYTE(0) \
+  } else { \
+    unsigned long long be = _bswap64(put_buffer); \
+    MEMCOPY(buffer, &be, 8); \
+    buffer += 8; \
+  } \
+}
+
+#define EMIT_BITS(code, size) { \
+  put_bits += size; \
+  if (put_bits > 64) { \
+    put_bits -= 64; \
+    put_buffer = (put_buffer << (size - put_bits)) | \
+                 ((size_t) (code) >> put_bits); \
+    FLUSH_BUFFER() \
+    put_buffer = (size_t) (code); \
+  } else \
+    put_buffer = (put_buffer << size) | (size_t) (code); \
+}
+
+
+/* Zigzag-ordered coefficients k .. k+15 of block */
+#define ZIGZAG16(b, a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, \
+                 a13, a14, a15) \
+  _mm256_setr_epi16(b[a0], b[a1], b[a2], b[a3], b[a4], b[a5], b[a6], b[a7], \
+                    b[a8], b[a9], b[a10], b[a11], b[a12], b[a13], b[a14], \
+                    b[a15])
+
+
+LOCAL(void)
+classify16 (__m256i coefs, JCOEF *values, unsigned short *nbits,
+            unsigned int *zero_mask)
+/* For 16 coefficients, store the bits to be emitted after the Huffman symbol
+ * (the value, or the complement of its magnitude if negative) and the number
+ * of such bits, as well as the mask of zero coefficients (2 bits each.)
+ */
+{
+  __m256i sign = _mm256_srai_epi16(coefs, 15);
+  __m256i absval = _mm256_abs_epi16(coefs);
+  __m256i lo, hi;
+
+  _mm256_storeu_si256((__m256i *) values, _mm256_add_epi16(coefs, sign));
+  *zero_mask = (unsigned int)
+    _mm256_movemask_epi8(_mm256_cmpeq_epi16(coefs, _mm256_setzero_si256()));
+
+  /* The number of bits of a nonzero magnitude is the unbiased exponent of its
+   * single-precision representation, plus 1.  Zero yields a negative value,
+   * which is clamped to 0.
+   */
+  lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(absval));
+  hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(absval, 1));
+  lo = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(lo)), 23);
+  hi = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(hi)), 23);
+  lo = _mm256_sub_epi32(lo, _mm256_set1_epi32(126));
+  hi = _mm256_sub_epi32(hi, _mm256_set1_epi32(126));
+  lo = _mm256_packus_epi32(lo, hi);
+  _mm256_storeu_si256((__m256i *) nbits,
+                      _mm256_permute4x64_epi64(lo, 0xD8));
+}
+
+
+GLOBAL(JOCTET *)
+jsimd_huff_encode_one_block_avx2 (void *state, JOCTET *buffer, JCOEFPTR block,
+                                  int last_dc_val, c_derived_tbl *dctbl,
+                                  c_derived_tbl *actbl)
+{
+  huff_state *hstate = (huff_state *) state;
+  JCOEF values[DCTSIZE2];
+  unsigned short nbits[DCTSIZE2];
+  unsigned int zero_mask[4];
+  unsigned long long nonzero;
+  size_t put_buffer = hstate->put_buffer;
+  int put_bits = hstate->put_bits;
+  unsigned int code_0xf0 = actbl->ehufco[0xf0];
+  int size_0xf0 = actbl->ehufsi[0xf0];
+  unsigned int code;
+  int size, k, last, r, nb, sym;
+
+  /* Reorder the block into zigzag order, replacing the DC coefficient with
+   * its difference from the prediction.
+   */
+  classify16(_mm256_insert_epi16(ZIGZAG16(block, 0, 1, 8, 16, 9, 2, 3, 10,
+                                          17, 24, 32, 25, 18, 11, 4, 5),
+                                 block[0] - last_dc_val, 0),
+             values, nbits, &zero_mask[0]);
+  classify16(ZIGZAG16(block, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7,
+                      14, 21, 28),
+             values + 16, nbits + 16, &zero_mask[1]);
+  classify16(ZIGZAG16(block, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+                      30, 37, 44, 51),
+             values + 32, nbits + 32, &zero_mask[2]);
+  classify16(ZIGZAG16(block, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54,
+                      47, 55, 62, 63),
+             values + 48, nbits + 48, &zero_mask[3]);
+
+  /* Each coefficient has two bits in the masks. */
+  nonzero = ~((unsigned long long) _pext_u32(zero_mask[0], 0x55555555) |
+              ((unsigned long long) _pext_u32(zero_mask[1], 0x55555555) << 16) |
+              ((unsigned long long) _pext_u32(zero_mask[2], 0x55555555) << 32) |
+              ((unsigned long long) _pext_u32(zero_mask[3], 0x55555555) << 48));
+
+  /* Encode the DC coefficient difference per section F.1.2.1 */
+  nb = nbits[0];
+  code = (dctbl->ehufco[nb] << nb) |
+         _bzhi_u32((unsigned short) values[0], nb);
+  size = dctbl->ehufsi[nb] + nb;
+  EMIT_BITS(code, size)
+
+  /* Encode the AC coefficients per section F.1.2.2 */
+  nonzero &= ~1ULL;
+  last = 0;
+  while (nonzero) {
+    k = (int) _tzcnt_u64(nonzero);
+    r = k - last - 1;
+    /* if run length > 15, must emit special run-length-16 codes (0xF0) */
+    while (r > 15) {
+      EMIT_BITS(code_0xf0, size_0xf0)
+      r -= 16;
+    }
+    nb = nbits[k];
+    sym = (r << 4) + nb;
+    code = (actbl->ehufco[sym] << nb) |
+           _bzhi_u32((unsigned short) values[k], nb);
+    size = actbl->ehufsi[sym] + nb;
+    EMIT_BITS(code, size)
+    last = k;
+    nonzero = _blsr_u64(nonzero);
+  }
+
+  /* If the last coef(s) were zero, emit an end-of-block code */
+  if (last < DCTSIZE2 - 1) {
+    code = actbl->ehufco[0];
+    size = actbl->ehufsi[0];
+    EMIT_BITS(code, size)
+  }
+
+  hstate->put_buffer = put_buffer;
+  hstate->put_bits = put_bits;
+  return buffer;
+}
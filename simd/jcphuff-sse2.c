@@ -0,0 +1,130 @@
+/*
+ * jcphuff-sse2.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains SSE2 implementations of the routines that prepare a
+ * block for progressive Huffman encoding (encode_mcu_AC_first_prepare() and
+ * encode_mcu_AC_refine_prepare() in jcphuff.c.)  The coefficients of the
+ * spectral band are processed 8 at a time, and the bitmaps are assembled
+ * from vector comparisons.  The results are identical to those of the C
+ * implementations, except that bits of bitmaps past the end of the band may
+ * be set; the encoder never examines them.
+ *
+ * These routines assume that a bitmap fits in a single size_t word, so they
+ * are only used on x86-64.
+ */
+
+#define JPEG_INTERNALS
+#include "../jinclude.h"
+#include "../jpeglib.h"
+#include "../jsimd.h"
+#include "../jdct.h"
+#include "jsimd.h"
+#include <emmintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+
+/*
+ * Load the (up to) 8 coefficients of block at the natural-order positions
+ * order[0 .. 7], setting those at or past index n to 0.  This reads order[]
+ * past n, which is safe because jpeg_natural_order[] is padded.
+ */
+
+LOCAL(__m128i)
+load_zigzag8 (const JCOEF *block, const int *order, int n)
+{
+  __m128i x = _mm_setr_epi16(block[order[0]], block[order[1]],
+                             block[order[2]], block[order[3]],
+                             block[order[4]], block[order[5]],
+                             block[order[6]], block[order[7]]);
+
+  if (n < 8)
+    x = _mm_and_si128(x, _mm_cmpgt_epi16(_mm_set1_epi16((short) n),
+                                         _mm_setr_epi16(0, 1, 2, 3, 4, 5,
+                                                        6, 7)));
+  return x;
+}
+
+
+/* Return an 8-bit mask of the lanes of a 16-bit comparison result */
+
+#define MASK8(cmp) \
+  ((unsigned int) _mm_movemask_epi8(_mm_packs_epi16(cmp, cmp)) & 0xFF)
+
+
+GLOBAL(void)
+jsimd_encode_mcu_AC_first_prepare_sse2 (const JCOEF *block,
+                                        const int *jpeg_natural_order_start,
+                                        int Sl, int Al, JCOEF *values,
+                                        size_t *bits)
+{
+  __m128i shift = _mm_cvtsi32_si128(Al);
+  __m128i zero = _mm_setzero_si128();
+  size_t nonzero = 0;
+  int k;
+
+  for (k = 0; k < Sl; k += 8) {
+    __m128i x = load_zigzag8(block, jpeg_natural_order_start + k, Sl - k);
+    __m128i sign = _mm_srai_epi16(x, 15);
+    __m128i absval;
+
+    /* Point transform: the absolute value, shifted right by Al */
+    absval = _mm_srl_epi16(_mm_sub_epi16(_mm_xor_si128(x, sign), sign), shift);
+    _mm_storeu_si128((__m128i *) &values[k], absval);
+    _mm_storeu_si128((__m128i *) &values[k + DCTSIZE2],
+                     _mm_xor_si128(absval, sign));
+
+    nonzero |= (size_t) (~MASK8(_mm_cmpeq_epi16(absval, zero)) & 0xFF) << k;
+  }
+
+  bits[0] = nonzero;
+}
+
+
+GLOBAL(int)
+jsimd_encode_mcu_AC_refine_prepare_sse2 (const JCOEF *block,
+                                         const int *jpeg_natural_order_start,
+                                         int Sl, int Al, JCOEF *absvalues,
+                                         size_t *bits)
+{
+  __m128i shift = _mm_cvtsi32_si128(Al);
+  __m128i zero = _mm_setzero_si128();
+  __m128i one = _mm_set1_epi16(1);
+  size_t nonzero = 0, positive = 0, ones = 0;
+  int k;
+
+  for (k = 0; k < Sl; k += 8) {
+    __m128i x = load_zigzag8(block, jpeg_natural_order_start + k, Sl - k);
+    __m128i sign = _mm_srai_epi16(x, 15);
+    __m128i absval;
+
+    absval = _mm_srl_epi16(_mm_sub_epi16(_mm_xor_si128(x, sign), sign), shift);
+    _mm_storeu_si128((__m128i *) &absvalues[k], absval);
+
+    nonzero |= (size_t) (~MASK8(_mm_cmpeq_epi16(absval, zero)) & 0xFF) << k;
+    positive |= (size_t) (~MASK8(sign) & 0xFF) << k;
+    ones |= (size_t) MASK8(_mm_cmpeq_epi16(absval, one)) << k;
+  }
+
+  bits[0] = nonzero;
+  bits[1] = positive;
+
+  /* EOB = index of last newly-nonzero coef */
+  if (ones == 0)
+    return -1;
+#if defined(_MSC_VER) && !defined(__clang__)
+  {
+    unsigned long index;
+
+    _BitScanReverse64(&index, ones);
+    return (int) index;
+  }
+#else
+  return 63 - __builtin_clzll(ones);
+#endif
+}
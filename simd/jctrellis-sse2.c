@@ -0,0 +1,200 @@
+/*
+ * jctrellis-sse2.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains SSE2 implementations of the inner loops of
+ * quantize_trellis() (jcdctmgr.c.)  Every single-precision result is formed
+ * from the same operands, with the same operations in the same order, as in
+ * the C code, and ties are broken the same way, so the output is identical
+ * to that of the C implementation.  This relies on the C code also being
+ * compiled to scalar SSE arithmetic, which is why these routines are only
+ * used on x86-64.
+ */
+
+#define JPEG_INTERNALS
+#include "../jinclude.h"
+#include "../jpeglib.h"
+#include "../jsimd.h"
+#include "../jdct.h"
+#include "../jsimddct.h"
+#include "jsimd.h"
+#include <emmintrin.h>
+
+
+/*
+ * Compute, for all 64 coefficients of a block (in natural order), the
+ * round-to-nearest quantized magnitude
+ *
+ *   qval[z] = (|src[z]| + q[z]/2) / q[z]
+ *
+ * and the distortion of quantizing the coefficient to zero
+ *
+ *   zero_dist[z] = |src[z]|^2 * lambda * lambda_tbl[z]
+ *
+ * The integer division is carried out in double precision, which is exact
+ * for the operand ranges involved (both are well below 2^31, and the
+ * quotient is never within 2^-53 relative of the next integer.)
+ */
+
+GLOBAL(void)
+jsimd_trellis_prep_sse2 (JCOEFPTR src, const int *q, const float *lambda_tbl,
+                         float lambda, int *qval, float *zero_dist)
+{
+  __m128 lambda_v = _mm_set1_ps(lambda);
+  __m128i zero = _mm_setzero_si128();
+  int i, h;
+
+  for (i = 0; i < DCTSIZE2; i += 8) {
+    __m128i coefs = _mm_loadu_si128((__m128i *)&src[i]);
+
+    for (h = 0; h < 2; h++) {
+      __m128i c16, c32, sign, x, sq, qv, n;
+      __m128d lo, hi;
+      __m128 dist;
+      int k = i + 4 * h;
+
+      /* Interleave with zeros so that _mm_madd_epi16() yields the 32-bit
+       * squares, and sign-extend to get the coefficients themselves.
+       */
+      c16 = h ? _mm_unpackhi_epi16(coefs, zero) :
+                _mm_unpacklo_epi16(coefs, zero);
+      c32 = _mm_srai_epi32(_mm_slli_epi32(c16, 16), 16);
+      sq = _mm_madd_epi16(c16, c16);
+      sign = _mm_srai_epi32(c32, 31);
+      x = _mm_sub_epi32(_mm_xor_si128(c32, sign), sign);
+
+      dist = _mm_mul_ps(_mm_cvtepi32_ps(sq), lambda_v);
+      dist = _mm_mul_ps(dist, _mm_loadu_ps(&lambda_tbl[k]));
+      _mm_storeu_ps(&zero_dist[k], dist);
+
+      qv = _mm_loadu_si128((__m128i *)&q[k]);
+      n = _mm_add_epi32(x, _mm_srai_epi32(qv, 1));
+      lo = _mm_div_pd(_mm_cvtepi32_pd(n), _mm_cvtepi32_pd(qv));
+      hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(n, 0x0E)),
+                      _mm_cvtepi32_pd(_mm_shuffle_epi32(qv, 0x0E)));
+      _mm_storeu_si128((__m128i *)&qval[k],
+                       _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo),
+                                          _mm_cvttpd_epi32(hi)));
+    }
+  }
+}
+
+
+/*
+ * Find the cheapest way of coding coefficient i (in zigzag order) as one of
+ * num_candidates magnitudes, preceded by a run of zeros starting after one of
+ * the num_preds positions in preds[] (in increasing order, the first being
+ * Ss-1.)  Candidate k has k+1 magnitude bits and distortion
+ * candidate_dist[k].
+ *
+ * This evaluates exactly the same costs as the C loop and keeps the first
+ * (pred, candidate) pair, in the C loop's order, that attains the minimum.
+ * Each vector holds four consecutive candidates for one predecessor, so the
+ * code lengths of all of them come from a single load of the relevant row of
+ * ehufsi[].  Each lane visits its predecessors in increasing order, so a
+ * strict comparison within the lane and a (pred, candidate) tie break across
+ * lanes reproduce the C result.
+ *
+ * Sets accumulated_cost[i] and, if a candidate was found, run_start[i].
+ * Returns the index of the chosen candidate, or -1 if no candidate is
+ * codable.
+ */
+
+GLOBAL(int)
+jsimd_trellis_search_sse2 (int i, int num_preds, const int *preds,
+                           int num_candidates, const float *candidate_dist,
+                           float *accumulated_cost,
+                           const float *accumulated_zero_dist, int *run_start,
+                           const char *ehufsi)
+{
+  int zrl_bits = ehufsi[0xf0];
+  float prev_zero_dist = accumulated_zero_dist[i - 1];
+  int num_vecs = (num_candidates + 3) >> 2;
+  __m128i zero = _mm_setzero_si128();
+  __m128 dist[4], best_cost[4];
+  __m128i kbits[4], kmask[4], best_pred[4];
+  float cost_out[16];
+  int pred_out[16];
+  int p, v, k, best_k;
+
+  for (v = 0; v < num_vecs; v++) {
+    int k0 = 4 * v;
+
+    for (k = 0; k < 4; k++)
+      cost_out[k] = k0 + k < num_candidates ? candidate_dist[k0 + k] : 0.f;
+    dist[v] = _mm_loadu_ps(cost_out);
+    kbits[v] = _mm_setr_epi32(k0 + 1, k0 + 2, k0 + 3, k0 + 4);
+    kmask[v] = _mm_cmplt_epi32(kbits[v], _mm_set1_epi32(num_candidates + 1));
+    best_cost[v] = _mm_set1_ps(1e38f);
+    best_pred[v] = zero;
+  }
+
+  for (p = 0; p < num_preds; p++) {
+    int j = preds[p];
+    int zero_run = i - 1 - j;
+    __m128i row, row_lo, row_hi, predv, run_bits;
+    __m128 base;
+
+    if ((zero_run >> 4) && zrl_bits == 0)
+      continue;
+
+    base = _mm_set1_ps(prev_zero_dist - accumulated_zero_dist[j] +
+                       accumulated_cost[j]);
+    run_bits = _mm_set1_epi32((zero_run >> 4) * zrl_bits);
+    predv = _mm_set1_epi32(p);
+
+    /* Code lengths of the symbols (zero_run & 15, 1..15) */
+    row = _mm_loadu_si128((__m128i *)&ehufsi[16 * (zero_run & 15)]);
+    row = _mm_srli_si128(row, 1);
+    row_lo = _mm_unpacklo_epi8(row, zero);
+    row_hi = _mm_unpackhi_epi8(row, zero);
+
+    for (v = 0; v < num_vecs; v++) {
+      __m128i coef_bits, rate, upd;
+      __m128 cost;
+
+      switch (v) {
+      case 0:  coef_bits = _mm_unpacklo_epi16(row_lo, zero);  break;
+      case 1:  coef_bits = _mm_unpackhi_epi16(row_lo, zero);  break;
+      case 2:  coef_bits = _mm_unpacklo_epi16(row_hi, zero);  break;
+      default: coef_bits = _mm_unpackhi_epi16(row_hi, zero);  break;
+      }
+
+      rate = _mm_add_epi32(_mm_add_epi32(coef_bits, kbits[v]), run_bits);
+      cost = _mm_add_ps(_mm_cvtepi32_ps(rate), dist[v]);
+      cost = _mm_add_ps(cost, base);
+
+      upd = _mm_andnot_si128(_mm_cmpeq_epi32(coef_bits, zero),
+                             _mm_and_si128(kmask[v], _mm_castps_si128(
+                               _mm_cmplt_ps(cost, best_cost[v]))));
+      best_cost[v] = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(upd), cost),
+                               _mm_andnot_ps(_mm_castsi128_ps(upd),
+                                             best_cost[v]));
+      best_pred[v] = _mm_or_si128(_mm_and_si128(upd, predv),
+                                  _mm_andnot_si128(upd, best_pred[v]));
+    }
+  }
+
+  best_k = -1;
+  for (v = 0; v < num_vecs; v++) {
+    _mm_storeu_ps(&cost_out[4 * v], best_cost[v]);
+    _mm_storeu_si128((__m128i *)&pred_out[4 * v], best_pred[v]);
+  }
+  for (k = 0; k < num_candidates; k++) {
+    if (cost_out[k] < 1e38f &&
+        (best_k < 0 || cost_out[k] < cost_out[best_k] ||
+         (cost_out[k] == cost_out[best_k] &&
+          pred_out[k] < pred_out[best_k])))
+      best_k = k;
+  }
+
+  if (best_k < 0) {
+    accumulated_cost[i] = 1e38f;
+    return -1;
+  }
+  accumulated_cost[i] = cost_out[best_k];
+  run_start[i] = preds[pred_out[best_k]];
+  return best_k;
+}
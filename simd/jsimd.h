@@ -23,6 +23,7 @@
 #define JSIMD_ARM_NEON   0x10
 #define JSIMD_MIPS_DSPR2 0x20
 #define JSIMD_ALTIVEC    0x40
+#define JSIMD_AVX2       0x80
 
 /* SIMD Ext: retrieve SIMD/CPU information */
 EXTERN(unsigned int) jpeg_simd_cpu_support (void);
@@ -757,6 +758,17 @@ EXTERN(void) jsimd_quantize_float_sse2
 EXTERN(void) jsimd_quantize_float_mips_dspr2
         (JCOEFPTR coef_block, FAST_FLOAT *divisors, FAST_FLOAT *workspace);
 
+/* Trellis Quantization */
+EXTERN(void) jsimd_trellis_prep_sse2
+        (JCOEFPTR src, const int *q, const float *lambda_tbl, float lambda,
+         int *qval, float *zero_dist);
+
+EXTERN(int) jsimd_trellis_search_sse2
+        (int i, int num_preds, const int *preds, int num_candidates,
+         const float *candidate_dist, float *accumulated_cost,
+         const float *accumulated_zero_dist, int *run_start,
+         const char *ehufsi);
+
 /* Scaled Inverse DCT */
 EXTERN(void) jsimd_idct_2x2_mmx
         (void *dct_table, JCOEFPTR coef_block, JSAMPARRAY output_buf,
@@ -862,6 +874,17 @@ EXTERN(JOCTET*) jsimd_huff_encode_one_block_sse2
         (void *state, JOCTET *buffer, JCOEFPTR block, int last_dc_val,
          c_derived_tbl *dctbl, c_derived_tbl *actbl);
 
+EXTERN(JOCTET*) jsimd_huff_encode_one_block_avx2
+        (void *state, JOCTET *buffer, JCOEFPTR block, int last_dc_val,
+         c_derived_tbl *dctbl, c_derived_tbl *actbl);
+
+EXTERN(void) jsimd_encode_mcu_AC_first_prepare_sse2
+        (const JCOEF *block, const int *jpeg_natural_order_start, int Sl,
+         int Al, JCOEF *values, size_t *bits);
+EXTERN(int) jsimd_encode_mcu_AC_refine_prepare_sse2
+        (const JCOEF *block, const int *jpeg_natural_order_start, int Sl,
+         int Al, JCOEF *absvalues, size_t *bits);
+
 EXTERN(JOCTET*) jsimd_huff_encode_one_block_neon
         (void *state, JOCTET *buffer, JCOEFPTR block, int last_dc_val,
          c_derived_tbl *dctbl, c_derived_tbl *actbl);
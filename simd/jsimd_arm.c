@@ -556,6 +556,34 @@ jsimd_quantize_float (JCOEFPTR coef_block, FAST_FLOAT *divisors,
 {
 }
 
+GLOBAL(int)
+jsimd_can_trellis_prep (void)
+{
+  return 0;
+}
+
+GLOBAL(int)
+jsimd_can_trellis_search (void)
+{
+  return 0;
+}
+
+GLOBAL(void)
+jsimd_trellis_prep (JCOEFPTR src, const int *q, const float *lambda_tbl,
+                    float lambda, int *qval, float *zero_dist)
+{
+}
+
+GLOBAL(int)
+jsimd_trellis_search (int i, int num_preds, const int *preds,
+                      int num_candidates, const float *candidate_dist,
+                      float *accumulated_cost,
+                      const float *accumulated_zero_dist, int *run_start,
+                      const char *ehufsi)
+{
+  return -1;
+}
+
 GLOBAL(int)
 jsimd_can_idct_2x2 (void)
 {
@@ -725,3 +753,31 @@ jsimd_huff_encode_one_block (void *state, JOCTET *buffer, JCOEFPTR block,
   return jsimd_huff_encode_one_block_neon(state, buffer, block, last_dc_val,
                                           dctbl, actbl);
 }
+
+GLOBAL(int)
+jsimd_can_encode_mcu_AC_first_prepare (void)
+{
+  return 0;
+}
+
+GLOBAL(int)
+jsimd_can_encode_mcu_AC_refine_prepare (void)
+{
+  return 0;
+}
+
+GLOBAL(void)
+jsimd_encode_mcu_AC_first_prepare (const JCOEF *block,
+                                   const int *jpeg_natural_order_start,
+                                   int Sl, int Al, JCOEF *values, size_t *bits)
+{
+}
+
+GLOBAL(int)
+jsimd_encode_mcu_AC_refine_prepare (const JCOEF *block,
+                                    const int *jpeg_natural_order_start,
+                                    int Sl, int Al, JCOEF *absvalues,
+                                    size_t *bits)
+{
+  return 0;
+}
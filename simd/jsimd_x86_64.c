@@ -22,6 +22,12 @@
 #include "../jsimddct.h"
 #include "jsimd.h"
 
+#if defined(__GNUC__)
+#include <cpuid.h>
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 /*
  * In the PIC cases, we have no guarantee that constants will keep
  * their alignment. This macro allows us to verify it at runtime.
@@ -33,6 +39,53 @@
 static unsigned int simd_support = ~0;
 static unsigned int simd_huffman = 1;
 
+/*
+ * Check whether the CPU and the OS support AVX2, and whether the CPU supports
+ * the BMI and BMI2 instructions that the AVX2 Huffman encoder also uses.
+ */
+LOCAL(int)
+check_avx2 (void)
+{
+  unsigned int regs[4], xcr0;
+
+#if defined(__GNUC__)
+  if (__get_cpuid_max(0, NULL) < 7)
+    return 0;
+  __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#elif defined(_MSC_VER)
+  __cpuid((int *) regs, 0);
+  if (regs[0] < 7)
+    return 0;
+  __cpuid((int *) regs, 1);
+#else
+  return 0;
+#endif
+
+  /* OSXSAVE and AVX */
+  if ((regs[2] & 0x18000000) != 0x18000000)
+    return 0;
+
+  /* The OS must preserve the XMM and YMM registers. */
+#if defined(__GNUC__)
+  {
+    unsigned int edx;
+    __asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+  }
+#else
+  xcr0 = (unsigned int) _xgetbv(0);
+#endif
+  if ((xcr0 & 6) != 6)
+    return 0;
+
+  /* BMI, AVX2 and BMI2 */
+#if defined(__GNUC__)
+  __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#else
+  __cpuidex((int *) regs, 7, 0);
+#endif
+  return (regs[1] & 0x128) == 0x128;
+}
+
 /*
  * Check what SIMD accelerations are supported.
  *
@@ -47,8 +100,13 @@ init_simd (void)
     return;
 
   simd_support = JSIMD_SSE2 | JSIMD_SSE;
+  if (check_avx2())
+    simd_support |= JSIMD_AVX2;
 
   /* Force different settings through environment variables */
+  env = getenv("JSIMD_FORCESSE2");
+  if ((env != NULL) && (strcmp(env, "1") == 0))
+    simd_support &= JSIMD_SSE2 | JSIMD_SSE;
   env = getenv("JSIMD_FORCENONE");
   if ((env != NULL) && (strcmp(env, "1") == 0))
     simd_support = 0;
@@ -699,6 +757,53 @@ jsimd_quantize_float (JCOEFPTR coef_block, FAST_FLOAT *divisors,
   jsimd_quantize_float_sse2(coef_block, divisors, workspace);
 }
 
+GLOBAL(int)
+jsimd_can_trellis_prep (void)
+{
+  init_simd();
+
+  /* The code is optimised for these values only */
+  if (DCTSIZE != 8)
+    return 0;
+  if (sizeof(JCOEF) != 2)
+    return 0;
+
+  if (simd_support & JSIMD_SSE2)
+    return 1;
+
+  return 0;
+}
+
+GLOBAL(int)
+jsimd_can_trellis_search (void)
+{
+  init_simd();
+
+  if (simd_support & JSIMD_SSE2)
+    return 1;
+
+  return 0;
+}
+
+GLOBAL(void)
+jsimd_trellis_prep (JCOEFPTR src, const int *q, const float *lambda_tbl,
+                    float lambda, int *qval, float *zero_dist)
+{
+  jsimd_trellis_prep_sse2(src, q, lambda_tbl, lambda, qval, zero_dist);
+}
+
+GLOBAL(int)
+jsimd_trellis_search (int i, int num_preds, const int *preds,
+                      int num_candidates, const float *candidate_dist,
+                      float *accumulated_cost,
+                      const float *accumulated_zero_dist, int *run_start,
+                      const char *ehufsi)
+{
+  return jsimd_trellis_search_sse2(i, num_preds, preds, num_candidates,
+                                   candidate_dist, accumulated_cost,
+                                   accumulated_zero_dist, run_start, ehufsi);
+}
+
 GLOBAL(int)
 jsimd_can_idct_2x2 (void)
 {
@@ -870,6 +975,8 @@ jsimd_can_huff_encode_one_block (void)
   if (sizeof(JCOEF) != 2)
     return 0;
 
+  if ((simd_support & JSIMD_AVX2) && simd_huffman)
+    return 1;
   if ((simd_support & JSIMD_SSE2) && simd_huffman &&
       IS_ALIGNED_SSE(jconst_huff_encode_one_block))
     return 1;
@@ -882,6 +989,61 @@ jsimd_huff_encode_one_block (void *state, JOCTET *buffer, JCOEFPTR block,
                              int last_dc_val, c_derived_tbl *dctbl,
                              c_derived_tbl *actbl)
 {
+  if (simd_support & JSIMD_AVX2)
+    return jsimd_huff_encode_one_block_avx2(state, buffer, block, last_dc_val,
+                                            dctbl, actbl);
   return jsimd_huff_encode_one_block_sse2(state, buffer, block, last_dc_val,
                                           dctbl, actbl);
 }
+
+GLOBAL(int)
+jsimd_can_encode_mcu_AC_first_prepare (void)
+{
+  init_simd();
+
+  if (DCTSIZE != 8)
+    return 0;
+  if (sizeof(JCOEF) != 2)
+    return 0;
+
+  if (simd_support & JSIMD_SSE2)
+    return 1;
+
+  return 0;
+}
+
+GLOBAL(int)
+jsimd_can_encode_mcu_AC_refine_prepare (void)
+{
+  init_simd();
+
+  if (DCTSIZE != 8)
+    return 0;
+  if (sizeof(JCOEF) != 2)
+    return 0;
+
+  if (simd_support & JSIMD_SSE2)
+    return 1;
+
+  return 0;
+}
+
+GLOBAL(void)
+jsimd_encode_mcu_AC_first_prepare (const JCOEF *block,
+                                   const int *jpeg_natural_order_start,
+                                   int Sl, int Al, JCOEF *values, size_t *bits)
+{
+  jsimd_encode_mcu_AC_first_prepare_sse2(block, jpeg_natural_order_start,
+                                         Sl, Al, values, bits);
+}
+
+GLOBAL(int)
+jsimd_encode_mcu_AC_refine_prepare (const JCOEF *block,
+                                    const int *jpeg_natural_order_start,
+                                    int Sl, int Al, JCOEF *absvalues,
+                                    size_t *bits)
+{
+  return jsimd_encode_mcu_AC_refine_prepare_sse2(block,
+                                                 jpeg_natural_order_start,
+                                                 Sl, Al, absvalues, bits);
+}
@@ -728,6 +728,12 @@ void usage(char *progname)
 	printf("     codec\n");
 	printf("-accuratedct = Use the most accurate DCT/IDCT algorithms available in the\n");
 	printf("     underlying codec\n");
+	printf("-arithmetic = Use arithmetic entropy coding when testing JPEG compression\n");
+	printf("     (JPEG input files that use arithmetic coding need no option)\n");
+	printf("-parallelrestart = Decode the restart intervals of JPEG images on worker\n");
+	printf("     threads (set TJ_THREADS to override the number of threads)\n");
+	printf("-dconly = Decompress 1/8-scale thumbnails from the DC coefficients of JPEG\n");
+	printf("     images alone (implies -scale 1/8)\n");
 	printf("-subsamp <s> = When testing JPEG compression, this option specifies the level\n");
 	printf("     of chrominance subsampling to use (<s> = 444, 422, 440, 420, 411, or\n");
 	printf("     GRAY).  The default is to test Grayscale, 4:2:0, 4:2:2, and 4:4:4 in\n");
@@ -826,6 +832,23 @@ int main(int argc, char *argv[])
 				printf("Using most accurate DCT/IDCT algorithm\n\n");
 				flags|=TJFLAG_ACCURATEDCT;
 			}
+			if(!strcasecmp(argv[i], "-arithmetic"))
+			{
+				static char arithenv[]="TJ_ARITHMETIC=1";
+				printf("Using arithmetic entropy coding\n\n");
+				putenv(arithenv);
+			}
+			if(!strcasecmp(argv[i], "-parallelrestart"))
+			{
+				printf("Decoding restart intervals in parallel\n\n");
+				flags|=TJFLAG_PARALLELRESTART;
+			}
+			if(!strcasecmp(argv[i], "-dconly"))
+			{
+				printf("Decoding DC coefficients only\n\n");
+				flags|=TJFLAG_DCONLY;
+				sf.num=1;  sf.denom=8;
+			}
 			if(!strcasecmp(argv[i], "-rgb")) pf=TJPF_RGB;
 			if(!strcasecmp(argv[i], "-rgbx")) pf=TJPF_RGBX;
 			if(!strcasecmp(argv[i], "-bgr")) pf=TJPF_BGR;
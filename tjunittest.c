@@ -593,6 +593,142 @@ void doTest(int w, int h, const int *formats, int nformats, int subsamp,
 }
 
 
+/* Compress and decompress a baseline image with restart markers serially and
+   in parallel, and make sure that the results are identical */
+void restartTest(int w, int h, int subsamp, const char *interval)
+{
+	static char revertEnv[]="TJ_REVERT=1", noRevertEnv[]="TJ_REVERT=";
+	static char threadsEnv[]="TJ_THREADS=4", noThreadsEnv[]="TJ_THREADS=";
+	static char restartEnv[80], noRestartEnv[]="TJ_RESTART=";
+	tjhandle chandle=NULL, dhandle=NULL;
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *jpegBuf2=NULL, *dstBuf=NULL,
+		*dstBuf2=NULL;
+	unsigned long jpegSize=0, jpegSize2=0, dstSize;
+	int pf=(subsamp==TJSAMP_GRAY)? TJPF_GRAY:TJPF_RGB, flags=0;
+	tjscalingfactor sf={1, 1};
+
+	if(subsamp!=TJSAMP_444 && subsamp!=TJSAMP_GRAY) flags|=TJFLAG_FASTUPSAMPLE;
+	dstSize=w*h*tjPixelSize[pf];
+	if((srcBuf=(unsigned char *)malloc(dstSize))==NULL
+		|| (dstBuf=(unsigned char *)malloc(dstSize))==NULL
+		|| (dstBuf2=(unsigned char *)malloc(dstSize))==NULL)
+		_throw("Memory allocation failure");
+	initBuf(srcBuf, w, h, pf, 0);
+	memset(dstBuf, 0, dstSize);
+	memset(dstBuf2, 0, dstSize);
+
+	if((chandle=tjInitCompress())==NULL || (dhandle=tjInitDecompress())==NULL)
+		_throwtj();
+
+	printf("%s %dx%d -> %s Q100, restart interval %s, serial and parallel ... ",
+		pixFormatStr[pf], w, h, subNameLong[subsamp], interval);
+	snprintf(restartEnv, 80, "TJ_RESTART=%s", interval);
+	putenv(revertEnv);  putenv(restartEnv);
+	_tj(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize, subsamp,
+		100, flags));
+	putenv(threadsEnv);
+	_tj(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf2, &jpegSize2, subsamp,
+		100, flags));
+	putenv(noThreadsEnv);
+	if(jpegSize2!=jpegSize || memcmp(jpegBuf, jpegBuf2, jpegSize))
+	{
+		printf("FAILED!\n  Parallel result differs from serial result\n");
+		exitStatus=-1;
+	}
+	else printf("Done.\n");
+
+	printf("JPEG -> %s serial and parallel ... ", pixFormatStr[pf]);
+	_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, pf, flags));
+	putenv(threadsEnv);
+	_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf2, w, 0, h, pf,
+		flags|TJFLAG_PARALLELRESTART));
+	if(memcmp(dstBuf, dstBuf2, dstSize))
+	{
+		printf("FAILED!\n  Parallel result differs from serial result\n");
+		exitStatus=-1;
+	}
+	else if(checkBuf(dstBuf2, w, h, pf, subsamp, sf, flags))
+		printf("Passed.\n");
+	else printf("FAILED!\n");
+	printf("\n");
+
+	bailout:
+	putenv(noRevertEnv);  putenv(noRestartEnv);  putenv(noThreadsEnv);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(jpegBuf2) tjFree(jpegBuf2);
+	if(dstBuf2) free(dstBuf2);
+	if(dstBuf) free(dstBuf);
+	if(srcBuf) free(srcBuf);
+}
+
+
+/* Decompress a thumbnail with TJFLAG_DCONLY and make sure that, without
+   chrominance subsampling, it is identical to a regular 1/8-scale
+   decompression */
+void dcOnlyTest(int w, int h, int subsamp, int progressive)
+{
+	static char revertEnv[]="TJ_REVERT=1", noRevertEnv[]="TJ_REVERT=";
+	static char progEnv[]="TJ_PROGRESSIVE=1", noProgEnv[]="TJ_PROGRESSIVE=";
+	tjhandle chandle=NULL, dhandle=NULL;
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *dstBuf=NULL, *dstBuf2=NULL;
+	unsigned long jpegSize=0, dstSize;
+	int pf=(subsamp==TJSAMP_GRAY)? TJPF_GRAY:TJPF_RGB;
+	tjscalingfactor sf={1, 8};
+	int scaledWidth=TJSCALED(w, sf), scaledHeight=TJSCALED(h, sf);
+
+	dstSize=scaledWidth*scaledHeight*tjPixelSize[pf];
+	if((srcBuf=(unsigned char *)malloc(w*h*tjPixelSize[pf]))==NULL
+		|| (dstBuf=(unsigned char *)malloc(dstSize))==NULL
+		|| (dstBuf2=(unsigned char *)malloc(dstSize))==NULL)
+		_throw("Memory allocation failure");
+	initBuf(srcBuf, w, h, pf, 0);
+	memset(dstBuf, 0, dstSize);
+	memset(dstBuf2, 0, dstSize);
+
+	if((chandle=tjInitCompress())==NULL || (dhandle=tjInitDecompress())==NULL)
+		_throwtj();
+
+	printf("%s %dx%d -> %s Q100 %s ... ", pixFormatStr[pf], w, h,
+		subNameLong[subsamp], progressive? "progressive":"baseline");
+	if(progressive) putenv(progEnv);
+	else putenv(revertEnv);
+	_tj(tjCompress2(chandle, srcBuf, w, 0, h, pf, &jpegBuf, &jpegSize, subsamp,
+		100, 0));
+	printf("Done.\n");
+
+	/* The DC-only thumbnail is always scaled to 1/8, even if the destination
+	   is as large as the image */
+	printf("JPEG -> %s %d/%d and DC only ... ", pixFormatStr[pf], sf.num,
+		sf.denom);
+	_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, scaledWidth, 0,
+		scaledHeight, pf, 0));
+	_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf2, w, 0, h, pf,
+		TJFLAG_DCONLY));
+	if(subsamp!=TJSAMP_444 && subsamp!=TJSAMP_GRAY)
+		printf("Done.\n");
+	else if(memcmp(dstBuf, dstBuf2, dstSize))
+	{
+		printf("FAILED!\n  DC-only result differs from 1/8-scale result\n");
+		exitStatus=-1;
+	}
+	else if(checkBuf(dstBuf2, scaledWidth, scaledHeight, pf, subsamp, sf, 0))
+		printf("Passed.\n");
+	else printf("FAILED!\n");
+	printf("\n");
+
+	bailout:
+	putenv(noRevertEnv);  putenv(noProgEnv);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(dstBuf2) free(dstBuf2);
+	if(dstBuf) free(dstBuf);
+	if(srcBuf) free(srcBuf);
+}
+
+
 void bufSizeTest(void)
 {
 	int w, h, i, subsamp;
@@ -718,6 +854,19 @@ int main(int argc, char *argv[])
 	doTest(39, 41, _onlyGray, 1, TJSAMP_GRAY, "test");
 	doTest(41, 35, _3byteFormats, 2, TJSAMP_GRAY, "test");
 	doTest(35, 39, _4byteFormats, 4, TJSAMP_GRAY, "test");
+	restartTest(41, 35, TJSAMP_420, "1B");
+	restartTest(35, 39, TJSAMP_420, "1");
+	restartTest(39, 41, TJSAMP_422, "2B");
+	restartTest(41, 35, TJSAMP_444, "3B");
+	restartTest(39, 41, TJSAMP_GRAY, "5B");
+	restartTest(227, 149, TJSAMP_420, "1");
+	restartTest(227, 149, TJSAMP_420, "7B");
+	dcOnlyTest(41, 35, TJSAMP_444, 0);
+	dcOnlyTest(35, 39, TJSAMP_444, 1);
+	dcOnlyTest(39, 41, TJSAMP_GRAY, 0);
+	dcOnlyTest(41, 35, TJSAMP_GRAY, 1);
+	dcOnlyTest(227, 149, TJSAMP_444, 1);
+	dcOnlyTest(39, 41, TJSAMP_420, 1);
 	bufSizeTest();
 	if(doyuv)
 	{
@@ -0,0 +1,219 @@
+/*
+ * trellistest.c
+ *
+ * Copyright (C) 2026, Mozilla Corporation.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This program checks the number of trellis quantization loops that the
+ * compressor reports through JINT_TRELLIS_LOOPS_USED, with and without
+ * adaptive loop termination (JFLOAT_TRELLIS_LOOP_THRESHOLD.)
+ *
+ * Usage: trellistest <image.ppm>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include "jpeglib.h"
+#include "jerror.h"
+
+#define NUM_LOOPS  3
+
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jb;
+} error_mgr;
+
+typedef struct {
+  struct jpeg_destination_mgr pub;
+  JOCTET buf[4096];
+  unsigned long size;               /* total number of bytes written */
+} count_dest_mgr;
+
+static unsigned char *image;
+static int width, height;
+static int failures = 0;
+
+
+static void my_error_exit (j_common_ptr cinfo)
+{
+  error_mgr *myerr = (error_mgr *)cinfo->err;
+  (*cinfo->err->output_message) (cinfo);
+  longjmp(myerr->jb, 1);
+}
+
+static void init_count_dest (j_compress_ptr cinfo)
+{
+  count_dest_mgr *dest = (count_dest_mgr *)cinfo->dest;
+  dest->pub.next_output_byte = dest->buf;
+  dest->pub.free_in_buffer = sizeof(dest->buf);
+  dest->size = 0;
+}
+
+static boolean empty_count_dest (j_compress_ptr cinfo)
+{
+  count_dest_mgr *dest = (count_dest_mgr *)cinfo->dest;
+  dest->size += sizeof(dest->buf);
+  dest->pub.next_output_byte = dest->buf;
+  dest->pub.free_in_buffer = sizeof(dest->buf);
+  return TRUE;
+}
+
+static void term_count_dest (j_compress_ptr cinfo)
+{
+  count_dest_mgr *dest = (count_dest_mgr *)cinfo->dest;
+  dest->size += sizeof(dest->buf) - dest->pub.free_in_buffer;
+}
+
+
+static int load_ppm (const char *filename)
+{
+  FILE *file;
+  int maxval;
+
+  if ((file = fopen(filename, "rb")) == NULL) {
+    fprintf(stderr, "Could not open %s\n", filename);
+    return 0;
+  }
+  if (fscanf(file, "P6 %d %d %d", &width, &height, &maxval) != 3 ||
+      maxval != 255 || fgetc(file) == EOF) {
+    fprintf(stderr, "%s is not a binary 8-bit PPM file\n", filename);
+    fclose(file);
+    return 0;
+  }
+  if ((image = (unsigned char *)malloc(width * height * 3)) == NULL ||
+      fread(image, width * 3, height, file) != (size_t)height) {
+    fprintf(stderr, "Could not read %s\n", filename);
+    fclose(file);
+    return 0;
+  }
+  fclose(file);
+  return 1;
+}
+
+
+/*
+ * Compress the image with the given settings and return the value of
+ * JINT_TRELLIS_LOOPS_USED, or -1 if the compressor failed.
+ */
+
+static int compress_image (boolean trellis, boolean arith, boolean q_opt,
+                           float threshold, int num_threads,
+                           unsigned long *size)
+{
+  struct jpeg_compress_struct cinfo;
+  error_mgr jerr;
+  count_dest_mgr dest;
+  JSAMPROW row;
+  int loops_used = -1;
+
+  *size = 0;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = my_error_exit;
+  jpeg_create_compress(&cinfo);
+  if (setjmp(jerr.jb))
+    goto bailout;
+
+  dest.pub.init_destination = init_count_dest;
+  dest.pub.empty_output_buffer = empty_count_dest;
+  dest.pub.term_destination = term_count_dest;
+  cinfo.dest = &dest.pub;
+
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 75, TRUE);
+  jpeg_c_set_bool_param(&cinfo, JBOOLEAN_TRELLIS_QUANT, trellis);
+  jpeg_c_set_bool_param(&cinfo, JBOOLEAN_TRELLIS_Q_OPT, q_opt);
+  jpeg_c_set_int_param(&cinfo, JINT_TRELLIS_NUM_LOOPS, NUM_LOOPS);
+  jpeg_c_set_float_param(&cinfo, JFLOAT_TRELLIS_LOOP_THRESHOLD, threshold);
+  jpeg_c_set_int_param(&cinfo, JINT_NUM_THREADS, num_threads);
+  if (arith) {
+    cinfo.arith_code = TRUE;
+    cinfo.optimize_coding = FALSE;
+  }
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    row = &image[cinfo.next_scanline * width * 3];
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+
+  loops_used = jpeg_c_get_int_param(&cinfo, JINT_TRELLIS_LOOPS_USED);
+  *size = dest.size;
+
+bailout:
+  jpeg_destroy_compress(&cinfo);
+  return loops_used;
+}
+
+
+static void check (const char *name, boolean trellis, boolean arith,
+                   boolean q_opt, float threshold, int num_threads,
+                   int min_loops, int max_loops, unsigned long *size)
+{
+  int loops_used = compress_image(trellis, arith, q_opt, threshold,
+                                  num_threads, size);
+
+  printf("%-28s loops used = %d, size = %lu: ", name, loops_used, *size);
+  if (loops_used < min_loops || loops_used > max_loops) {
+    printf("FAILED (expected %d..%d)\n", min_loops, max_loops);
+    failures++;
+  } else
+    printf("OK\n");
+}
+
+
+int main (int argc, char **argv)
+{
+  unsigned long size_all, size_one, size_one_mt, size_q_opt, size;
+
+  if (argc != 2) {
+    fprintf(stderr, "USAGE: %s <image.ppm>\n", argv[0]);
+    return 1;
+  }
+  if (!load_ppm(argv[1]))
+    return 1;
+
+  /* Without a threshold, every loop is run. */
+  check("no threshold", TRUE, FALSE, FALSE, 0.0f, 1, NUM_LOOPS, NUM_LOOPS,
+        &size_all);
+  /* No loop reduces the size by 100%, so only the first loop is run. */
+  check("threshold 1.0", TRUE, FALSE, FALSE, 1.0f, 1, 1, 1, &size_one);
+  check("threshold 1.0, 4 threads", TRUE, FALSE, FALSE, 1.0f, 4, 1, 1,
+        &size_one_mt);
+  if (size_one_mt != size_one) {
+    printf("Multithreaded output differs in size (%lu vs. %lu)\n",
+           size_one_mt, size_one);
+    failures++;
+  }
+  check("threshold 0.01", TRUE, FALSE, FALSE, 0.01f, 1, 1, NUM_LOOPS, &size);
+  check("no trellis", FALSE, FALSE, FALSE, 1.0f, 1, 0, 0, &size);
+  /* Adaptive termination is disabled with quantization table optimization,
+   * so the output must not change.
+   */
+  check("q_opt", TRUE, FALSE, TRUE, 0.0f, 1, NUM_LOOPS, NUM_LOOPS,
+        &size_q_opt);
+  check("q_opt, threshold 1.0", TRUE, FALSE, TRUE, 1.0f, 1, NUM_LOOPS,
+        NUM_LOOPS, &size);
+  if (size != size_q_opt) {
+    printf("Output with q_opt and a threshold differs in size (%lu vs. %lu)\n",
+           size, size_q_opt);
+    failures++;
+  }
+#ifdef C_ARITH_CODING_SUPPORTED
+  /* Adaptive termination has no effect with arithmetic coding. */
+  check("arithmetic, threshold 1.0", TRUE, TRUE, FALSE, 1.0f, 1, NUM_LOOPS,
+        NUM_LOOPS, &size);
+#endif
+
+  free(image);
+  if (failures) {
+    printf("%d test(s) FAILED\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -43,6 +43,7 @@
 #include "./tjutil.h"
 #include "transupp.h"
 #include "./jpegcomp.h"
+#include "./jthread.h"
 
 extern void jpeg_mem_dest_tj(j_compress_ptr, unsigned char **,
 	unsigned long *, boolean);
@@ -227,7 +228,11 @@ static int setCompDefaults(struct jpeg_compress_struct *cinfo,
 	if((env=getenv("TJ_OPTIMIZE"))!=NULL && strlen(env)>0 && !strcmp(env, "1"))
 		cinfo->optimize_coding=TRUE;
 	if((env=getenv("TJ_ARITHMETIC"))!=NULL && strlen(env)>0	&& !strcmp(env, "1"))
+	{
+		/* Arithmetic coding is adaptive and needs no optimization pass */
 		cinfo->arith_code=TRUE;
+		cinfo->optimize_coding=FALSE;
+	}
 	if((env=getenv("TJ_RESTART"))!=NULL && strlen(env)>0)
 	{
 		int temp=-1;  char tempc=0;
@@ -242,6 +247,8 @@ static int setCompDefaults(struct jpeg_compress_struct *cinfo,
 				cinfo->restart_in_rows=temp;
 		}
 	}
+	if((env=getenv("TJ_THREADS"))!=NULL && strlen(env)>0 && atoi(env)>0)
+		cinfo->master->num_threads=atoi(env);
 #endif
 
 	if(jpegQual>=0)
@@ -333,6 +340,21 @@ static int setDecompDefaults(struct jpeg_decompress_struct *dinfo,
 
 	if(flags&TJFLAG_FASTDCT) dinfo->dct_method=JDCT_FASTEST;
 
+	dinfo->master->dc_only=(flags&TJFLAG_DCONLY)? TRUE:FALSE;
+
+	dinfo->master->num_threads=1;
+	if(flags&TJFLAG_PARALLELRESTART)
+	{
+		#ifndef NO_GETENV
+		char *env;
+		#endif
+		dinfo->master->num_threads=jthread_num_cpus();
+		#ifndef NO_GETENV
+		if((env=getenv("TJ_THREADS"))!=NULL && strlen(env)>0 && atoi(env)>0)
+			dinfo->master->num_threads=atoi(env);
+		#endif
+	}
+
 	bailout:
 	return retval;
 }
@@ -1390,6 +1412,7 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle,
 	if(height==0) height=jpegheight;
 	for(i=0; i<NUMSF; i++)
 	{
+		if((flags&TJFLAG_DCONLY) && (sf[i].num!=1 || sf[i].denom!=8)) continue;
 		scaledw=TJSCALED(jpegwidth, sf[i]);
 		scaledh=TJSCALED(jpegheight, sf[i]);
 		if(scaledw<=width && scaledh<=height)
@@ -1754,6 +1777,8 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
 		jpeg_read_header(dinfo, TRUE);
 	}
 	this->headerRead=0;
+	/* The YUV planes must have their usual (subsampled) dimensions. */
+	dinfo->master->dc_only=FALSE;
 	jpegSubsamp=getSubsamp(dinfo);
 	if(jpegSubsamp<0)
 		_throw("tjDecompressToYUVPlanes(): Could not determine subsampling type for JPEG image");
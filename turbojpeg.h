@@ -383,6 +383,27 @@ enum TJCS
  * when decompressing, because this has been shown to have a larger effect.
  */
 #define TJFLAG_ACCURATEDCT   4096
+/**
+ * Decode the restart intervals of a JPEG image in parallel, using one worker
+ * thread per processor (or the number of threads given in the
+ * <tt>TJ_THREADS</tt> environment variable.)  This applies only to
+ * single-scan images that use Huffman coding and contain restart markers,
+ * and it requires memory for the image's DCT coefficients in addition to the
+ * usual buffers.  The decompressed image is the same as without this flag.
+ */
+#define TJFLAG_PARALLELRESTART 8192
+/**
+ * Decompress a 1/8-scale thumbnail of the JPEG image from its DC coefficients
+ * alone.  The AC coefficients of a baseline image are skipped over rather
+ * than stored, and the AC scans of a progressive image are not decoded at
+ * all.  Since subsampled chrominance components are also reduced to one
+ * sample per DCT block, the thumbnail of such an image has less color detail
+ * than that produced by a regular 1/8-scale decompression.  If this flag is
+ * passed to #tjDecompress2(), then the image is always scaled to 1/8,
+ * regardless of the desired width and height (which must not be smaller than
+ * the scaled dimensions.)
+ */
+#define TJFLAG_DCONLY       16384
 
 
 /**